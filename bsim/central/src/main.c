@@ -0,0 +1,705 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+// Simulated phone for BabbleSim. Connects to N peripherals running the
+// accel firmware, sets up MTU / data length / PHY like a phone would,
+// subscribes to the streams of the selected mode and reports goodput,
+// latency and loss per link and stream as "RESULT ..." lines for run.sh.
+// With the sync stream selected it is also the hub the devices take their
+// shared timeline from (timesync.h).
+
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/bluetooth/uuid.h>
+#include "bs_types.h"
+#include "bs_tracing.h"
+#include "time_machine.h"
+#include "bstests.h"
+#include "accel_svc.h"
+#include "timesync.h"
+#include "power_gov.h"
+#include "reduce.h"
+
+extern enum bst_result_t bst_result;
+
+#define FAIL(...) \
+	do { \
+		bst_result = Failed; \
+		bs_trace_error_time_line(__VA_ARGS__); \
+	} while (0)
+
+#define PASS(...) \
+	do { \
+		bst_result = Passed; \
+		bs_trace_info_time(1, __VA_ARGS__); \
+	} while (0)
+
+#define PERIPHERAL_NAME   "AccelDevice"
+// connect + MTU + discovery for one peripheral
+#define SETUP_TIMEOUT_S   10
+
+static const char *const stream_names[ACCEL_STREAM_COUNT] = {
+	"raw", "features", "events", "diag", "actigraphy", "linear", "gravity", "sketch",
+	"trace", "sync", "grid", "rollup", "power", "reduced",
+};
+
+// run parameters: -argstest n=<peripherals> time=<seconds> interval=<1.25 ms units>
+static uint8_t n_periph = 1;
+static uint32_t run_s = 30;
+static uint16_t conn_interval = 24;
+
+// set by the test id
+static const char *mode_name;
+static uint32_t stream_mask;
+
+struct stream_stats {
+	uint32_t pkts;
+	uint32_t bytes;
+	uint32_t first_ms;
+	uint32_t last_ms;
+	// gaps in the sequence numbers (raw blocks, feature windows)
+	uint32_t lost;
+	uint16_t last_seq;
+	uint16_t next_offset;
+	bool seq_valid;
+	// only for packets that carry the device uptime (events, diag). All
+	// simulated devices boot at t=0, so both clocks are comparable.
+	uint32_t lat_n;
+	uint64_t lat_sum_ms;
+	uint32_t lat_max_ms;
+};
+
+struct link {
+	struct bt_conn *conn;
+	uint16_t mtu;
+	uint8_t tx_phy;
+	uint16_t value_handle[ACCEL_STREAM_COUNT];
+	struct bt_gatt_subscribe_params sub[ACCEL_STREAM_COUNT];
+	struct stream_stats st[ACCEL_STREAM_COUNT];
+	// what the peripheral says it dropped, from the last diag packet
+	uint16_t dev_dropped[ACCEL_STREAM_COUNT];
+	uint32_t disconnects;
+	// sync packets with both clocks locked, and the last one's period
+	uint32_t sync_locked;
+	uint32_t period_ns;
+	// next grid index expected
+	uint32_t grid_next;
+	bool grid_valid;
+	// reduced points and the sample indexes they cover
+	uint32_t red_points;
+	uint32_t red_first;
+	uint32_t red_last;
+	bool red_valid;
+};
+
+static struct link links[CONFIG_BT_MAX_CONN];
+static struct bt_uuid_128 stream_uuid[ACCEL_STREAM_COUNT];
+
+static K_SEM_DEFINE(sem_found, 0, 1);
+static K_SEM_DEFINE(sem_connected, 0, 1);
+static K_SEM_DEFINE(sem_mtu, 0, 1);
+static K_SEM_DEFINE(sem_discovered, 0, 1);
+static bt_addr_le_t found_addr;
+static uint8_t conn_err;
+static struct link *setup_link;
+
+// notify characteristics are 0x12345679 + stream, see accel_svc.c
+static void init_stream_uuids(void)
+{
+	for (int s = 0; s < ACCEL_STREAM_COUNT; s++) {
+		stream_uuid[s] = (struct bt_uuid_128)BT_UUID_INIT_128(
+			BT_UUID_128_ENCODE(0x12345679, 0x1234, 0x5678, 0x1234, 0x1234567890ab));
+		sys_put_le32(0x12345679 + s, &stream_uuid[s].val[12]);
+	}
+}
+
+// hub beacon: periodic advertising, 100 ms
+#define BEACON_INTERVAL    80   // 1.25 ms units
+#define BEACON_INTERVAL_MS (BEACON_INTERVAL * 5 / 4)
+
+static struct bt_le_ext_adv *beacon_adv;
+static struct timesync_beacon beacon = {
+	.company = sys_cpu_to_le16(TIMESYNC_COMPANY_ID),
+	.magic = sys_cpu_to_le16(TIMESYNC_MAGIC),
+};
+static uint32_t beacon_start_ms;
+
+// Runs half an interval before each event, so the label always names the
+// event it goes out in however the work item is delayed.
+static void beacon_update(struct k_work *work)
+{
+	struct bt_data ad = BT_DATA(BT_DATA_MANUFACTURER_DATA, &beacon, sizeof(beacon));
+
+	beacon.label = sys_cpu_to_le32((k_uptime_get_32() - beacon_start_ms) / BEACON_INTERVAL_MS + 1);
+	bt_le_per_adv_set_data(beacon_adv, &ad, 1);
+}
+
+static K_WORK_DEFINE(beacon_work, beacon_update);
+
+static void beacon_tick(struct k_timer *timer)
+{
+	k_work_submit(&beacon_work);
+}
+
+static K_TIMER_DEFINE(beacon_timer, beacon_tick, NULL);
+
+static int beacon_start(void)
+{
+	struct bt_data ad = BT_DATA(BT_DATA_MANUFACTURER_DATA, &beacon, sizeof(beacon));
+	int err;
+
+	err = bt_le_ext_adv_create(BT_LE_EXT_ADV_NCONN, NULL, &beacon_adv);
+	if (!err) {
+		err = bt_le_per_adv_set_param(beacon_adv, BT_LE_PER_ADV_PARAM(BEACON_INTERVAL,
+					      BEACON_INTERVAL, BT_LE_PER_ADV_OPT_NONE));
+	}
+	if (!err) {
+		// the same marker in the extended advertising, so devices know what to sync to
+		err = bt_le_ext_adv_set_data(beacon_adv, &ad, 1, NULL, 0);
+	}
+	if (!err) {
+		err = bt_le_per_adv_set_data(beacon_adv, &ad, 1);
+	}
+	if (!err) {
+		err = bt_le_per_adv_start(beacon_adv);
+	}
+	if (!err) {
+		err = bt_le_ext_adv_start(beacon_adv, BT_LE_EXT_ADV_START_DEFAULT);
+	}
+	if (err) {
+		return err;
+	}
+	beacon_start_ms = k_uptime_get_32();
+	k_timer_start(&beacon_timer, K_MSEC(BEACON_INTERVAL_MS / 2), K_MSEC(BEACON_INTERVAL_MS));
+	return 0;
+}
+
+static struct link *find_link(struct bt_conn *conn)
+{
+	for (int i = 0; i < n_periph; i++) {
+		if (links[i].conn == conn) {
+			return &links[i];
+		}
+	}
+	return NULL;
+}
+
+static void track_seq(struct stream_stats *st, uint16_t seq, uint16_t offset, uint16_t count)
+{
+	if (st->seq_valid) {
+		if (seq != st->last_seq) {
+			st->lost += (uint16_t)(seq - st->last_seq - 1);
+			// a new block must start at 0, otherwise its head went missing
+			if (offset != 0) {
+				st->lost++;
+			}
+		} else if (offset != st->next_offset) {
+			st->lost++;
+		}
+	}
+	st->seq_valid = true;
+	st->last_seq = seq;
+	st->next_offset = offset + count;
+}
+
+static void track_latency(struct stream_stats *st, uint32_t dev_uptime_ms, uint32_t now)
+{
+	uint32_t lat = now - dev_uptime_ms;
+
+	st->lat_n++;
+	st->lat_sum_ms += lat;
+	st->lat_max_ms = MAX(st->lat_max_ms, lat);
+}
+
+static uint8_t notify_cb(struct bt_conn *conn, struct bt_gatt_subscribe_params *params,
+			 const void *data, uint16_t length)
+{
+	struct link *l = find_link(conn);
+	uint32_t now = k_uptime_get_32();
+	const uint8_t *p = data;
+	int s;
+
+	if (!data) {
+		// unsubscribed
+		return BT_GATT_ITER_STOP;
+	}
+	if (!l) {
+		return BT_GATT_ITER_CONTINUE;
+	}
+	s = params - l->sub;
+
+	struct stream_stats *st = &l->st[s];
+
+	if (!st->pkts) {
+		st->first_ms = now;
+	}
+	st->pkts++;
+	st->bytes += length;
+	st->last_ms = now;
+
+	switch (s) {
+	case ACCEL_STREAM_RAW:
+		if (length >= sizeof(struct accel_raw_hdr)) {
+			const struct accel_raw_hdr *hdr = data;
+
+			track_seq(st, sys_le16_to_cpu(hdr->seq), hdr->offset, hdr->count);
+		}
+		break;
+	case ACCEL_STREAM_FEATURES:
+		if (length >= sizeof(struct accel_features_pkt)) {
+			track_seq(st, sys_get_le16(p), 0, 0);
+		}
+		break;
+	case ACCEL_STREAM_EVENTS:
+		if (length >= sizeof(struct accel_event_pkt)) {
+			track_latency(st, sys_get_le32(p + offsetof(struct accel_event_pkt, uptime_ms)), now);
+		}
+		break;
+	case ACCEL_STREAM_DIAG:
+		if (length >= sizeof(struct accel_diag_pkt)) {
+			const uint8_t *dropped = p + offsetof(struct accel_diag_pkt, dropped);
+
+			track_latency(st, sys_get_le32(p), now);
+			for (int i = 0; i < ACCEL_STREAM_COUNT; i++) {
+				l->dev_dropped[i] = sys_get_le16(dropped + 2 * i);
+			}
+		}
+		break;
+	case ACCEL_STREAM_POWER:
+		if (length >= sizeof(struct power_gov_report)) {
+			track_latency(st, sys_get_le32(p + offsetof(struct power_gov_report, uptime_ms)),
+				      now);
+		}
+		break;
+	case ACCEL_STREAM_REDUCED:
+		if (length >= sizeof(struct reduce_pkt_hdr)) {
+			const struct reduce_pkt_hdr *hdr = data;
+			uint32_t index = sys_le32_to_cpu(hdr->index);
+			uint8_t n = MIN(hdr->n, (length - sizeof(*hdr)) / REDUCE_PT_BYTES);
+
+			// points only move forward, at most REDUCE_MAX_GAP apart; a
+			// wider gap is a packet that went missing
+			if (l->red_valid && ((int32_t)(index - l->red_last) <= 0 ||
+					     index - l->red_last > REDUCE_MAX_GAP)) {
+				st->lost++;
+			}
+			if (!l->red_valid) {
+				l->red_first = index;
+			}
+			l->red_valid = true;
+			for (int i = 0; i < n; i++) {
+				index += sys_get_le16(p + sizeof(*hdr) + i * REDUCE_PT_BYTES);
+			}
+			l->red_last = index;
+			l->red_points += n;
+		}
+		break;
+	case ACCEL_STREAM_SYNC:
+		if (length >= sizeof(struct accel_sync_pkt)) {
+			const struct accel_sync_pkt *pkt = data;
+
+			track_seq(st, sys_le16_to_cpu(pkt->seq), 0, 0);
+			if (pkt->state == (ACCEL_SYNC_SAMPLE_LOCKED | ACCEL_SYNC_REF_LOCKED)) {
+				l->sync_locked++;
+			}
+			l->period_ns = sys_le32_to_cpu(pkt->period_ns);
+		}
+		break;
+	case ACCEL_STREAM_GRID:
+		if (length >= sizeof(struct accel_grid_hdr)) {
+			const struct accel_grid_hdr *hdr = data;
+			uint32_t index = sys_le32_to_cpu(hdr->index);
+
+			// grid points are consecutive on every device, gaps are lost points
+			if (l->grid_valid && index != l->grid_next) {
+				st->lost += index - l->grid_next;
+			}
+			l->grid_valid = true;
+			l->grid_next = index + hdr->count;
+		}
+		break;
+	default:
+		break;
+	}
+
+	return BT_GATT_ITER_CONTINUE;
+}
+
+static bool ad_has_name(struct bt_data *data, void *user_data)
+{
+	bool *match = user_data;
+
+	if (data->type == BT_DATA_NAME_COMPLETE &&
+	    data->data_len == strlen(PERIPHERAL_NAME) &&
+	    !memcmp(data->data, PERIPHERAL_NAME, data->data_len)) {
+		*match = true;
+		return false;
+	}
+	return true;
+}
+
+static void device_found(const bt_addr_le_t *addr, int8_t rssi, uint8_t type,
+			 struct net_buf_simple *ad)
+{
+	struct bt_conn *conn;
+	bool match = false;
+
+	if (type != BT_GAP_ADV_TYPE_ADV_IND) {
+		return;
+	}
+	bt_data_parse(ad, ad_has_name, &match);
+	if (!match) {
+		return;
+	}
+
+	// already connected to this one
+	conn = bt_conn_lookup_addr_le(BT_ID_DEFAULT, addr);
+	if (conn) {
+		bt_conn_unref(conn);
+		return;
+	}
+
+	if (bt_le_scan_stop()) {
+		return;
+	}
+	bt_addr_le_copy(&found_addr, addr);
+	k_sem_give(&sem_found);
+}
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	conn_err = err;
+	k_sem_give(&sem_connected);
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	struct link *l = find_link(conn);
+
+	if (l) {
+		printk("link %d disconnected (reason 0x%02x)\n", (int)(l - links), reason);
+		l->disconnects++;
+	}
+}
+
+static void le_phy_updated(struct bt_conn *conn, struct bt_conn_le_phy_info *param)
+{
+	struct link *l = find_link(conn);
+
+	if (l) {
+		l->tx_phy = param->tx_phy;
+	}
+}
+
+BT_CONN_CB_DEFINE(conn_callbacks) = {
+	.connected = connected,
+	.disconnected = disconnected,
+	.le_phy_updated = le_phy_updated,
+};
+
+static void mtu_exchanged(struct bt_conn *conn, uint8_t err, struct bt_gatt_exchange_params *params)
+{
+	k_sem_give(&sem_mtu);
+}
+
+static uint8_t discover_cb(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			   struct bt_gatt_discover_params *params)
+{
+	const struct bt_gatt_chrc *chrc;
+
+	if (!attr) {
+		k_sem_give(&sem_discovered);
+		return BT_GATT_ITER_STOP;
+	}
+
+	chrc = attr->user_data;
+	for (int s = 0; s < ACCEL_STREAM_COUNT; s++) {
+		if (!bt_uuid_cmp(chrc->uuid, &stream_uuid[s].uuid)) {
+			setup_link->value_handle[s] = chrc->value_handle;
+		}
+	}
+
+	return BT_GATT_ITER_CONTINUE;
+}
+
+static int setup_one(struct link *l)
+{
+	static struct bt_gatt_exchange_params mtu_params = { .func = mtu_exchanged };
+	static struct bt_gatt_discover_params disc_params;
+	int err;
+
+	err = bt_le_scan_start(BT_LE_SCAN_ACTIVE, device_found);
+	if (err) {
+		return err;
+	}
+	if (k_sem_take(&sem_found, K_SECONDS(SETUP_TIMEOUT_S))) {
+		bt_le_scan_stop();
+		return -ETIMEDOUT;
+	}
+
+	err = bt_conn_le_create(&found_addr, BT_CONN_LE_CREATE_CONN,
+				BT_LE_CONN_PARAM(conn_interval, conn_interval, 0, 400), &l->conn);
+	if (err) {
+		return err;
+	}
+	if (k_sem_take(&sem_connected, K_SECONDS(SETUP_TIMEOUT_S)) || conn_err) {
+		return -ENOTCONN;
+	}
+
+	setup_link = l;
+	l->tx_phy = BT_GAP_LE_PHY_1M;
+
+	// what a phone does right after connecting
+	err = bt_gatt_exchange_mtu(l->conn, &mtu_params);
+	if (!err) {
+		k_sem_take(&sem_mtu, K_SECONDS(SETUP_TIMEOUT_S));
+	} else if (err != -EALREADY) {
+		return err;
+	}
+	l->mtu = bt_gatt_get_mtu(l->conn);
+	bt_conn_le_data_len_update(l->conn, BT_LE_DATA_LEN_PARAM_MAX);
+	bt_conn_le_phy_update(l->conn, BT_CONN_LE_PHY_PARAM_2M);
+
+	disc_params.uuid = NULL;
+	disc_params.func = discover_cb;
+	disc_params.start_handle = BT_ATT_FIRST_ATTRIBUTE_HANDLE;
+	disc_params.end_handle = BT_ATT_LAST_ATTRIBUTE_HANDLE;
+	disc_params.type = BT_GATT_DISCOVER_CHARACTERISTIC;
+	err = bt_gatt_discover(l->conn, &disc_params);
+	if (err) {
+		return err;
+	}
+	if (k_sem_take(&sem_discovered, K_SECONDS(SETUP_TIMEOUT_S))) {
+		return -ETIMEDOUT;
+	}
+
+	for (int s = 0; s < ACCEL_STREAM_COUNT; s++) {
+		struct bt_gatt_subscribe_params *sub = &l->sub[s];
+
+		if (!(stream_mask & BIT(s))) {
+			continue;
+		}
+		if (!l->value_handle[s]) {
+			printk("stream %s not found\n", stream_names[s]);
+			return -ENOENT;
+		}
+		sub->notify = notify_cb;
+		sub->value = BT_GATT_CCC_NOTIFY;
+		sub->value_handle = l->value_handle[s];
+		// accel_svc.c puts every CCC right after its value
+		sub->ccc_handle = l->value_handle[s] + 1;
+		err = bt_gatt_subscribe(l->conn, sub);
+		if (err) {
+			return err;
+		}
+	}
+
+	return 0;
+}
+
+static const char *phy_name(uint8_t phy)
+{
+	switch (phy) {
+	case BT_GAP_LE_PHY_2M:
+		return "2M";
+	case BT_GAP_LE_PHY_CODED:
+		return "Coded";
+	default:
+		return "1M";
+	}
+}
+
+static void report(uint32_t window_ms)
+{
+	uint64_t total_bytes = 0;
+	uint32_t total_lost = 0;
+	uint32_t total_disc = 0;
+
+	for (int i = 0; i < n_periph; i++) {
+		struct link *l = &links[i];
+
+		total_disc += l->disconnects;
+		for (int s = 0; s < ACCEL_STREAM_COUNT; s++) {
+			struct stream_stats *st = &l->st[s];
+
+			if (!(stream_mask & BIT(s))) {
+				continue;
+			}
+			total_bytes += st->bytes;
+			total_lost += st->lost;
+
+			printk("RESULT mode=%s links=%u interval=%u link=%d stream=%s mtu=%u phy=%s "
+			       "pkts=%u bytes=%u goodput_bps=%u lost=%u dev_dropped=%u "
+			       "lat_avg_ms=%u lat_max_ms=%u\n",
+			       mode_name, n_periph, conn_interval, i, stream_names[s], l->mtu,
+			       phy_name(l->tx_phy), st->pkts, st->bytes,
+			       (uint32_t)((uint64_t)st->bytes * 8 * 1000 / window_ms), st->lost,
+			       l->dev_dropped[s],
+			       st->lat_n ? (uint32_t)(st->lat_sum_ms / st->lat_n) : 0, st->lat_max_ms);
+		}
+		if (stream_mask & BIT(ACCEL_STREAM_SYNC)) {
+			printk("RESULT mode=%s links=%u interval=%u link=%d sync locked=%u/%u "
+			       "period_ns=%u\n", mode_name, n_periph, conn_interval, i,
+			       l->sync_locked, l->st[ACCEL_STREAM_SYNC].pkts, l->period_ns);
+		}
+		if (stream_mask & BIT(ACCEL_STREAM_REDUCED)) {
+			printk("RESULT mode=%s links=%u interval=%u link=%d reduced points=%u "
+			       "samples=%u\n", mode_name, n_periph, conn_interval, i, l->red_points,
+			       l->red_valid ? l->red_last - l->red_first + 1 : 0);
+		}
+	}
+
+	printk("RESULT mode=%s links=%u interval=%u total goodput_bps=%u lost=%u disconnects=%u\n",
+	       mode_name, n_periph, conn_interval,
+	       (uint32_t)(total_bytes * 8 * 1000 / window_ms), total_lost, total_disc);
+}
+
+static void test_main(void)
+{
+	uint32_t start;
+	int err;
+
+	bst_ticker_set_next_tick_absolute(
+		(bs_time_t)(n_periph * SETUP_TIMEOUT_S + run_s + 10) * 1000000);
+
+	init_stream_uuids();
+
+	err = bt_enable(NULL);
+	if (err) {
+		FAIL("bt_enable failed (err %d)\n", err);
+		return;
+	}
+
+	if (stream_mask & BIT(ACCEL_STREAM_SYNC)) {
+		err = beacon_start();
+		if (err) {
+			FAIL("hub beacon failed to start (err %d)\n", err);
+			return;
+		}
+	}
+
+	for (int i = 0; i < n_periph; i++) {
+		err = setup_one(&links[i]);
+		if (err) {
+			FAIL("setup of link %d failed (err %d)\n", i, err);
+			return;
+		}
+		printk("link %d up, MTU %u\n", i, links[i].mtu);
+	}
+
+	// measure from when everything is subscribed, earlier links have a head start
+	for (int i = 0; i < n_periph; i++) {
+		memset(links[i].st, 0, sizeof(links[i].st));
+		links[i].sync_locked = 0;
+		links[i].grid_valid = false;
+		links[i].red_points = 0;
+		links[i].red_valid = false;
+	}
+	start = k_uptime_get_32();
+	k_sleep(K_SECONDS(run_s));
+
+	report(k_uptime_get_32() - start);
+
+	for (int i = 0; i < n_periph; i++) {
+		if (links[i].disconnects) {
+			FAIL("link %d dropped during the run\n", i);
+			return;
+		}
+	}
+	PASS("central %s done\n", mode_name);
+}
+
+static void test_args(int argc, char *argv[])
+{
+	for (int i = 0; i < argc; i++) {
+		if (!strncmp(argv[i], "n=", 2)) {
+			n_periph = CLAMP(atoi(argv[i] + 2), 1, CONFIG_BT_MAX_CONN);
+		} else if (!strncmp(argv[i], "time=", 5)) {
+			run_s = atoi(argv[i] + 5);
+		} else if (!strncmp(argv[i], "interval=", 9)) {
+			conn_interval = atoi(argv[i] + 9);
+		}
+	}
+}
+
+static void test_tick(bs_time_t HW_device_time)
+{
+	if (bst_result != Passed) {
+		FAIL("central did not finish in time\n");
+	}
+}
+
+#define ALL_STREAMS (BIT(ACCEL_STREAM_COUNT) - 1)
+
+#define MODE_TEST(name, mask) \
+	static void pre_init_##name(void) \
+	{ \
+		mode_name = #name; \
+		stream_mask = (mask); \
+		bst_result = In_progress; \
+	}
+
+MODE_TEST(raw, BIT(ACCEL_STREAM_RAW))
+MODE_TEST(features, BIT(ACCEL_STREAM_FEATURES))
+MODE_TEST(events, BIT(ACCEL_STREAM_EVENTS))
+MODE_TEST(diag, BIT(ACCEL_STREAM_DIAG))
+MODE_TEST(actigraphy, BIT(ACCEL_STREAM_ACTIGRAPHY))
+MODE_TEST(linear, BIT(ACCEL_STREAM_LINEAR))
+MODE_TEST(gravity, BIT(ACCEL_STREAM_GRAVITY))
+MODE_TEST(sketch, BIT(ACCEL_STREAM_SKETCH))
+MODE_TEST(trace, BIT(ACCEL_STREAM_TRACE))
+MODE_TEST(sync, BIT(ACCEL_STREAM_SYNC) | BIT(ACCEL_STREAM_GRID))
+MODE_TEST(power, BIT(ACCEL_STREAM_POWER))
+MODE_TEST(reduced, BIT(ACCEL_STREAM_REDUCED))
+MODE_TEST(all, ALL_STREAMS)
+
+#define MODE_ENTRY(name) \
+	{ \
+		.test_id = "central_" #name, \
+		.test_descr = "subscribe to " #name " and measure goodput/latency/loss", \
+		.test_args_f = test_args, \
+		.test_pre_init_f = pre_init_##name, \
+		.test_tick_f = test_tick, \
+		.test_main_f = test_main, \
+	}
+
+static const struct bst_test_instance test_def[] = {
+	MODE_ENTRY(raw),
+	MODE_ENTRY(features),
+	MODE_ENTRY(events),
+	MODE_ENTRY(diag),
+	MODE_ENTRY(actigraphy),
+	MODE_ENTRY(linear),
+	MODE_ENTRY(gravity),
+	MODE_ENTRY(sketch),
+	MODE_ENTRY(trace),
+	MODE_ENTRY(sync),
+	MODE_ENTRY(power),
+	MODE_ENTRY(reduced),
+	MODE_ENTRY(all),
+	BSTEST_END_MARKER
+};
+
+struct bst_test_list *test_central_install(struct bst_test_list *tests)
+{
+	return bst_add_tests(tests, test_def);
+}
+
+bst_test_install_t test_installers[] = {
+	test_central_install,
+	NULL
+};
+
+int main(void)
+{
+	bst_main();
+	return 0;
+}
@@ -0,0 +1,132 @@
+#!/usr/bin/env bash
+#
+# Copyright (c) 2024 Nordic Semiconductor
+#
+# SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+#
+# BabbleSim throughput runs: builds the firmware (with the emulated sensor)
+# and the simulated central for nrf52_bsim, then runs one central against
+# N peripherals for each streaming mode and collects the RESULT lines.
+#
+# Needs a Zephyr/NCS environment with BabbleSim installed, i.e. ZEPHYR_BASE,
+# BSIM_OUT_PATH and BSIM_COMPONENTS_PATH set as for the Zephyr bsim tests.
+#
+#   bsim/run.sh [-n peripherals] [-t seconds] [-i interval] [mode...]
+#
+# modes: raw features events diag actigraphy linear gravity sketch trace sync
+# power reduced all (default: all of them). interval is in 1.25 ms units. The power
+# mode runs for at least two governor periods (POWER_GOV_PERIOD_S), there is
+# one report per period.
+# Results end up in build_bsim/results.txt, one line per link and stream plus
+# a total per mode, so runs with different prj.conf settings can be diffed.
+#
+# In the sync mode the central is also the timing hub and every peripheral's
+# sensor runs off nominal ODR by a different amount (-odr_ppm). Each device
+# logs its estimate of when a sample happened next to the simulated time it
+# really did; the spread of (estimate - truth) across devices is how well
+# their samples line up.
+
+set -eu
+
+: "${ZEPHYR_BASE:?}"
+: "${BSIM_OUT_PATH:?}"
+: "${BSIM_COMPONENTS_PATH:?}"
+
+N=1
+SECS=30
+INTERVAL=24
+while getopts "n:t:i:" opt; do
+	case $opt in
+	n) N=$OPTARG ;;
+	t) SECS=$OPTARG ;;
+	i) INTERVAL=$OPTARG ;;
+	*) exit 1 ;;
+	esac
+done
+shift $((OPTIND - 1))
+MODES=${*:-raw features events diag actigraphy linear gravity sketch trace sync power reduced all}
+
+APP_DIR=$(cd "$(dirname "$0")/.." && pwd)
+OUT=$APP_DIR/build_bsim
+BIN=$BSIM_OUT_PATH/bin
+
+west build -b nrf52_bsim --no-sysbuild -d "$OUT/peripheral" "$APP_DIR"
+west build -b nrf52_bsim --no-sysbuild -d "$OUT/central" "$APP_DIR/bsim/central"
+cp "$OUT/peripheral/zephyr/zephyr.exe" "$BIN/bs_nrf52_bsim_accel_peripheral"
+cp "$OUT/central/zephyr/zephyr.exe" "$BIN/bs_nrf52_bsim_accel_central"
+
+: > "$OUT/results.txt"
+cd "$BIN"
+for mode in $MODES; do
+	sim_id=accel_${mode}_n${N}_$$
+	pids=()
+	secs=$SECS
+	if [ "$mode" = power ] && [ "$secs" -lt 130 ]; then
+		secs=130
+	fi
+
+	./bs_nrf52_bsim_accel_central -s="$sim_id" -d=0 -testid="central_$mode" \
+		-RealEncryption=0 -argstest n="$N" time="$secs" interval="$INTERVAL" \
+		> "$OUT/central_$mode.log" 2>&1 &
+	pids+=($!)
+	for i in $(seq 1 "$N"); do
+		extra=()
+		if [ "$mode" = sync ]; then
+			extra=(-odr_ppm=$(( (i - 1) * 3000 - 6000 )))
+		fi
+		./bs_nrf52_bsim_accel_peripheral -s="$sim_id" -d="$i" -RealEncryption=0 ${extra[@]+"${extra[@]}"} \
+			> "$OUT/peripheral_${mode}_$i.log" 2>&1 &
+		pids+=($!)
+	done
+	./bs_2G4_phy_v1 -s="$sim_id" -D=$((N + 1)) \
+		-sim_length=$(((N * 10 + secs + 20) * 1000000)) > /dev/null &
+	pids+=($!)
+
+	status=0
+	for pid in "${pids[@]}"; do
+		wait "$pid" || status=1
+	done
+
+	grep -h "RESULT" "$OUT/central_$mode.log" | sed 's/^.*RESULT/RESULT/' >> "$OUT/results.txt" || true
+	if [ "$mode" = sync ]; then
+		for i in $(seq 1 "$N"); do
+			# SYNC frame=<n> true_us=<t> ref_us=<t>
+			awk -v dev="$i" -v n_dev="$N" '
+				/SYNC frame=/ {
+					for (f = 1; f <= NF; f++) {
+						split($f, kv, "=")
+						v[kv[1]] = kv[2]
+					}
+					if (v["true_us"] == 0) next
+					off = v["ref_us"] - v["true_us"]
+					if (!n || off < lo) lo = off
+					if (!n || off > hi) hi = off
+					sum += off
+					n++
+				}
+				END {
+					printf "RESULT mode=sync links=%d device=%d stamps=%d offset_us=%d jitter_us=%d\n",
+					       n_dev, dev, n, n ? sum / n : 0, hi - lo
+				}' "$OUT/peripheral_sync_$i.log" >> "$OUT/results.txt"
+		done
+		# the common offset is the hub's epoch, only the differences matter
+		grep "mode=sync .*device=" "$OUT/results.txt" | awk '
+			{
+				for (f = 1; f <= NF; f++) {
+					split($f, kv, "=")
+					v[kv[1]] = kv[2]
+				}
+				if (!n || v["offset_us"] < lo) lo = v["offset_us"]
+				if (!n || v["offset_us"] > hi) hi = v["offset_us"]
+				n++
+			}
+			END { printf "RESULT mode=sync links=%d total alignment_spread_us=%d\n", n, hi - lo }' \
+			>> "$OUT/results.txt"
+	fi
+	if [ $status -ne 0 ]; then
+		echo "mode $mode failed, see $OUT/central_$mode.log" >&2
+		exit 1
+	fi
+done
+
+grep "total" "$OUT/results.txt"
@@ -0,0 +1,18 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef ACCEL_FEATURES_H__
+#define ACCEL_FEATURES_H__
+
+#include <stdint.h>
+#include "bma400_defs.h"
+#include "accel_svc.h"
+
+// Per-window statistics of one FIFO batch (mean/min/max/rms per axis, LSB).
+void features_compute(const struct bma400_fifo_sensor_data *samples, uint16_t count,
+		      struct accel_features_pkt *out);
+
+#endif /* ACCEL_FEATURES_H__ */
@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef ACCEL_SVC_H__
+#define ACCEL_SVC_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/toolchain.h>
+#include <zephyr/bluetooth/conn.h>
+#include "bma400_defs.h"
+
+// Each stream is its own notify characteristic with its own CCC, so the
+// phone only subscribes to what it needs. Nothing is computed or sent for a
+// stream that has no subscriber.
+enum accel_stream {
+	ACCEL_STREAM_RAW,       // raw sample batches
+	ACCEL_STREAM_FEATURES,  // per-window mean/min/max/rms
+	ACCEL_STREAM_EVENTS,    // discrete events (activity, taps, overflow...)
+	ACCEL_STREAM_DIAG,      // counters for debugging
+	ACCEL_STREAM_ACTIGRAPHY, // activity count epochs, sent in bulk
+	ACCEL_STREAM_LINEAR,    // gravity-free acceleration, decimated/suppressed
+	ACCEL_STREAM_GRAVITY,   // gravity direction
+	ACCEL_STREAM_SKETCH,    // periodic distribution snapshots
+	ACCEL_STREAM_TRACE,     // raw FIFO capture for replay (fifo_trace.h)
+	ACCEL_STREAM_SYNC,      // sample timestamps on the shared timeline (timesync.h)
+	ACCEL_STREAM_GRID,      // samples resampled to the shared grid
+	ACCEL_STREAM_ROLLUP,    // answers to history queries (rollup.h)
+	ACCEL_STREAM_POWER,     // accounted vs projected current (power_gov.h)
+	ACCEL_STREAM_REDUCED,   // bounded-error points (reduce.h)
+	ACCEL_STREAM_COUNT
+};
+
+// Lower number = higher priority. When TX buffers run low, lower priority
+// streams are held back first so events always get through.
+enum accel_stream_prio {
+	ACCEL_PRIO_HIGH,
+	ACCEL_PRIO_NORMAL,
+	ACCEL_PRIO_LOW,
+};
+
+// largest notification payload (ATT MTU 247 - 3)
+#define ACCEL_SVC_MAX_PAYLOAD 244
+
+// notifications in flight across all streams
+#define ACCEL_SVC_TX_SLOTS 8
+
+// event ids sent on ACCEL_STREAM_EVENTS
+enum accel_event {
+	ACCEL_EVT_ACTIVITY = 1,
+	ACCEL_EVT_SINGLE_TAP,
+	ACCEL_EVT_DOUBLE_TAP,
+	ACCEL_EVT_ORIENT,
+	ACCEL_EVT_FIFO_OVERFLOW,
+	ACCEL_EVT_GESTURE,      // arg = gesture id
+	ACCEL_EVT_WEAR,         // arg = 1 worn, 0 off body
+	ACCEL_EVT_LEVEL,        // arg = cascade level now in effect (cascade.h)
+};
+
+// raw batch header, followed by count * (x, y, z) int16 LE.
+// seq is the block number, offset the index of the first sample in the block
+// when a block is split over several notifications.
+struct accel_raw_hdr {
+	uint16_t seq;
+	uint8_t offset;
+	uint8_t count;
+} __packed;
+
+struct accel_features_pkt {
+	uint16_t seq;
+	uint8_t count;
+	int16_t mean[3];
+	int16_t min[3];
+	int16_t max[3];
+	uint16_t rms[3];
+} __packed;
+
+struct accel_event_pkt {
+	uint8_t id;
+	uint32_t uptime_ms;
+	uint16_t arg;
+} __packed;
+
+// all fields little endian like the other packets
+struct accel_diag_pkt {
+	uint32_t uptime_ms;
+	uint32_t drains;
+	uint32_t samples;
+	uint16_t sent[ACCEL_STREAM_COUNT];
+	uint16_t dropped[ACCEL_STREAM_COUNT];
+	int16_t min_slack_ms;      // least FIFO service slack so far (fifo_deadline.h)
+	uint16_t deadline_missed;  // drains too late to keep every frame
+	uint32_t adv_ms;           // advertising so far (adv_sched.h)
+	uint32_t adv_uc;           // and its charge
+	uint32_t cascade_ms[3];    // time at trigger, confirm, stream (cascade.h)
+	uint16_t gesture_runs;     // DTW runs (gesture.h)
+	uint16_t gesture_abandoned; // of those, cut short by the early abandon
+	uint16_t gesture_detected;
+	uint32_t gesture_cycles;   // average cycles per DTW run
+} __packed;
+
+// sent once per drained batch, describes the raw block with the same seq
+struct accel_sync_pkt {
+	uint16_t seq;
+	uint8_t count;
+	uint8_t state;          // ACCEL_SYNC_* flags
+	uint32_t t_ref_us;      // first sample on the shared timeline, low 32 bits
+	uint32_t period_ns;     // sample period on the shared timeline
+	int16_t ref_err_us;     // residual of the last beacon
+	uint16_t beacons;       // beacons received since boot
+} __packed;
+
+#define ACCEL_SYNC_SAMPLE_LOCKED  BIT(0)  // sample clock tracked from the interrupts
+#define ACCEL_SYNC_REF_LOCKED     BIT(1)  // t_ref_us is on the hub timeline, else local
+
+// grid batch header, followed by count * (x, y, z) int16 LE. Sample i is at
+// (index + i) * the nominal sample period on the shared timeline.
+struct accel_grid_hdr {
+	uint32_t index;
+	uint8_t count;
+} __packed;
+
+void accel_svc_set_conn(struct bt_conn *conn);
+
+bool accel_svc_subscribed(enum accel_stream stream);
+
+// Loopback for trace replay: every stream except TRACE counts as subscribed
+// and notifications complete immediately without a connection.
+void accel_svc_set_sink(bool on);
+
+// notification payload that fits the current MTU
+uint16_t accel_svc_payload_len(void);
+
+// min time between notifications on a stream (0 = no limit)
+void accel_svc_set_rate(enum accel_stream stream, uint16_t min_interval_ms);
+
+// written to the settings characteristic, one setting per write
+enum accel_setting_key {
+	ACCEL_SET_RATE = 1,        // index = stream, value = min interval (ms)
+	ACCEL_SET_SKETCH_PERIOD,   // value = sketch snapshot period (s), sketch.h
+	ACCEL_SET_ACTIG_EPOCH,     // value = actigraphy epoch (s), actigraphy.h
+	ACCEL_SET_LIN_DECIM,       // value = linear stream decimation, gravity.h
+	ACCEL_SET_LIN_THRESH,      // value = linear suppression threshold (mg)
+};
+
+struct accel_setting {
+	uint8_t key;
+	uint8_t index;
+	uint16_t value;
+} __packed;
+
+int accel_svc_setting(const void *buf, uint16_t len);
+void accel_svc_set_prio(enum accel_stream stream, enum accel_stream_prio prio);
+enum accel_stream_prio accel_svc_get_prio(enum accel_stream stream);
+
+// Streams with a lower priority than this count as unsubscribed, so they are
+// neither computed nor sent (the power governor's profiles).
+void accel_svc_set_emit(enum accel_stream_prio lowest);
+
+// subscribed by the phone, whether or not the priority lets it through
+bool accel_svc_requested(enum accel_stream stream);
+
+// Sends one notification on the stream. Returns -ENOTCONN if no one is
+// subscribed, -EAGAIN if held back by rate/priority, -EMSGSIZE if it does
+// not fit the MTU, or the stack error.
+int accel_svc_send(enum accel_stream stream, const void *data, uint16_t len);
+
+// Encoding in place: reserve the shared payload buffer, write the packet
+// into it, then commit, which sends it like accel_svc_send() and gives the
+// buffer back. *cap is what fits the current MTU. NULL while another
+// encoder holds the buffer. accel_svc_release() gives it back unsent.
+uint8_t *accel_svc_reserve(uint16_t *cap);
+int accel_svc_commit(enum accel_stream stream, uint16_t len);
+void accel_svc_release(void);
+
+// Packs and sends a block of samples on ACCEL_STREAM_RAW, split to fit the
+// MTU. Starts at sample *offset and moves it past every notification that
+// went out, so a block cut short by an error is resumed where it stopped.
+int accel_svc_send_raw(uint16_t seq, const struct bma400_fifo_sensor_data *samples, uint16_t count,
+		       uint8_t *offset);
+
+int accel_svc_send_event(enum accel_event id, uint16_t arg);
+
+// per-stream counters for the diagnostics stream
+void accel_svc_get_counts(uint16_t sent[ACCEL_STREAM_COUNT], uint16_t dropped[ACCEL_STREAM_COUNT]);
+
+// payload bytes handed to the stack on a stream since boot
+uint32_t accel_svc_get_bytes(enum accel_stream stream);
+
+const char *accel_svc_stream_name(enum accel_stream stream);
+
+#endif /* ACCEL_SVC_H__ */
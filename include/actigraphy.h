@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef ACTIGRAPHY_H__
+#define ACTIGRAPHY_H__
+
+#include <stdint.h>
+#include <zephyr/toolchain.h>
+#include "bma400_defs.h"
+
+// ActiGraph-style activity counts: each axis goes through a 0.29-1.63 Hz
+// band-pass, is rectified, dead-banded and integrated over an epoch.
+// One small record per epoch is kept in a ring and sent in bulk on the
+// actigraphy stream, instead of the raw 25 Hz data.
+
+#define ACTIG_EPOCH_S_MAX       60
+#define ACTIG_RING_RECORDS      384   // ~1 h at 10 s epochs, 6.4 h at 60 s
+#define ACTIG_BULK_RECORDS      16    // send once this many records are pending
+#define ACTIG_DEADBAND_MG       17    // ~ one count, removes sensor noise
+
+struct actig_record {
+	uint32_t start_s;     // uptime at the start of the epoch
+	uint16_t counts[3];   // x, y, z
+	uint16_t vm;          // vector magnitude of the three
+} __packed;
+
+// bulk packet header, followed by n records
+struct actig_pkt_hdr {
+	uint16_t seq;         // sequence number of the first record
+	uint8_t epoch_s;
+	uint8_t n;
+} __packed;
+
+// The epoch starts as CONFIG_APP_ACTIGRAPHY_EPOCH_S. A new length is picked
+// up by the next batch, which closes the running epoch early.
+void actigraphy_set_epoch(uint8_t seconds);
+
+// feed one decoded FIFO batch
+void actigraphy_process(const struct bma400_fifo_sensor_data *samples, uint16_t count);
+
+// sends pending records if the actigraphy stream has a subscriber
+void actigraphy_flush(void);
+
+#endif /* ACTIGRAPHY_H__ */
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef ADV_SCHED_H__
+#define ADV_SCHED_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/toolchain.h>
+#include <zephyr/bluetooth/bluetooth.h>
+
+// Advertising windows opened by the sensor, instead of advertising from
+// boot until someone connects. A trigger (reset, motion, a tap, a dropped
+// link) opens a fast window of fast_s at fast_ms; slow_s at slow_ms follow,
+// then nothing until the next trigger. Another trigger while fast extends
+// the window. slow_s = 0 goes straight to off, ADV_SCHED_FOREVER stays slow.
+//
+// Time is counted per phase and charge with the power governor's figure
+// for an advertising event, one event per interval.
+
+enum adv_trigger {
+	ADV_TRIG_RESET,
+	ADV_TRIG_MOTION,       // GEN1 activity, or a confirmed wake-up (cascade.h)
+	ADV_TRIG_TAP,
+	ADV_TRIG_DISCONNECT,
+	ADV_TRIG_COUNT
+};
+
+enum adv_phase {
+	ADV_PHASE_OFF,
+	ADV_PHASE_FAST,
+	ADV_PHASE_SLOW,
+	ADV_PHASE_CONN,
+	ADV_PHASE_COUNT
+};
+
+#define ADV_SCHED_FOREVER      0xFFFF
+#define ADV_SCHED_RETRY_MS     1000     // start refused (connection not freed yet)
+
+// written to the schedule characteristic, takes effect with the next phase
+struct adv_sched_cfg {
+	uint16_t fast_s;
+	uint16_t fast_ms;      // interval, 20-10240 ms
+	uint16_t slow_s;
+	uint16_t slow_ms;
+} __packed;
+
+struct adv_sched_stats {
+	uint32_t ms[ADV_PHASE_COUNT];
+	uint32_t events;       // advertising events, from time and interval
+	uint32_t charge_uc;
+	uint32_t windows;      // fast windows opened
+	uint32_t triggers[ADV_TRIG_COUNT];
+};
+
+// from bt_ready(), opens the first window (ADV_TRIG_RESET)
+void adv_sched_start(const struct bt_data *ad, size_t ad_len);
+
+// any context; ignored while connected
+void adv_sched_trigger(enum adv_trigger trig);
+
+void adv_sched_set_conn(bool connected);
+
+// Not connected: the drain reads the interrupt status for motion and taps
+// even when no stream needs it.
+bool adv_sched_listening(void);
+
+int adv_sched_configure(const void *buf, uint16_t len);
+
+void adv_sched_get_stats(struct adv_sched_stats *stats);
+
+#endif /* ADV_SCHED_H__ */
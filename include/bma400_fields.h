@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef BMA400_FIELDS_H__
+#define BMA400_FIELDS_H__
+
+#include <stdint.h>
+#include <zephyr/sys/util.h>
+#include "bma400.h"
+#include "bma400_defs.h"
+#include "spi_trace.h"
+
+// Register fields as compile-time descriptors. A field is (register, mask)
+// and BMA400_FV() places a value in it. Several fields of one register
+// merge into one access when the code is compiled: the masks and the
+// constant parts of the values fold, a plain write when the fields cover
+// the whole register and a read-modify-write otherwise. Fields of
+// different registers, or overlapping ones, in one access don't compile.
+// Values may be run-time expressions, only the masks have to be constant.
+//
+// The driver gets there at run time instead: bma400_enable_interrupt()
+// reads and writes both INT_CONFIG registers and goes through a switch per
+// entry to change one bit. Both end in the same registers through the same
+// transport (the bma400_dev the backend set up), so they mix freely.
+//
+// SEQ_FIELDS() in sensor_seq.h is the step for a sequence,
+// BMA400_FIELDS_SET() the blocking access for anything else.
+
+#define BMA400_FLD(reg, msk)         (reg, msk)
+
+#define BMA400_F_POWER_MODE          BMA400_FLD(BMA400_REG_ACCEL_CONFIG_0, BMA400_POWER_MODE_MSK)
+#define BMA400_F_OSR_LP              BMA400_FLD(BMA400_REG_ACCEL_CONFIG_0, BMA400_OSR_LP_MSK)
+#define BMA400_F_FILT1_BW            BMA400_FLD(BMA400_REG_ACCEL_CONFIG_0, BMA400_FILT_1_BW_MSK)
+#define BMA400_F_ODR                 BMA400_FLD(BMA400_REG_ACCEL_CONFIG_1, BMA400_ACCEL_ODR_MSK)
+#define BMA400_F_OSR                 BMA400_FLD(BMA400_REG_ACCEL_CONFIG_1, BMA400_OSR_MSK)
+#define BMA400_F_RANGE               BMA400_FLD(BMA400_REG_ACCEL_CONFIG_1, BMA400_ACCEL_RANGE_MSK)
+#define BMA400_F_DATA_SRC            BMA400_FLD(BMA400_REG_ACCEL_CONFIG_2, BMA400_DATA_FILTER_MSK)
+
+// not in the vendor defs
+#define BMA400_REG_INT_CONF_1        UINT8_C(0x20)
+#define BMA400_REG_FIFO_CONFIG_1     UINT8_C(0x27)
+#define BMA400_REG_FIFO_CONFIG_2     UINT8_C(0x28)
+
+#define BMA400_F_EN_DRDY             BMA400_FLD(BMA400_REG_INT_CONF_0, BMA400_EN_DRDY_MSK)
+#define BMA400_F_EN_FIFO_WM          BMA400_FLD(BMA400_REG_INT_CONF_0, BMA400_EN_FIFO_WM_MSK)
+#define BMA400_F_EN_FIFO_FULL        BMA400_FLD(BMA400_REG_INT_CONF_0, BMA400_EN_FIFO_FULL_MSK)
+#define BMA400_F_EN_GEN2             BMA400_FLD(BMA400_REG_INT_CONF_0, BMA400_EN_GEN2_MSK)
+#define BMA400_F_EN_GEN1             BMA400_FLD(BMA400_REG_INT_CONF_0, BMA400_EN_GEN1_MSK)
+#define BMA400_F_EN_ORIENT_CH        BMA400_FLD(BMA400_REG_INT_CONF_0, BMA400_EN_ORIENT_CH_MSK)
+#define BMA400_F_EN_LATCH            BMA400_FLD(BMA400_REG_INT_CONF_1, BMA400_EN_LATCH_MSK)
+#define BMA400_F_EN_ACTCH            BMA400_FLD(BMA400_REG_INT_CONF_1, BMA400_EN_ACTCH_MSK)
+#define BMA400_F_EN_D_TAP            BMA400_FLD(BMA400_REG_INT_CONF_1, BMA400_EN_D_TAP_MSK)
+#define BMA400_F_EN_S_TAP            BMA400_FLD(BMA400_REG_INT_CONF_1, BMA400_EN_S_TAP_MSK)
+
+#define BMA400_F_FIFO_AUTO_FLUSH     BMA400_FLD(BMA400_REG_FIFO_CONFIG_0, BMA400_FIFO_AUTO_FLUSH)
+#define BMA400_F_FIFO_STOP_ON_FULL   BMA400_FLD(BMA400_REG_FIFO_CONFIG_0, BMA400_FIFO_STOP_ON_FULL)
+#define BMA400_F_FIFO_TIME_EN        BMA400_FLD(BMA400_REG_FIFO_CONFIG_0, BMA400_FIFO_TIME_EN)
+#define BMA400_F_FIFO_DATA_SRC       BMA400_FLD(BMA400_REG_FIFO_CONFIG_0, BMA400_FIFO_DATA_SRC)
+#define BMA400_F_FIFO_8_BIT          BMA400_FLD(BMA400_REG_FIFO_CONFIG_0, BMA400_FIFO_8_BIT_EN)
+#define BMA400_F_FIFO_XYZ            BMA400_FLD(BMA400_REG_FIFO_CONFIG_0, GENMASK(7, 5))
+// watermark, the upper register is whole: bits 7:3 are reserved and written 0
+#define BMA400_F_FIFO_WM_LO          BMA400_FLD(BMA400_REG_FIFO_CONFIG_1, GENMASK(7, 0))
+#define BMA400_F_FIFO_WM_HI          BMA400_FLD(BMA400_REG_FIFO_CONFIG_2, GENMASK(7, 0))
+
+#define BMA400_FLD_REG_(reg, msk)    (reg)
+#define BMA400_FLD_MSK_(reg, msk)    (msk)
+#define BMA400_FLD_REG(fld)          BMA400_FLD_REG_ fld
+#define BMA400_FLD_MSK(fld)          BMA400_FLD_MSK_ fld
+
+// field value: (register, mask, bits)
+#define BMA400_FV(fld, v) \
+	(BMA400_FLD_REG(fld), BMA400_FLD_MSK(fld), FIELD_PREP(BMA400_FLD_MSK(fld), (v)))
+
+#define BMA400_FV_REG_(reg, msk, bits)   (reg)
+#define BMA400_FV_MSK_(reg, msk, bits)   (msk)
+#define BMA400_FV_BITS_(reg, msk, bits)  (bits)
+#define BMA400_FV_REG(fv)            BMA400_FV_REG_ fv
+#define BMA400_FV_MSK(fv)            BMA400_FV_MSK_ fv
+#define BMA400_FV_BITS(fv)           BMA400_FV_BITS_ fv
+
+// Merged over the field values of one access. All registers are the same
+// exactly when OR and AND of them agree, the masks are disjoint when their
+// sum is their OR.
+#define BMA400_FVS_REG(...)          BMA400_FV_REG(GET_ARG_N(1, __VA_ARGS__))
+#define BMA400_FVS_MSK(...)          ((uint8_t)(FOR_EACH(BMA400_FV_MSK, (|), __VA_ARGS__)))
+#define BMA400_FVS_BITS(...)         ((uint8_t)(FOR_EACH(BMA400_FV_BITS, (|), __VA_ARGS__)))
+#define BMA400_FVS_OK(...)                                                     \
+	((FOR_EACH(BMA400_FV_REG, (|), __VA_ARGS__)) ==                        \
+	 (FOR_EACH(BMA400_FV_REG, (&), __VA_ARGS__)) &&                        \
+	 (FOR_EACH(BMA400_FV_MSK, (+), __VA_ARGS__)) ==                        \
+	 (FOR_EACH(BMA400_FV_MSK, (|), __VA_ARGS__)))
+// the register, or a compile error
+#define BMA400_FVS_REG_CHECKED(...)                                            \
+	(BMA400_FVS_REG(__VA_ARGS__) + ZERO_OR_COMPILE_ERROR(BMA400_FVS_OK(__VA_ARGS__)))
+
+static inline int8_t bma400_fields_update(struct bma400_dev *dev, uint8_t reg, uint8_t mask,
+					  uint8_t bits)
+{
+	uint8_t v = bits;
+	int8_t rslt = BMA400_OK;
+
+	if (mask != 0xFF) {
+		rslt = SPI_TRACED(bma400_get_regs, reg, &v, 1, dev);
+		v = (v & ~mask) | bits;
+	}
+	if (rslt == BMA400_OK) {
+		rslt = SPI_TRACED(bma400_set_regs, reg, &v, 1, dev);
+	}
+	return rslt;
+}
+
+// e.g. BMA400_FIELDS_SET(dev, BMA400_FV(BMA400_F_OSR, 3), BMA400_FV(BMA400_F_ODR, odr))
+#define BMA400_FIELDS_SET(dev, ...)                                            \
+	bma400_fields_update((dev), BMA400_FVS_REG_CHECKED(__VA_ARGS__),       \
+			     BMA400_FVS_MSK(__VA_ARGS__), BMA400_FVS_BITS(__VA_ARGS__))
+
+#endif /* BMA400_FIELDS_H__ */
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef CASCADE_H__
+#define CASCADE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "bma400_defs.h"
+#include "sensor_cfg.h"
+
+// Sensing cascade, each level costlier than the one before and only
+// entered when that one saw something worth it:
+//
+// CASCADE_TRIGGER: sensor in low power mode, GEN1 activity on the pin and
+//   nothing else. No FIFO interrupt, the MCU sleeps.
+// CASCADE_CONFIRM: after a GEN1 wake-up the sensor stays in low power mode
+//   and the FIFO collects one window of CONFIG_APP_CASCADE_CONFIRM_S, drained
+//   once at the watermark. The window is moving when an axis spans more than
+//   CASCADE_MOTION_MG, or tilted when its mean is CASCADE_TILT_MG away from
+//   where the device last came to rest. Either promotes, otherwise (or
+//   without a drain in CONFIG_APP_CASCADE_CONFIRM_TIMEOUT_S) it is back to
+//   the trigger.
+// CASCADE_STREAM: normal mode FIFO streaming through every stage. Demoted
+//   when wear_state.h finds the device off body, or after
+//   CONFIG_APP_CASCADE_IDLE_S without a moving window when that is set.
+//
+// The switches are sequences in main.c; this keeps the rules and the time
+// spent at each level.
+
+enum cascade_level {
+	CASCADE_TRIGGER,
+	CASCADE_CONFIRM,
+	CASCADE_STREAM,
+	CASCADE_LEVEL_COUNT
+};
+
+enum cascade_verdict {
+	CASCADE_PENDING,      // window not complete yet
+	CASCADE_PROMOTE,
+	CASCADE_DEMOTE,
+};
+
+#define CASCADE_WINDOW     (CONFIG_APP_CASCADE_CONFIRM_S * SENSOR_ODR_HZ)
+#define CASCADE_MOTION_MG  120    // peak to peak on any axis within a window
+#define CASCADE_TILT_MG    200    // ~12 degrees
+
+struct cascade_stats {
+	uint32_t ms[CASCADE_LEVEL_COUNT];
+	uint32_t promoted;    // confirm windows that went on to streaming
+	uint32_t rejected;
+	uint32_t timeouts;
+	uint32_t idle;        // demotions from streaming for lack of motion
+};
+
+// the level in effect, once the sequence switching to it is through
+void cascade_set_level(enum cascade_level level);
+
+// CASCADE_CONFIRM: feeds the decoded window, a verdict once it is complete
+enum cascade_verdict cascade_confirm(const struct bma400_fifo_sensor_data *samples,
+				     uint16_t count);
+void cascade_confirm_timeout(void);
+
+// CASCADE_STREAM: watches for motion and the resting orientation
+void cascade_process(const struct bma400_fifo_sensor_data *samples, uint16_t count);
+
+// true (once) when streaming has gone CONFIG_APP_CASCADE_IDLE_S without motion
+bool cascade_take_idle(void);
+
+void cascade_get_stats(struct cascade_stats *stats);
+
+#endif /* CASCADE_H__ */
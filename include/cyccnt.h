@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef CYCCNT_H__
+#define CYCCNT_H__
+
+#include <stdint.h>
+#include <zephyr/kernel.h>
+
+// CPU cycle counter for profiling. k_cycle_get_32() runs off the 32 kHz RTC
+// on nRF, which is far too coarse for timing a single function, so use the
+// DWT cycle counter where there is one.
+#if defined(CONFIG_CPU_CORTEX_M_HAS_DWT)
+#include <cmsis_core.h>
+#include <nrfx.h> // SystemCoreClock
+
+static inline void cyccnt_init(void)
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+static inline uint32_t cyccnt_get(void)
+{
+	return DWT->CYCCNT;
+}
+
+static inline uint32_t cyccnt_to_us(uint32_t cycles)
+{
+	return cycles / (SystemCoreClock / 1000000);
+}
+#elif defined(CONFIG_BOARD_NATIVE_SIM)
+// Kernel time doesn't move while code runs on native_sim, so time the host
+// instead (host_clock.c lives on the runner side). One cycle = 1 ns.
+#include "host_clock.h"
+
+static inline void cyccnt_init(void)
+{
+}
+
+static inline uint32_t cyccnt_get(void)
+{
+	return (uint32_t)host_clock_ns();
+}
+
+static inline uint32_t cyccnt_to_us(uint32_t cycles)
+{
+	return cycles / 1000;
+}
+#else
+static inline void cyccnt_init(void)
+{
+}
+
+static inline uint32_t cyccnt_get(void)
+{
+	return k_cycle_get_32();
+}
+
+static inline uint32_t cyccnt_to_us(uint32_t cycles)
+{
+	return k_cyc_to_us_floor32(cycles);
+}
+#endif
+
+#endif /* CYCCNT_H__ */
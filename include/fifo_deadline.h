@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef FIFO_DEADLINE_H__
+#define FIFO_DEADLINE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/kernel.h>
+
+// Deadline monitor for the FIFO drain. From the watermark edge on, the
+// reader has until the first frame it can't keep: the FIFO running full, or
+// more frames piling up than one drain decodes, whichever comes first. Each
+// drain records its latency (edge to FIFO read done) against that budget.
+//
+// A timer armed at the edge fires when a drain has used up
+// FIFO_DEADLINE_WARN_PCT of the budget. That warns and raises the reader
+// thread by FIFO_DEADLINE_BOOST priority levels while there is still time;
+// it drops back after FIFO_DEADLINE_RECOVER_DRAINS drains on time.
+
+#define FIFO_DEADLINE_HW_BYTES        1024
+#define FIFO_DEADLINE_WARN_PCT        50
+#define FIFO_DEADLINE_BOOST           3
+#define FIFO_DEADLINE_RECOVER_DRAINS  16
+#define FIFO_DEADLINE_REPORT_DRAINS   256
+
+// latency histogram, bucket 0 is < 64 us, then doubling; the last one is open
+#define FIFO_DEADLINE_HIST_BUCKETS    16
+#define FIFO_DEADLINE_HIST_MIN_US     64
+
+struct fifo_deadline_stats {
+	uint32_t budget_us;
+	uint32_t drains;
+	uint32_t max_latency_us;
+	int32_t min_slack_us;      // negative: a drain was past the deadline
+	uint32_t warnings;         // drains that reached the warn point
+	uint32_t missed;           // drains past the deadline, frames were lost
+	uint16_t max_fill_bytes;
+	uint32_t hist[FIFO_DEADLINE_HIST_BUCKETS];
+};
+
+// Sets the budget from the active FIFO config. cap_frames is how many frames
+// one drain decodes, reader the thread to escalate.
+void fifo_deadline_config(uint32_t odr_hz, uint8_t frame_bytes, uint16_t wm_bytes,
+			  uint16_t cap_frames, k_tid_t reader);
+
+// from the watermark interrupt
+void fifo_deadline_edge(void);
+
+// after the FIFO was read, with the number of FIFO bytes read
+void fifo_deadline_drained(uint16_t fill_bytes);
+
+void fifo_deadline_get_stats(struct fifo_deadline_stats *stats);
+
+#endif /* FIFO_DEADLINE_H__ */
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef FIFO_TRACE_H__
+#define FIFO_TRACE_H__
+
+#include <stdint.h>
+#include <zephyr/toolchain.h>
+#include "bma400_defs.h"
+
+// Field traces: every FIFO drain exactly as the driver read it, so real
+// motion can be replayed through the pipeline later (trace_replay.c).
+//
+// A trace is a stream of records, each a struct fifo_trace_rec followed by
+// len payload bytes, all little endian:
+//   FIFO_TRACE_REC_HEADER  struct fifo_trace_header
+//   FIFO_TRACE_REC_REGS    struct fifo_trace_regs, config registers at capture time
+//   FIFO_TRACE_REC_DRAIN   uint16_t int_status + the FIFO bytes (no SPI dummy byte)
+// A new header is written whenever capture (re)starts, so a reader can
+// resync on it after a gap.
+//
+// On air (ACCEL_STREAM_TRACE) the record stream is cut into notifications of
+// one sequence byte followed by the next chunk of the stream. The phone
+// appends the chunks to a file and starts a new file on a sequence gap.
+
+#define FIFO_TRACE_MAGIC    0x43525446 // "FTRC"
+#define FIFO_TRACE_VERSION  1
+
+enum fifo_trace_rec_type {
+	FIFO_TRACE_REC_HEADER = 1,
+	FIFO_TRACE_REC_REGS,
+	FIFO_TRACE_REC_DRAIN,
+};
+
+struct fifo_trace_rec {
+	uint8_t type;
+	uint8_t reserved;
+	uint16_t len;
+	uint32_t t_ms;      // device uptime
+} __packed;
+
+struct fifo_trace_header {
+	uint32_t magic;
+	uint16_t version;
+	uint8_t chip_id;
+	uint8_t reserved;
+} __packed;
+
+// ACCEL_CONFIG_0 .. GEN2/ACT_CH/TAP config. The data and status registers
+// in front of it are left out: reading them pops the FIFO or clears status.
+#define FIFO_TRACE_REG_FIRST  BMA400_REG_ACCEL_CONFIG_0
+#define FIFO_TRACE_REG_LAST   0x5F
+
+struct fifo_trace_regs {
+	uint8_t first;
+	uint8_t v[FIFO_TRACE_REG_LAST - FIFO_TRACE_REG_FIRST + 1];
+} __packed;
+
+// Called after every drain with the status and the raw FIFO buffer as the
+// driver read it (SPI dummy byte first). Only does something while
+// ACCEL_STREAM_TRACE is subscribed.
+void fifo_trace_capture(struct bma400_dev *dev, uint16_t int_status,
+			const uint8_t *fifo, uint16_t len);
+
+#endif /* FIFO_TRACE_H__ */
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef FIXMATH_H__
+#define FIXMATH_H__
+
+#include <stdint.h>
+
+// Small integer helpers shared by the processing stages. Everything on the
+// sample path stays in integer / Q15 so it runs the same with or without FPU.
+
+#define Q15_ONE  INT16_MAX
+
+// integer square root (floor)
+static inline uint32_t isqrt64(uint64_t v)
+{
+	uint64_t res = 0;
+	uint64_t bit = (uint64_t)1 << 62;
+
+	while (bit > v) {
+		bit >>= 2;
+	}
+	while (bit) {
+		if (v >= res + bit) {
+			v -= res + bit;
+			res = (res >> 1) + bit;
+		} else {
+			res >>= 1;
+		}
+		bit >>= 2;
+	}
+	return (uint32_t)res;
+}
+
+static inline uint32_t isqrt32(uint32_t v)
+{
+	return isqrt64(v);
+}
+
+static inline int16_t sat16(int32_t v)
+{
+	if (v > INT16_MAX) {
+		return INT16_MAX;
+	}
+	if (v < INT16_MIN) {
+		return INT16_MIN;
+	}
+	return (int16_t)v;
+}
+
+// Q15 multiply with rounding
+static inline int32_t q15_mul(int32_t a, int32_t b)
+{
+	return (int32_t)(((int64_t)a * b + (1 << 14)) >> 15);
+}
+
+#endif /* FIXMATH_H__ */
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef GESTURE_H__
+#define GESTURE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/toolchain.h>
+#include "bma400_defs.h"
+
+// Template-matching gesture recognizer. The GEN1 activity status opens a
+// candidate window, which is closed on the first quiet batch (or when it is
+// full) and matched against the stored templates with a band-constrained,
+// early-abandoning DTW in Q15. Only the id of the best match is sent, on the
+// events stream.
+
+#define GESTURE_MAX_TEMPLATES   4
+#define GESTURE_TMPL_MAX        32    // points per template
+#define GESTURE_WIN_MIN         10    // shorter windows are ignored
+#define GESTURE_WIN_MAX         64    // ~2.5 s at 25 Hz
+#define GESTURE_BAND            6     // Sakoe-Chiba band (samples)
+
+// Template as written over GATT. Points are int8 at 16 sensor LSB (~31 mg)
+// per unit, the same rate as the sensor ODR. threshold is the max average
+// per-step L1 distance in Q15 for a match. len = 0 clears the slot.
+struct gesture_tmpl_wire {
+	uint8_t slot;
+	uint8_t id;
+	uint8_t len;
+	uint16_t threshold;
+	int8_t pts[];         // len * (x, y, z)
+} __packed;
+
+struct gesture_stats {
+	uint32_t windows;
+	uint32_t matches;     // DTW runs
+	uint32_t abandoned;   // runs cut short by the early abandon
+	uint32_t detected;
+	uint32_t last_cycles;   // cycles of the last DTW run
+	uint32_t avg_cycles;
+};
+
+// called from the GATT write handler, returns 0 or a negative errno
+int gesture_load_template(const void *data, uint16_t len);
+
+// feed one decoded batch and the interrupt status read with it.
+// Returns the detected gesture id or 0.
+uint8_t gesture_process(const struct bma400_fifo_sensor_data *samples, uint16_t count,
+			bool active);
+
+void gesture_get_stats(struct gesture_stats *stats);
+
+#endif /* GESTURE_H__ */
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef GRAVITY_H__
+#define GRAVITY_H__
+
+#include <stdint.h>
+#include <zephyr/toolchain.h>
+#include "bma400_defs.h"
+
+// Splits the accel stream into gravity and linear acceleration. Gravity is a
+// one-pole low-pass (Q15 coefficient, state kept across FIFO batches), linear
+// is the sample minus gravity.
+//
+// Gravity goes out as a Q15 unit vector on its own stream. Linear is mostly
+// near zero, so it is box-car decimated, packed as int8 and batches whose
+// peak stays under a threshold are not sent at all.
+
+#define GRAVITY_TAU_MS          1000  // low-pass time constant
+#define GRAVITY_LIN_SHIFT       2     // int8 LSB = 4 sensor LSB (~7.8 mg), +/-1 g
+
+struct gravity_pkt {
+	uint16_t seq;
+	int16_t dir[3];       // Q15 unit vector
+	uint16_t mag;         // |g| in sensor LSB
+} __packed;
+
+// linear packet header, followed by n * (x, y, z) int8 in GRAVITY_LIN_SHIFT units
+struct linear_pkt_hdr {
+	uint16_t seq;         // counts decimated output samples, gaps = suppressed
+	uint8_t decim;
+	uint8_t n;
+} __packed;
+
+// Decimation and suppression threshold of the linear stream, defaults from
+// CONFIG_APP_GRAVITY_LIN_DECIM / _THRESH_MG. A new decimation is picked up
+// by the next batch.
+void gravity_set_decimation(uint8_t decim);
+void gravity_set_threshold(uint16_t mg);
+
+// feed one decoded FIFO batch, sends on the gravity/linear streams if subscribed
+void gravity_process(const struct bma400_fifo_sensor_data *samples, uint16_t count);
+
+#endif /* GRAVITY_H__ */
@@ -0,0 +1,16 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef HOST_CLOCK_H__
+#define HOST_CLOCK_H__
+
+#include <stdint.h>
+
+// native_sim only: host monotonic clock, built into the native simulator
+// runner so it can use the host libc.
+uint64_t host_clock_ns(void);
+
+#endif /* HOST_CLOCK_H__ */
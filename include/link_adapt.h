@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef LINK_ADAPT_H__
+#define LINK_ADAPT_H__
+
+#include <stdint.h>
+#include <zephyr/bluetooth/conn.h>
+
+// Link adaptation loop: every LINK_ADAPT_PERIOD_MS the RSSI of the active
+// connection is read and, together with the notification delivery stats,
+// used to step the TX power and pick 1M / 2M / Coded PHY.
+#define LINK_ADAPT_PERIOD_MS      2000
+
+// RSSI thresholds (dBm) with some hysteresis between them
+#define LINK_ADAPT_RSSI_STRONG    (-55)  // close to the phone: lower TX power, 2M PHY
+#define LINK_ADAPT_RSSI_GOOD      (-70)  // leave TX power alone
+#define LINK_ADAPT_RSSI_WEAK      (-82)  // raise TX power
+#define LINK_ADAPT_RSSI_EDGE      (-90)  // max TX power and Coded PHY if the controller has it
+
+// a PHY update the peer neither completes nor rejects is given up after
+// this many periods, so the next one can be asked for
+#define LINK_ADAPT_PHY_TIMEOUT    5
+
+// notifications that took longer than this to be acked are counted as retransmitted
+#define LINK_ADAPT_SLOW_TX_MS     50
+
+void link_adapt_start(struct bt_conn *conn);
+void link_adapt_stop(void);
+
+// called from the notify path: queued = bytes handed to the stack,
+// failed = bt_gatt_notify found no TX buffer (-ENOMEM); other errors are
+// not the link's doing and are not reported
+void link_adapt_tx_queued(uint16_t len);
+void link_adapt_tx_failed(void);
+// called from the notify completion callback
+void link_adapt_tx_done(uint16_t len, uint32_t queued_at_ms);
+
+// PHY update callback from the connection callbacks
+void link_adapt_phy_updated(struct bt_conn *conn, uint8_t tx_phy, uint8_t rx_phy);
+
+#endif /* LINK_ADAPT_H__ */
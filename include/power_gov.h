@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef POWER_GOV_H__
+#define POWER_GOV_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/toolchain.h>
+#include <zephyr/bluetooth/conn.h>
+#include "accel_svc.h"
+
+// Power governor: picks the sensing profile that fits an average current
+// budget, so a lifetime target (capacity / hours, e.g. 225 mAh over 14
+// days is 670 uA) doesn't need the sensor and link settings worked out by
+// hand.
+//
+// Charge is accounted on the device from what actually happened: time in
+// each sensor mode, FIFO drains (bus bytes and CPU time), connection or
+// advertising events and notifications, each priced by the current model
+// in power_gov.c. Every POWER_GOV_PERIOD_S the period's average goes out on
+// ACCEL_STREAM_POWER next to what the model projected for it, and the
+// richest profile whose projection fits the budget is picked. Overspend so
+// far is paid back over POWER_GOV_PAYBACK_S, and the projections are
+// scaled by how far the last one was off.
+//
+// The ODR stays at SENSOR_ODR_HZ, the filters of the processing stages are
+// built for it. Profiles differ in oversampling, FIFO format, watermark,
+// connection parameters and the lowest stream priority still emitted.
+
+#define POWER_GOV_PERIOD_S     60
+#define POWER_GOV_PAYBACK_S    3600
+#define POWER_GOV_UP_PCT       90     // a richer profile has to fit with this much to spare
+// one advertising event on all three channels, nC; adv_sched.c counts with it too
+#define POWER_GOV_ADV_EVENT_NC 6000
+
+struct power_gov_profile {
+	const char *name;
+	uint8_t osr;                 // normal mode oversampling, 0-3
+	uint8_t frame_bytes;         // FIFO_FRAME_BYTES (8 bit) or FIFO_FRAME_BYTES_12BIT
+	uint16_t wm_frames;          // FIFO watermark
+	uint16_t conn_min;           // 1.25 ms units
+	uint16_t conn_max;
+	uint16_t conn_latency;
+	uint16_t conn_timeout;       // 10 ms units
+	enum accel_stream_prio lowest_prio;  // streams below it are not emitted
+};
+
+// written to the budget characteristic; without prio only the budget
+// changes, 0xFF in prio keeps that stream's priority. budget_na = 0 turns
+// the governor off (it still accounts and reports).
+struct power_gov_cfg {
+	uint32_t budget_na;
+	uint8_t prio[ACCEL_STREAM_COUNT];
+} __packed;
+
+// sent on ACCEL_STREAM_POWER once per period
+struct power_gov_report {
+	uint32_t uptime_ms;
+	uint32_t budget_na;
+	uint32_t target_na;      // budget less the payback of overspend
+	uint32_t actual_na;      // accounted over the period
+	uint32_t projected_na;   // what was projected for it
+	uint32_t next_na;        // projected for the profile picked now
+	int32_t debt_uc;         // charge spent over budget so far
+	uint16_t life_h;         // battery life at actual_na
+	uint8_t profile;         // picked now, 0 = richest
+	uint8_t scale_pct;       // actual / model over the recent periods
+} __packed;
+
+// starts the periodic evaluation with the Kconfig budget
+void power_gov_init(void);
+
+int power_gov_configure(const void *buf, uint16_t len);
+
+// Profile the governor wants, NULL while it is the one in effect. The FIFO
+// drain applies it and reports back with power_gov_applied().
+const struct power_gov_profile *power_gov_pending(void);
+void power_gov_applied(const struct power_gov_profile *p);
+const struct power_gov_profile *power_gov_active(void);
+
+// accounting, from the FIFO drain: bytes read and the time it kept the CPU up
+void power_gov_drain(uint16_t bytes, uint32_t cpu_us);
+// sensor in low power mode (off body), FIFO not running
+void power_gov_low_power(bool on);
+// connection and advertising state, from the connection callbacks and the
+// advertising schedule (interval_ms = 0: not advertising)
+void power_gov_set_conn(struct bt_conn *conn);
+void power_gov_set_adv(uint16_t interval_ms);
+// hub timeline (timesync.h): scan duty in percent while looking, beacon
+// interval while synced, 0 for neither
+void power_gov_set_timesync(uint8_t scan_pct, uint16_t sync_ms);
+
+#endif /* POWER_GOV_H__ */
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef REDUCE_H__
+#define REDUCE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/toolchain.h>
+#include "bma400_defs.h"
+
+// Bounded-error reduction for consumers that state a tolerance. Only the
+// points needed to rebuild every axis within its bound go out on
+// ACCEL_STREAM_REDUCED, each with its sample index (samples since boot).
+//
+// REDUCE_DEADBAND: send on delta. A sample goes out when an axis moved more
+// than its bound from the last point sent; the consumer holds the last
+// point until the next one.
+// REDUCE_DOOR: swinging door. Points are the vertices of a piecewise linear
+// curve, every sample lies within the bound of the line between the points
+// around it. The door is kept per axis; when one closes, the vertex is
+// placed on all three, so a point always carries x, y and z. A vertex goes
+// out when the sample after it doesn't fit, one sample late.
+//
+// Either way a point goes out at least every REDUCE_MAX_GAP samples, so a
+// still signal doesn't look like a lost link. reduce_rx_*() is the
+// reference reconstructor; the trace replay build runs both modes against
+// the input and reports ratio and worst error.
+
+enum reduce_mode {
+	REDUCE_DEADBAND,
+	REDUCE_DOOR,
+	REDUCE_MODE_COUNT
+};
+
+#define REDUCE_TOL_MG      20
+#define REDUCE_MAX_GAP     250    // 10 s at 25 Hz
+
+struct reduce_point {
+	uint32_t index;
+	int16_t v[3];
+};
+
+struct reducer {
+	uint8_t mode;
+	int16_t tol[3];              // LSB
+	bool open;
+	struct reduce_point anchor;  // last point emitted
+	struct reduce_point prev;    // last sample seen
+	int64_t lo[3];               // door, Q16 LSB per sample
+	int64_t hi[3];
+};
+
+typedef void (*reduce_out_t)(const struct reduce_point *p, void *user);
+
+// written to the reduction characteristic, takes effect with the next batch
+struct reduce_cfg {
+	uint8_t mode;
+	uint16_t tol_mg[3];
+} __packed;
+
+// packet header, followed by n * { uint16_t dt; int16_t x, y, z; } LE with
+// dt the samples since the point before it (0 for the first, at index)
+struct reduce_pkt_hdr {
+	uint32_t index;
+	uint8_t mode;
+	uint8_t n;
+} __packed;
+
+#define REDUCE_PT_BYTES    8
+
+void reduce_init(struct reducer *r, uint8_t mode, const uint16_t tol_mg[3]);
+
+// the next sample starts over with a point of its own
+void reduce_reset(struct reducer *r);
+
+void reduce_push(struct reducer *r, uint32_t index, const int16_t v[3],
+		 reduce_out_t out, void *user);
+
+// Reference reconstructor. Each received point completes the samples since
+// the one before it: out() gets every index up to and including the point.
+struct reduce_rx {
+	uint8_t mode;
+	bool have;
+	struct reduce_point last;
+};
+
+typedef void (*reduce_rx_out_t)(uint32_t index, const int16_t v[3], void *user);
+
+void reduce_rx_init(struct reduce_rx *rx);
+void reduce_rx_point(struct reduce_rx *rx, const struct reduce_point *p,
+		     reduce_rx_out_t out, void *user);
+int reduce_rx_packet(struct reduce_rx *rx, const uint8_t *buf, uint16_t len,
+		     reduce_rx_out_t out, void *user);
+
+// feed one decoded FIFO batch, sends on the reduced stream if subscribed
+void reduce_process(const struct bma400_fifo_sensor_data *samples, uint16_t count);
+
+int reduce_configure(const void *buf, uint16_t len);
+
+// trace replay: REPLAY lines with ratio and worst error per mode
+void reduce_report(void);
+
+#endif /* REDUCE_H__ */
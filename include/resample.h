@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef RESAMPLE_H__
+#define RESAMPLE_H__
+
+#include <stdint.h>
+
+// Fractional resampler onto an exact grid. Every input sample comes with its
+// own timestamp (from the tracked sample clock, so the BMA400 oscillator
+// error and any ODR switch are already in it); output samples sit at exact
+// multiples of the nominal period on the same timeline.
+//
+// Catmull-Rom cubic between the middle two samples of a 4-sample window,
+// with the position in Q15, so the output lags the input by one sample.
+// The window and the next grid index carry over from one batch to the
+// next, and over ODR changes since only the timestamps matter. Going down
+// in rate relies on the sensor's own filter (acc_filt1, 0.4 x ODR) for
+// anti-aliasing. A timestamp that goes backwards or leaves a hole of more
+// than RESAMPLE_MAX_GAP periods starts over.
+
+#define RESAMPLE_MAX_GAP  4
+
+struct resampler {
+	uint32_t period_us;
+	int64_t next;           // next grid index to produce
+	int64_t t[4];
+	int16_t v[4][3];
+	uint8_t fill;
+};
+
+typedef void (*resample_out_t)(int64_t index, const int16_t xyz[3], void *user);
+
+void resample_init(struct resampler *rs, uint32_t period_us);
+
+// drops the window, the next sample starts over
+void resample_reset(struct resampler *rs);
+
+// Adds one sample at t_us, calls out for every grid point it completes.
+void resample_push(struct resampler *rs, int64_t t_us, const int16_t xyz[3],
+		   resample_out_t out, void *user);
+
+#endif /* RESAMPLE_H__ */
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef RETAINED_RING_H__
+#define RETAINED_RING_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "bma400_defs.h"
+#include "sensor_cfg.h"
+
+// Ring of decoded sample blocks kept in __noinit RAM. RAM survives a warm
+// reset (watchdog, fault, sys_reboot) on nRF, so blocks that were drained
+// but not yet sent are picked up again after boot instead of being lost.
+// Only a real power cycle clears it, no flash writes involved.
+
+#define RETAINED_RING_BLOCKS      32   // ~32 s of data at 25 Hz / 25 sample watermark
+#define RETAINED_RING_BLOCK_MAX   FIFO_SAMPLES  // samples per block (one FIFO watermark)
+
+struct retained_block {
+	uint16_t seq;         // running block number, carried across resets
+	uint8_t count;
+	uint8_t boot;         // low byte of the boot counter it was recorded in
+	uint32_t uptime_ms;
+	struct bma400_fifo_sensor_data s[RETAINED_RING_BLOCK_MAX];
+	uint32_t crc;
+};
+
+// Validates the retained header and blocks, resets the ring if anything is
+// off. Returns the number of unsent blocks that survived.
+uint16_t retained_ring_init(void);
+
+// Copies a drained batch into the ring (count is clamped to a block).
+// The oldest unsent block is overwritten when the ring is full. Returns the
+// seq the block got.
+uint16_t retained_ring_push(const struct bma400_fifo_sensor_data *samples, uint16_t count);
+
+// Oldest unsent block or NULL, stays in the ring until retained_ring_pop()
+const struct retained_block *retained_ring_peek(void);
+void retained_ring_pop(void);
+
+uint16_t retained_ring_pending(void);
+uint32_t retained_ring_boot_count(void);
+
+#endif /* RETAINED_RING_H__ */
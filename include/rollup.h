@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef ROLLUP_H__
+#define ROLLUP_H__
+
+#include <stdint.h>
+#include <zephyr/toolchain.h>
+#include "bma400_defs.h"
+
+// History at three resolutions, so a phone that was away for an hour can
+// ask what happened without raw data being logged. Per second, minute and
+// hour: min/max/mean/RMS per axis, each tier a fixed ring. Samples go into
+// the open second; a closed second is folded into the open minute, a closed
+// minute into the open hour, so each batch costs O(1) on top of the per
+// sample sums.
+//
+// The phone writes a struct rollup_query to the query characteristic and
+// gets the tier's records in that time range on ACCEL_STREAM_ROLLUP,
+// several per notification, ending with an empty packet.
+
+enum rollup_tier {
+	ROLLUP_SECOND,
+	ROLLUP_MINUTE,
+	ROLLUP_HOUR,
+	ROLLUP_TIER_COUNT
+};
+
+#define ROLLUP_SECOND_RECORDS  60    // last minute
+#define ROLLUP_MINUTE_RECORDS  60    // last hour
+#define ROLLUP_HOUR_RECORDS    24    // last day
+
+struct rollup_rec {
+	uint32_t start_s;     // uptime at the start of the period
+	uint32_t n;           // samples in it, less than nominal across gaps
+	int16_t min[3];
+	int16_t max[3];
+	int16_t mean[3];
+	uint16_t rms[3];      // all in sensor LSB
+} __packed;
+
+// written to the query characteristic; to_s = 0 means up to now
+struct rollup_query {
+	uint8_t tier;
+	uint32_t from_s;
+	uint32_t to_s;
+} __packed;
+
+// answer packet header, followed by n records; n = 0 ends the answer,
+// ROLLUP_N_MTU ends it unanswered because not one record fits the ATT MTU
+// (a central that never exchanged it)
+#define ROLLUP_N_MTU           0xFF
+
+struct rollup_pkt_hdr {
+	uint8_t tier;
+	uint8_t n;
+	uint16_t seq;         // packet number within the answer
+} __packed;
+
+// feed one decoded FIFO batch
+void rollup_process(const struct bma400_fifo_sensor_data *samples, uint16_t count);
+
+// starts answering a query, replacing one still in progress
+int rollup_query(const void *buf, uint16_t len);
+
+#endif /* ROLLUP_H__ */
@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef SENSOR_CFG_H__
+#define SENSOR_CFG_H__
+
+#include "bma400_defs.h"
+
+// Sensor settings the processing stages need to know about. Change them
+// here, not in init_fifo_watermark(), so the stages follow along.
+#define SENSOR_ODR              BMA400_ODR_25HZ
+#define SENSOR_ODR_HZ           25
+#define SENSOR_RANGE            BMA400_RANGE_4G
+#define SENSOR_LSB_PER_G        512  // 12 bit over +/-4 g (8 bit FIFO data is shifted up to 12 bit)
+
+#define FIFO_SAMPLES 25 // number of samples for fifo content
+#define FIFO_FRAME_BYTES 4 // header + 8 bit X, Y, Z
+#define FIFO_FRAME_BYTES_12BIT 7 // header + 12 bit X, Y, Z, the power governor's richest profile
+
+#endif /* SENSOR_CFG_H__ */
@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef SENSOR_EMUL_H__
+#define SENSOR_EMUL_H__
+
+#include <stdint.h>
+#include "bma400_defs.h"
+
+// Register-level stand-in for the BMA400 on boards without one (nrf52_bsim,
+// native_sim). bma400.c talks to it through the same read/write hooks as the
+// SPI functions in main.c, so the driver and everything after it run
+// unmodified. Samples are generated at the configured ODR into a 1 KB FIFO
+// and the watermark interrupt is raised through a callback instead of a GPIO.
+// On nrf52_bsim -odr_ppm=<n> detunes the sample rate like a real part's
+// oscillator would be.
+
+// synthetic motion: alternating still / moving phases of this length
+#define SENSOR_EMUL_PHASE_S 10
+
+typedef void (*sensor_emul_irq_t)(void);
+
+// irq is called (from the timer ISR) when the FIFO fill crosses the watermark
+void sensor_emul_start(sensor_emul_irq_t irq);
+
+// Simulated time a FIFO frame (counted from the first one since start) was
+// written, 0 if it is too old. Ground truth for the timestamp model.
+uint64_t sensor_emul_frame_time_us(uint32_t frame);
+
+BMA400_INTF_RET_TYPE sensor_emul_read(uint8_t reg_address, uint8_t *data, uint32_t len, void *intf_ptr);
+BMA400_INTF_RET_TYPE sensor_emul_write(uint8_t reg_address, const uint8_t *data, uint32_t len, void *intf_ptr);
+
+#endif /* SENSOR_EMUL_H__ */
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef SENSOR_SEQ_H__
+#define SENSOR_SEQ_H__
+
+#include <stdint.h>
+#include <zephyr/kernel.h>
+#include "bma400_defs.h"
+#include "bma400_fields.h"
+
+// Sensor executor: one work queue for everything that talks to the BMA400,
+// the bring-up in main() included. FIFO drains are submitted to it from the interrupt, and
+// multi-step configuration runs on it as a sequence of steps.
+//
+// The vendor driver sleeps in dev->delay_us() in the middle of its
+// multi-step calls (power mode switch 10-40 ms, soft reset, FIFO read
+// enable), which would hold up every drain behind it. A sequence does the
+// register writes itself and turns each wait into a delayed continuation
+// on the queue, so a drain that comes up during a reconfiguration runs in
+// between. One sequence runs at a time.
+
+struct sensor_seq_step {
+	uint8_t op;
+	uint8_t reg;
+	uint8_t mask;
+	uint8_t val;
+	uint32_t us;
+	int8_t (*fn)(void);
+};
+
+enum {
+	SENSOR_SEQ_UPDATE,   // reg = (reg & ~mask) | val
+	SENSOR_SEQ_WRITE,
+	SENSOR_SEQ_READ,     // dummy read, e.g. to get SPI mode back after reset
+	SENSOR_SEQ_WAIT,
+	SENSOR_SEQ_CALL,     // anything else without waits, BMA400_OK to go on
+};
+
+#define SEQ_UPDATE(r, m, v)  { .op = SENSOR_SEQ_UPDATE, .reg = (r), .mask = (m), .val = (v) }
+#define SEQ_WRITE(r, v)      { .op = SENSOR_SEQ_WRITE, .reg = (r), .val = (v) }
+#define SEQ_READ(r)          { .op = SENSOR_SEQ_READ, .reg = (r) }
+#define SEQ_WAIT_US(t)       { .op = SENSOR_SEQ_WAIT, .us = (t) }
+#define SEQ_CALL(f)          { .op = SENSOR_SEQ_CALL, .fn = (f) }
+
+// BMA400_FV() values of one register as one step (bma400_fields.h), a
+// write when they cover the register
+#define SEQ_FIELDS(...) {                                                     \
+	.op = BMA400_FVS_MSK(__VA_ARGS__) == 0xFF ? SENSOR_SEQ_WRITE : SENSOR_SEQ_UPDATE, \
+	.reg = BMA400_FVS_REG_CHECKED(__VA_ARGS__),                           \
+	.mask = BMA400_FVS_MSK(__VA_ARGS__),                                  \
+	.val = BMA400_FVS_BITS(__VA_ARGS__) }
+
+// The driver's blocking calls, as steps. A switch takes 1/ODR in the old
+// mode, low power mode always runs at 25 Hz.
+#define SEQ_POWER_MODE(mode)                                                  \
+	SEQ_FIELDS(BMA400_FV(BMA400_F_POWER_MODE, (mode))),                   \
+	SEQ_WAIT_US((mode) == BMA400_MODE_LOW_POWER ? 40000 : 10000)
+#define SEQ_SOFT_RESET()                                                      \
+	SEQ_WRITE(BMA400_REG_COMMAND, BMA400_SOFT_RESET_CMD),                 \
+	SEQ_WAIT_US(BMA400_DELAY_US_SOFT_RESET),                              \
+	SEQ_READ(0x7F)
+#define SEQ_FIFO_READ_ENABLE()                                                \
+	SEQ_WRITE(BMA400_REG_FIFO_READ_EN, 0),                                \
+	SEQ_WAIT_US(1000)
+
+// called on the queue when a sequence is over, rslt of the step it ended on
+typedef void (*sensor_seq_done_t)(int8_t rslt);
+
+// starts the queue; bus_on/bus_off wrap every run of steps
+void sensor_seq_init(struct bma400_dev *dev, void (*bus_on)(void), void (*bus_off)(void));
+
+struct k_work_q *sensor_seq_queue(void);
+
+// From the queue (a drain or a done callback). -EBUSY while another
+// sequence runs.
+int sensor_seq_start(const struct sensor_seq_step *steps, uint8_t n, sensor_seq_done_t done);
+
+bool sensor_seq_busy(void);
+
+#endif /* SENSOR_SEQ_H__ */
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef SKETCH_H__
+#define SKETCH_H__
+
+#include <stdint.h>
+#include <zephyr/toolchain.h>
+#include "bma400_defs.h"
+
+// Constant-memory distribution sketches for long-term monitoring. Every
+// decoded batch updates fixed log-bucket histograms (4 buckets per octave,
+// ~19 % resolution) of:
+//  - the acceleration magnitude of every sample
+//  - the per-batch RMS of each axis around its batch mean (vibration)
+// At the end of each period a small snapshot of quantiles is stored and
+// published on the sketch stream and the histograms start over. The period
+// is CONFIG_APP_SKETCH_PERIOD_S until sketch_set_period() changes it.
+
+#define SKETCH_BUCKETS          48    // covers 0..4095 LSB
+#define SKETCH_SNAPSHOTS        48    // two days of hourly snapshots
+
+// Quantiles are sent as bucket indexes, use sketch_bucket_value() (or the
+// same formula on the phone) to turn them back into sensor LSB.
+struct sketch_snapshot {
+	uint32_t start_s;
+	uint32_t samples;
+	uint8_t mag_p50;
+	uint8_t mag_p95;
+	uint16_t mag_max;     // exact, LSB
+	uint8_t rms[3][3];    // per axis: p50, p95, max bucket
+} __packed;
+
+void sketch_set_period(uint32_t seconds);
+
+void sketch_process(const struct bma400_fifo_sensor_data *samples, uint16_t count);
+
+// lower bound of a bucket in sensor LSB
+uint16_t sketch_bucket_value(uint8_t bucket);
+
+#endif /* SKETCH_H__ */
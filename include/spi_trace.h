@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef SPI_TRACE_H__
+#define SPI_TRACE_H__
+
+#include <stdint.h>
+
+// Bus time per register and per driver API, to see which read-modify-write
+// and polling paths are worth removing. Enabled with CONFIG_APP_SPI_TRACE
+// (overlay-spi-trace.conf); compiles away otherwise.
+//
+// The transport (read_reg_spi/write_reg_spi) times every transfer with the
+// cycle counter. Transfers are counted per (API, direction, register): the
+// API is the vendor driver call that caused them, tagged at the call site
+// with SPI_TRACED(), or "-" for untagged calls. Each entry has a latency
+// histogram. "spi_trace dump" on the shell lists the entries by total bus
+// time, "spi_trace reset" clears them.
+
+// distinct (API, direction, register) entries, further ones are counted as dropped
+#define SPI_TRACE_ENTRIES       32
+
+// latency histogram, bucket 0 is < 8 us, then doubling; the last one is open
+#define SPI_TRACE_HIST_BUCKETS  10
+#define SPI_TRACE_HIST_MIN_US   8
+
+#if defined(CONFIG_APP_SPI_TRACE)
+
+// Calls fn(...) with the API tag set to "fn". Tags nest, the innermost wins.
+#define SPI_TRACED(fn, ...) ({                                     \
+	const char *prev_api_ = spi_trace_api_enter(#fn);          \
+	__typeof__(fn(__VA_ARGS__)) ret_ = fn(__VA_ARGS__);        \
+	spi_trace_api_exit(prev_api_);                             \
+	ret_;                                                      \
+})
+
+const char *spi_trace_api_enter(const char *api);
+void spi_trace_api_exit(const char *prev);
+
+// around one transfer in the transport; reg has the read bit (bit 7) as sent
+uint32_t spi_trace_begin(void);
+void spi_trace_end(uint32_t t0, uint8_t reg, uint32_t len);
+
+// logs the entries, largest total bus time first
+void spi_trace_dump(void);
+void spi_trace_reset(void);
+
+#else
+
+#define SPI_TRACED(fn, ...) fn(__VA_ARGS__)
+
+static inline uint32_t spi_trace_begin(void)
+{
+	return 0;
+}
+
+static inline void spi_trace_end(uint32_t t0, uint8_t reg, uint32_t len) {}
+static inline void spi_trace_dump(void) {}
+static inline void spi_trace_reset(void) {}
+
+#endif
+
+#endif /* SPI_TRACE_H__ */
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef STAGE_PROF_H__
+#define STAGE_PROF_H__
+
+#include <stdint.h>
+
+// Per-stage timing of the drain path, in CPU cycles (cyccnt.h).
+enum stage {
+	STAGE_DRAIN,     // status + FIFO read + decode
+	STAGE_RING,      // retained ring push and raw flush
+	STAGE_SYNC,      // shared timeline stamps and grid
+	STAGE_ACTIG,
+	STAGE_ROLLUP,
+	STAGE_GRAVITY,
+	STAGE_WAKE,      // wake threshold tuning
+	STAGE_WEAR,      // off-body detection
+	STAGE_SKETCH,
+	STAGE_REDUCE,    // deadband / swinging door stream
+	STAGE_FEATURES,
+	STAGE_EVENTS,    // includes the gesture matcher
+	STAGE_DIAG,
+	STAGE_COUNT
+};
+
+struct stage_stats {
+	uint32_t n;
+	uint64_t sum_cycles;
+	uint32_t max_cycles;
+};
+
+// Adds the time since t0 to the stage and returns the current cycle count,
+// so consecutive stages can be chained:
+//   t = cyccnt_get(); ...; t = stage_prof_mark(STAGE_RING, t); ...
+uint32_t stage_prof_mark(enum stage stage, uint32_t t0);
+
+void stage_prof_get(enum stage stage, struct stage_stats *stats);
+const char *stage_prof_name(enum stage stage);
+void stage_prof_reset(void);
+
+// logs avg/max per stage in us
+void stage_prof_report(void);
+
+#endif /* STAGE_PROF_H__ */
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef TIMELINE_H__
+#define TIMELINE_H__
+
+#include <stdint.h>
+
+// Timeline of the sensor pipeline, for finding out why one particular drain
+// was late. Enabled with CONFIG_APP_TIMELINE (overlay-timeline.conf); the
+// calls compile away otherwise. Where the events end up depends on the
+// tracing format the kernel is built with, so they sit on one timeline with
+// thread switches and interrupts (BT RX thread, radio ISR):
+//   CONFIG_SEGGER_SYSTEMVIEW       SystemView markers, streamed over RTT
+//   CONFIG_PERCEPIO_TRACERECORDER  Tracealyzer user events
+//   CONFIG_TRACING_CTF             CTF named events
+//   CONFIG_TRACING_USER            own RAM ring (below)
+//
+// The RAM ring keeps the last CONFIG_APP_TIMELINE_RECORDS records, 8 bytes
+// each: cycle count, record type, event and argument, plus thread switches
+// and ISR entry/exit from the kernel's user tracing hooks. timeline_trigger()
+// (called on a late drain) keeps recording for a quarter of the ring, then
+// stops and writes the ring, oldest first, to RTT up channel
+// CONFIG_APP_TIMELINE_RTT_CHANNEL. Thread ids are listed in the log. The
+// records are a CTF event stream, tools/timeline/metadata describes them:
+//   JLinkRTTLogger -RTTChannel 2 trace/stream && cp tools/timeline/metadata trace/
+//   babeltrace2 trace/
+
+enum timeline_ev {
+	TL_BMA_IRQ,       // watermark interrupt
+	TL_SEM_GIVE,      // drain submitted to the sensor queue
+	TL_SEM_TAKE,      // drain started
+	TL_SPI,           // one register transfer, arg = register
+	TL_FIFO_READ,     // status + FIFO read, arg = bytes
+	TL_DECODE,        // FIFO frames to samples, arg = samples
+	TL_PROCESS,       // all stages of one batch
+	TL_ENCODE,        // packing a notification, arg = stream
+	TL_NOTIFY,        // handing it to the stack, arg = stream
+	TL_NOTIFY_DONE,   // the stack is done with it, arg = TX slot
+	TL_TRIGGER,       // timeline_trigger()
+	TL_SEQ_STEP,      // configuration sequence step, arg = step index
+	TL_EV_COUNT
+};
+
+#if defined(CONFIG_APP_TIMELINE)
+
+void timeline_begin(enum timeline_ev ev, uint16_t arg);
+void timeline_end(enum timeline_ev ev, uint16_t arg);
+void timeline_mark(enum timeline_ev ev, uint16_t arg);
+
+// something went wrong, keep the history leading up to it
+void timeline_trigger(void);
+
+#else
+
+static inline void timeline_begin(enum timeline_ev ev, uint16_t arg) {}
+static inline void timeline_end(enum timeline_ev ev, uint16_t arg) {}
+static inline void timeline_mark(enum timeline_ev ev, uint16_t arg) {}
+static inline void timeline_trigger(void) {}
+
+#endif
+
+#endif /* TIMELINE_H__ */
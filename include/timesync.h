@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef TIMESYNC_H__
+#define TIMESYNC_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/toolchain.h>
+#include "bma400_defs.h"
+
+// Puts the samples of several devices on one timeline. Two clocks are
+// tracked, each with an alpha-beta loop (offset + rate):
+//   sample clock: sample index -> local time, from the watermark interrupts
+//                 (the BMA400 oscillator is a few % off nominal ODR)
+//   hub clock:    local time -> hub time, from a periodic advertising train
+//                 every device of a set is synced to
+// Periodic advertising events are exactly one interval apart on the hub's
+// clock, and every device receives the same event at the same instant, so
+// the event label in the beacon times the interval is the shared timeline.
+//
+// Per drained batch the first sample's hub time and the sample period go
+// out on ACCEL_STREAM_SYNC. Phones that would rather not resample subscribe
+// to ACCEL_STREAM_GRID instead, where samples are resampled (resample.h)
+// onto multiples of the nominal period on the hub timeline, the same grid on
+// every device. The grid stays at the rate given to timesync_config();
+// after timesync_set_odr() the samples just come at a different spacing.
+
+// periodic advertising payload of the hub, as manufacturer specific data
+#define TIMESYNC_COMPANY_ID  0x0059  // Nordic Semiconductor
+#define TIMESYNC_MAGIC       0x5354  // "TS"
+
+struct timesync_beacon {
+	uint16_t company;
+	uint16_t magic;
+	uint32_t label;     // periodic advertising event number on the hub
+} __packed;
+
+// residual beyond which a clock is re-acquired instead of tracked
+#define TIMESYNC_SAMPLE_STEP_US  2000
+#define TIMESYNC_REF_STEP_US     5000
+// updates before a clock counts as locked
+#define TIMESYNC_LOCK_UPDATES    8
+// sync timeout, in 10 ms units
+#define TIMESYNC_SYNC_TIMEOUT    500
+
+// Looking for the hub (CONFIG_APP_TIMESYNC_HUB via overlay-timesync.conf, off
+// by default: a single device has no hub, and continuous RX would cost more
+// than the sensor; without it the scanner is not even built in).
+// Bursts of TIMESYNC_SCAN_BURST_MS at a TIMESYNC_SCAN_WINDOW/INTERVAL duty;
+// after a burst without the hub the next one waits TIMESYNC_SCAN_BACKOFF_S,
+// doubling up to CONFIG_APP_TIMESYNC_SCAN_MAX_S. A lost beacon is looked
+// for right away. The power governor charges scanning and the synced train.
+#define TIMESYNC_SCAN_BURST_MS   3000
+#define TIMESYNC_SCAN_INTERVAL   160    // 100 ms, 0.625 ms units
+#define TIMESYNC_SCAN_WINDOW     48     // 30 ms
+#define TIMESYNC_SCAN_BACKOFF_S  10
+
+// edge_frames: FIFO frames in the FIFO when the watermark fires
+void timesync_config(uint32_t odr_hz, uint16_t edge_frames);
+
+// The sensor was switched to another ODR. Call it between draining the FIFO
+// and the switch: the sample clock carries on at the new rate without
+// dropping its lock.
+void timesync_set_odr(uint32_t odr_hz, uint16_t edge_frames);
+
+// starts looking for the hub beacon, needs Bluetooth up
+int timesync_start(void);
+
+// No samples to time below streaming (cascade.h): no scan bursts while
+// paused. A sync already up is kept.
+void timesync_pause(bool pause);
+
+// from the watermark interrupt
+void timesync_edge(void);
+
+// after the FIFO read, with the number of frames read
+void timesync_drained(uint16_t frames);
+
+// Sends SYNC/GRID for the samples decoded from the last drain, seq is the
+// raw block they went into. A drain decoded in several blocks is passed in
+// order, one call per block.
+void timesync_process(uint16_t seq, const struct bma400_fifo_sensor_data *samples,
+		      uint16_t count);
+
+#endif /* TIMESYNC_H__ */
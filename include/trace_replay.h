@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef TRACE_REPLAY_H__
+#define TRACE_REPLAY_H__
+
+#include <stdint.h>
+#include "bma400_defs.h"
+
+// native_sim backend for bma400_dev that plays back a trace recorded with
+// fifo_trace.h. Each drain record is put in the FIFO at its original time
+// (relative to the first one) and the interrupt raised, so the driver and
+// the pipeline see what the device saw. Time is simulated: run with --no-rt
+// to go as fast as the host allows, without it the replay is real time.
+//
+// When the trace ends, a report (REPLAY lines plus stage timing) is printed
+// and the process exits.
+
+typedef void (*trace_replay_irq_t)(void);
+
+// opens the file given with --trace=<file>, exits if there is none
+void trace_replay_start(trace_replay_irq_t irq);
+
+BMA400_INTF_RET_TYPE trace_replay_read(uint8_t reg_address, uint8_t *data, uint32_t len, void *intf_ptr);
+BMA400_INTF_RET_TYPE trace_replay_write(uint8_t reg_address, const uint8_t *data, uint32_t len, void *intf_ptr);
+
+#endif /* TRACE_REPLAY_H__ */
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef WAKE_TUNE_H__
+#define WAKE_TUNE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "bma400_defs.h"
+
+// Sets the generic interrupt thresholds from the background the device
+// actually sees instead of fixed numbers. GEN1 (activity) and GEN2
+// (inactivity) compare each sample against the sensor's 1 Hz low-pass
+// reference; the same deviation is computed here from the decoded samples,
+// max over the axes, in mg.
+//
+// Only 1 s windows without real motion (peak below WAKE_TUNE_MOTION_MG)
+// count as background: sensor noise plus whatever vibration the mounting
+// picks up. For every candidate threshold (8 mg steps, the GEN1 LSB) and
+// duration it counts how often the deviation stays above the threshold
+// for that many samples, i.e. how often GEN1 would have fired for nothing.
+// GEN1 gets the lowest threshold, then the shortest duration, that stays
+// under WAKE_TUNE_FALSE_PER_HOUR, plus one step of margin; hysteresis
+// covers the spread of the background. GEN2 calls the device still when
+// every axis stays within the background's 99th percentile.
+//
+// The first tune happens after WAKE_TUNE_FIRST_S of background, then every
+// WAKE_TUNE_PERIOD_S from what was seen since the last one.
+
+#define WAKE_TUNE_FALSE_PER_HOUR  4
+#define WAKE_TUNE_MOTION_MG       400
+#define WAKE_TUNE_MIN_MG          24
+#define WAKE_TUNE_BINS            48     // candidate thresholds, 8 mg apart
+#define WAKE_TUNE_FIRST_S         60
+#define WAKE_TUNE_PERIOD_S        900
+#define WAKE_TUNE_INACT_S         5      // GEN2 duration
+
+struct wake_tune_cfg {
+	uint8_t act_thres;       // GEN1 threshold, 8 mg units
+	uint16_t act_dur;        // GEN1 duration, samples
+	uint8_t act_hyst;        // BMA400_HYST_*
+	uint8_t inact_thres;     // GEN2 threshold, 8 mg units
+	uint16_t inact_dur;      // GEN2 duration, samples
+};
+
+// the fixed values used before the first tune
+void wake_tune_defaults(struct wake_tune_cfg *cfg);
+
+// Feeds one decoded batch. GEN1/GEN2 hits are counted from int_status for
+// the batches it was read for (status_read).
+void wake_tune_process(const struct bma400_fifo_sensor_data *samples, uint16_t count,
+		       uint16_t int_status, bool status_read);
+
+// true (once) when a new config is waiting to be programmed
+bool wake_tune_take(struct wake_tune_cfg *cfg);
+
+#endif /* WAKE_TUNE_H__ */
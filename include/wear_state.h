@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef WEAR_STATE_H__
+#define WEAR_STATE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "bma400_defs.h"
+
+// Off-body detection. On a nightstand the device is perfectly still, keeps
+// one orientation and cools down to room temperature; on a wrist there is
+// always some movement within a few minutes and the sensor sits close to
+// skin temperature.
+//
+// Samples are summed over WEAR_WINDOW_S windows. A window is still when
+// every axis stays within WEAR_STILL_MG (standard deviation) and its mean
+// is within WEAR_ORIENT_MG of the previous window's. The temperature is
+// read once per window. After WEAR_OFF_S of still windows the device is
+// off body if the sensor is below WEAR_SKIN_DC or has cooled by
+// WEAR_COOL_DC since the stillness began; after WEAR_OFF_LONG_S it is off
+// body whatever the temperature says.
+//
+// The FIFO drain owns all of it: it switches to the low-power profile
+// when wear_state_take_off() says so and calls wear_state_resume() on the
+// first wake-up motion.
+
+#define WEAR_WINDOW_S      30
+#define WEAR_STILL_MG      10
+#define WEAR_ORIENT_MG     50     // ~3 degrees of tilt
+#define WEAR_OFF_S         300
+#define WEAR_OFF_LONG_S    1800
+#define WEAR_SKIN_DC       280    // 0.1 degC
+#define WEAR_COOL_DC       15
+
+struct wear_stats {
+	uint32_t worn_s;
+	uint32_t off_s;
+	uint32_t off_count;     // times taken off
+	int16_t temp_dc;        // last reading, 0.1 degC
+};
+
+// feeds one decoded batch while worn
+void wear_state_process(const struct bma400_fifo_sensor_data *samples, uint16_t count);
+
+// true when a temperature reading is wanted, pass it to wear_state_temp()
+bool wear_state_temp_due(void);
+void wear_state_temp(int16_t temp_dc);
+
+// true (once) when the device was found off body
+bool wear_state_take_off(void);
+
+// back on the wrist: restarts the detector
+void wear_state_resume(void);
+
+bool wear_state_worn(void);
+
+// residency since boot, including the current state
+void wear_state_get_stats(struct wear_stats *stats);
+
+#endif /* WEAR_STATE_H__ */
@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+#include "accel_features.h"
+#include "fixmath.h"
+
+void features_compute(const struct bma400_fifo_sensor_data *samples, uint16_t count,
+		      struct accel_features_pkt *out)
+{
+	static uint16_t seq;
+	int32_t sum[3] = { 0 };
+	uint32_t sq[3] = { 0 };
+	int16_t mn[3] = { INT16_MAX, INT16_MAX, INT16_MAX };
+	int16_t mx[3] = { INT16_MIN, INT16_MIN, INT16_MIN };
+
+	for (int i = 0; i < count; i++) {
+		const int16_t v[3] = { samples[i].x, samples[i].y, samples[i].z };
+
+		for (int a = 0; a < 3; a++) {
+			sum[a] += v[a];
+			// 12 bit samples, a FIFO's worth of squares fits in 32 bits
+			sq[a] += (uint32_t)((int32_t)v[a] * v[a]);
+			mn[a] = MIN(mn[a], v[a]);
+			mx[a] = MAX(mx[a], v[a]);
+		}
+	}
+
+	out->seq = sys_cpu_to_le16(seq++);
+	out->count = count;
+	for (int a = 0; a < 3; a++) {
+		out->mean[a] = sys_cpu_to_le16(count ? sum[a] / count : 0);
+		out->min[a] = sys_cpu_to_le16(count ? mn[a] : 0);
+		out->max[a] = sys_cpu_to_le16(count ? mx[a] : 0);
+		out->rms[a] = sys_cpu_to_le16(count ? isqrt32(sq[a] / count) : 0);
+	}
+}
@@ -0,0 +1,618 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include "accel_svc.h"
+#include "actigraphy.h"
+#include "link_adapt.h"
+#include "gesture.h"
+#include "gravity.h"
+#include "power_gov.h"
+#include "reduce.h"
+#include "adv_sched.h"
+#include "rollup.h"
+#include "sketch.h"
+#include "timeline.h"
+
+LOG_MODULE_REGISTER(accel_svc, LOG_LEVEL_INF);
+
+#define BT_UUID_ACCEL_SERVICE_VAL \
+	BT_UUID_128_ENCODE(0x12345678,0x1234,0x5678,0x1234,0x1234567890ab)
+// raw keeps the UUID of the old single characteristic
+#define BT_UUID_ACCEL_RAW_VAL \
+	BT_UUID_128_ENCODE(0x12345679,0x1234,0x5678,0x1234,0x1234567890ab)
+#define BT_UUID_ACCEL_FEATURES_VAL \
+	BT_UUID_128_ENCODE(0x1234567a,0x1234,0x5678,0x1234,0x1234567890ab)
+#define BT_UUID_ACCEL_EVENTS_VAL \
+	BT_UUID_128_ENCODE(0x1234567b,0x1234,0x5678,0x1234,0x1234567890ab)
+#define BT_UUID_ACCEL_DIAG_VAL \
+	BT_UUID_128_ENCODE(0x1234567c,0x1234,0x5678,0x1234,0x1234567890ab)
+#define BT_UUID_ACCEL_ACTIG_VAL \
+	BT_UUID_128_ENCODE(0x1234567d,0x1234,0x5678,0x1234,0x1234567890ab)
+#define BT_UUID_ACCEL_LINEAR_VAL \
+	BT_UUID_128_ENCODE(0x1234567e,0x1234,0x5678,0x1234,0x1234567890ab)
+#define BT_UUID_ACCEL_GRAVITY_VAL \
+	BT_UUID_128_ENCODE(0x1234567f,0x1234,0x5678,0x1234,0x1234567890ab)
+#define BT_UUID_ACCEL_SKETCH_VAL \
+	BT_UUID_128_ENCODE(0x12345680,0x1234,0x5678,0x1234,0x1234567890ab)
+#define BT_UUID_ACCEL_TRACE_VAL \
+	BT_UUID_128_ENCODE(0x12345681,0x1234,0x5678,0x1234,0x1234567890ab)
+#define BT_UUID_ACCEL_SYNC_VAL \
+	BT_UUID_128_ENCODE(0x12345682,0x1234,0x5678,0x1234,0x1234567890ab)
+#define BT_UUID_ACCEL_GRID_VAL \
+	BT_UUID_128_ENCODE(0x12345683,0x1234,0x5678,0x1234,0x1234567890ab)
+#define BT_UUID_ACCEL_ROLLUP_VAL \
+	BT_UUID_128_ENCODE(0x12345684,0x1234,0x5678,0x1234,0x1234567890ab)
+#define BT_UUID_ACCEL_POWER_VAL \
+	BT_UUID_128_ENCODE(0x12345685,0x1234,0x5678,0x1234,0x1234567890ab)
+#define BT_UUID_ACCEL_REDUCED_VAL \
+	BT_UUID_128_ENCODE(0x12345686,0x1234,0x5678,0x1234,0x1234567890ab)
+// writable characteristics use the 0x123456a* range
+#define BT_UUID_ACCEL_GESTURE_TMPL_VAL \
+	BT_UUID_128_ENCODE(0x123456a0,0x1234,0x5678,0x1234,0x1234567890ab)
+#define BT_UUID_ACCEL_ROLLUP_QUERY_VAL \
+	BT_UUID_128_ENCODE(0x123456a1,0x1234,0x5678,0x1234,0x1234567890ab)
+#define BT_UUID_ACCEL_POWER_BUDGET_VAL \
+	BT_UUID_128_ENCODE(0x123456a2,0x1234,0x5678,0x1234,0x1234567890ab)
+#define BT_UUID_ACCEL_REDUCE_CFG_VAL \
+	BT_UUID_128_ENCODE(0x123456a3,0x1234,0x5678,0x1234,0x1234567890ab)
+#define BT_UUID_ACCEL_ADV_SCHED_VAL \
+	BT_UUID_128_ENCODE(0x123456a4,0x1234,0x5678,0x1234,0x1234567890ab)
+#define BT_UUID_ACCEL_SETTING_VAL \
+	BT_UUID_128_ENCODE(0x123456a5,0x1234,0x5678,0x1234,0x1234567890ab)
+
+static struct bt_uuid_128 accel_service_uuid = BT_UUID_INIT_128(BT_UUID_ACCEL_SERVICE_VAL);
+static struct bt_uuid_128 accel_raw_uuid      = BT_UUID_INIT_128(BT_UUID_ACCEL_RAW_VAL);
+static struct bt_uuid_128 accel_features_uuid = BT_UUID_INIT_128(BT_UUID_ACCEL_FEATURES_VAL);
+static struct bt_uuid_128 accel_events_uuid   = BT_UUID_INIT_128(BT_UUID_ACCEL_EVENTS_VAL);
+static struct bt_uuid_128 accel_diag_uuid     = BT_UUID_INIT_128(BT_UUID_ACCEL_DIAG_VAL);
+static struct bt_uuid_128 accel_actig_uuid    = BT_UUID_INIT_128(BT_UUID_ACCEL_ACTIG_VAL);
+static struct bt_uuid_128 accel_linear_uuid   = BT_UUID_INIT_128(BT_UUID_ACCEL_LINEAR_VAL);
+static struct bt_uuid_128 accel_gravity_uuid  = BT_UUID_INIT_128(BT_UUID_ACCEL_GRAVITY_VAL);
+static struct bt_uuid_128 accel_sketch_uuid   = BT_UUID_INIT_128(BT_UUID_ACCEL_SKETCH_VAL);
+static struct bt_uuid_128 accel_trace_uuid    = BT_UUID_INIT_128(BT_UUID_ACCEL_TRACE_VAL);
+static struct bt_uuid_128 accel_sync_uuid     = BT_UUID_INIT_128(BT_UUID_ACCEL_SYNC_VAL);
+static struct bt_uuid_128 accel_grid_uuid     = BT_UUID_INIT_128(BT_UUID_ACCEL_GRID_VAL);
+static struct bt_uuid_128 accel_rollup_uuid   = BT_UUID_INIT_128(BT_UUID_ACCEL_ROLLUP_VAL);
+static struct bt_uuid_128 accel_power_uuid    = BT_UUID_INIT_128(BT_UUID_ACCEL_POWER_VAL);
+static struct bt_uuid_128 accel_reduced_uuid  = BT_UUID_INIT_128(BT_UUID_ACCEL_REDUCED_VAL);
+static struct bt_uuid_128 accel_gesture_tmpl_uuid = BT_UUID_INIT_128(BT_UUID_ACCEL_GESTURE_TMPL_VAL);
+static struct bt_uuid_128 accel_rollup_query_uuid = BT_UUID_INIT_128(BT_UUID_ACCEL_ROLLUP_QUERY_VAL);
+static struct bt_uuid_128 accel_power_budget_uuid = BT_UUID_INIT_128(BT_UUID_ACCEL_POWER_BUDGET_VAL);
+static struct bt_uuid_128 accel_reduce_cfg_uuid   = BT_UUID_INIT_128(BT_UUID_ACCEL_REDUCE_CFG_VAL);
+static struct bt_uuid_128 accel_adv_sched_uuid    = BT_UUID_INIT_128(BT_UUID_ACCEL_ADV_SCHED_VAL);
+static struct bt_uuid_128 accel_setting_uuid      = BT_UUID_INIT_128(BT_UUID_ACCEL_SETTING_VAL);
+
+struct stream_state {
+	const char *name;
+	bool subscribed;
+	enum accel_stream_prio prio;
+	uint16_t min_interval_ms;
+	uint32_t last_sent_ms;
+	uint16_t sent;
+	uint16_t dropped;
+	uint32_t bytes;
+};
+
+static struct stream_state streams[ACCEL_STREAM_COUNT] = {
+	[ACCEL_STREAM_RAW]      = { .name = "raw",      .prio = ACCEL_PRIO_LOW },
+	[ACCEL_STREAM_FEATURES] = { .name = "features", .prio = ACCEL_PRIO_NORMAL },
+	[ACCEL_STREAM_EVENTS]   = { .name = "events",   .prio = ACCEL_PRIO_HIGH },
+	[ACCEL_STREAM_DIAG]     = { .name = "diag",     .prio = ACCEL_PRIO_LOW, .min_interval_ms = 1000 },
+	[ACCEL_STREAM_ACTIGRAPHY] = { .name = "actigraphy", .prio = ACCEL_PRIO_NORMAL },
+	[ACCEL_STREAM_LINEAR]   = { .name = "linear",   .prio = ACCEL_PRIO_NORMAL },
+	[ACCEL_STREAM_GRAVITY]  = { .name = "gravity",  .prio = ACCEL_PRIO_LOW, .min_interval_ms = 1000 },
+	[ACCEL_STREAM_SKETCH]   = { .name = "sketch",   .prio = ACCEL_PRIO_NORMAL },
+	[ACCEL_STREAM_TRACE]    = { .name = "trace",    .prio = ACCEL_PRIO_NORMAL },
+	[ACCEL_STREAM_SYNC]     = { .name = "sync",     .prio = ACCEL_PRIO_NORMAL },
+	[ACCEL_STREAM_GRID]     = { .name = "grid",     .prio = ACCEL_PRIO_LOW },
+	[ACCEL_STREAM_ROLLUP]   = { .name = "rollup",   .prio = ACCEL_PRIO_LOW },
+	[ACCEL_STREAM_POWER]    = { .name = "power",    .prio = ACCEL_PRIO_HIGH },
+	[ACCEL_STREAM_REDUCED]  = { .name = "reduced",  .prio = ACCEL_PRIO_NORMAL },
+};
+
+// how many of the TX slots each priority may fill
+static const uint8_t prio_slot_limit[] = {
+	[ACCEL_PRIO_HIGH]   = ACCEL_SVC_TX_SLOTS,
+	[ACCEL_PRIO_NORMAL] = ACCEL_SVC_TX_SLOTS * 3 / 4,
+	[ACCEL_PRIO_LOW]    = ACCEL_SVC_TX_SLOTS / 2,
+};
+
+// bookkeeping for notifications the stack still owns
+struct tx_slot {
+	uint32_t queued_at_ms;
+	uint16_t len;
+};
+
+static struct tx_slot tx_slots[ACCEL_SVC_TX_SLOTS];
+static atomic_t tx_slot_used;
+static atomic_t tx_inflight;
+// Bumped when the link goes. The stack drops what it still had queued
+// without calling back, so the slots are freed in one go then and a late
+// callback from the old link (generation in its user_data) is ignored.
+static atomic_t tx_gen;
+
+// Payload buffer the encoders write into. The stack copies a notification
+// into its own buffer before bt_gatt_notify_cb() returns, so one buffer
+// serves every stream instead of a staging array per encoder.
+static uint8_t tx_buf[ACCEL_SVC_MAX_PAYLOAD];
+static atomic_t tx_buf_busy;
+
+static struct bt_conn *svc_conn;
+static bool sink;
+static enum accel_stream_prio emit_lowest = ACCEL_PRIO_LOW;
+
+static void accel_ccc_cfg_changed(const struct bt_gatt_attr *attr, uint16_t value);
+
+static ssize_t write_gesture_tmpl(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+				  const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+	if (offset) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+	}
+	if (gesture_load_template(buf, len)) {
+		return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+	}
+	return len;
+}
+
+static ssize_t write_rollup_query(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+				  const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+	if (offset) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+	}
+	if (rollup_query(buf, len)) {
+		return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+	}
+	return len;
+}
+
+static ssize_t write_power_budget(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+				  const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+	if (offset) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+	}
+	if (power_gov_configure(buf, len)) {
+		return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+	}
+	return len;
+}
+
+static ssize_t write_reduce_cfg(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+				const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+	if (offset) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+	}
+	if (reduce_configure(buf, len)) {
+		return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+	}
+	return len;
+}
+
+static ssize_t write_setting(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			     const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+	if (offset) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+	}
+	if (accel_svc_setting(buf, len)) {
+		return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+	}
+	return len;
+}
+
+static ssize_t write_adv_sched(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			       const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+	if (offset) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+	}
+	if (adv_sched_configure(buf, len)) {
+		return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+	}
+	return len;
+}
+
+BT_GATT_SERVICE_DEFINE(accel_svc,
+	BT_GATT_PRIMARY_SERVICE(&accel_service_uuid),
+	BT_GATT_CHARACTERISTIC(&accel_raw_uuid.uuid, BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_NONE, NULL, NULL, NULL),
+	BT_GATT_CCC(accel_ccc_cfg_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	BT_GATT_CHARACTERISTIC(&accel_features_uuid.uuid, BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_NONE, NULL, NULL, NULL),
+	BT_GATT_CCC(accel_ccc_cfg_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	BT_GATT_CHARACTERISTIC(&accel_events_uuid.uuid, BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_NONE, NULL, NULL, NULL),
+	BT_GATT_CCC(accel_ccc_cfg_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	BT_GATT_CHARACTERISTIC(&accel_diag_uuid.uuid, BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_NONE, NULL, NULL, NULL),
+	BT_GATT_CCC(accel_ccc_cfg_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	BT_GATT_CHARACTERISTIC(&accel_actig_uuid.uuid, BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_NONE, NULL, NULL, NULL),
+	BT_GATT_CCC(accel_ccc_cfg_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	BT_GATT_CHARACTERISTIC(&accel_linear_uuid.uuid, BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_NONE, NULL, NULL, NULL),
+	BT_GATT_CCC(accel_ccc_cfg_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	BT_GATT_CHARACTERISTIC(&accel_gravity_uuid.uuid, BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_NONE, NULL, NULL, NULL),
+	BT_GATT_CCC(accel_ccc_cfg_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	BT_GATT_CHARACTERISTIC(&accel_sketch_uuid.uuid, BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_NONE, NULL, NULL, NULL),
+	BT_GATT_CCC(accel_ccc_cfg_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	BT_GATT_CHARACTERISTIC(&accel_trace_uuid.uuid, BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_NONE, NULL, NULL, NULL),
+	BT_GATT_CCC(accel_ccc_cfg_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	BT_GATT_CHARACTERISTIC(&accel_sync_uuid.uuid, BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_NONE, NULL, NULL, NULL),
+	BT_GATT_CCC(accel_ccc_cfg_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	BT_GATT_CHARACTERISTIC(&accel_grid_uuid.uuid, BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_NONE, NULL, NULL, NULL),
+	BT_GATT_CCC(accel_ccc_cfg_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	BT_GATT_CHARACTERISTIC(&accel_rollup_uuid.uuid, BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_NONE, NULL, NULL, NULL),
+	BT_GATT_CCC(accel_ccc_cfg_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	BT_GATT_CHARACTERISTIC(&accel_power_uuid.uuid, BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_NONE, NULL, NULL, NULL),
+	BT_GATT_CCC(accel_ccc_cfg_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	BT_GATT_CHARACTERISTIC(&accel_reduced_uuid.uuid, BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_NONE, NULL, NULL, NULL),
+	BT_GATT_CCC(accel_ccc_cfg_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	// notify streams above must stay in enum order, STREAM_*_ATTR() index them
+	BT_GATT_CHARACTERISTIC(&accel_gesture_tmpl_uuid.uuid, BT_GATT_CHRC_WRITE,
+			       BT_GATT_PERM_WRITE, NULL, write_gesture_tmpl, NULL),
+	BT_GATT_CHARACTERISTIC(&accel_rollup_query_uuid.uuid, BT_GATT_CHRC_WRITE,
+			       BT_GATT_PERM_WRITE, NULL, write_rollup_query, NULL),
+	BT_GATT_CHARACTERISTIC(&accel_power_budget_uuid.uuid, BT_GATT_CHRC_WRITE,
+			       BT_GATT_PERM_WRITE, NULL, write_power_budget, NULL),
+	BT_GATT_CHARACTERISTIC(&accel_reduce_cfg_uuid.uuid, BT_GATT_CHRC_WRITE,
+			       BT_GATT_PERM_WRITE, NULL, write_reduce_cfg, NULL),
+	BT_GATT_CHARACTERISTIC(&accel_adv_sched_uuid.uuid, BT_GATT_CHRC_WRITE,
+			       BT_GATT_PERM_WRITE, NULL, write_adv_sched, NULL),
+	BT_GATT_CHARACTERISTIC(&accel_setting_uuid.uuid, BT_GATT_CHRC_WRITE,
+			       BT_GATT_PERM_WRITE, NULL, write_setting, NULL),
+);
+
+// attrs: [0] service, then (declaration, value, CCC) per stream
+#define STREAM_VALUE_ATTR(s) (&accel_svc.attrs[2 + 3 * (s)])
+#define STREAM_CCC_ATTR(s)   (&accel_svc.attrs[3 + 3 * (s)])
+
+static void accel_ccc_cfg_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+	for (int s = 0; s < ACCEL_STREAM_COUNT; s++) {
+		if (attr == STREAM_CCC_ATTR(s)) {
+			streams[s].subscribed = (value == BT_GATT_CCC_NOTIFY);
+			printk("Accel %s notifications %s\n", streams[s].name,
+			       streams[s].subscribed ? "enabled" : "disabled");
+			return;
+		}
+	}
+}
+
+static int tx_slot_alloc(void)
+{
+	for (int i = 0; i < ACCEL_SVC_TX_SLOTS; i++) {
+		if (!atomic_test_and_set_bit(&tx_slot_used, i)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void accel_notify_sent(struct bt_conn *conn, void *user_data)
+{
+	uintptr_t ud = POINTER_TO_UINT(user_data);
+	int slot = ud & 0xFF;
+
+	if ((uint8_t)(ud >> 8) != (uint8_t)atomic_get(&tx_gen)) {
+		return;
+	}
+	timeline_mark(TL_NOTIFY_DONE, slot);
+	link_adapt_tx_done(tx_slots[slot].len, tx_slots[slot].queued_at_ms);
+	atomic_clear_bit(&tx_slot_used, slot);
+	atomic_dec(&tx_inflight);
+}
+
+void accel_svc_set_conn(struct bt_conn *conn)
+{
+	svc_conn = conn;
+	if (!conn) {
+		// CCCs are not bonded, the next central starts unsubscribed
+		for (int s = 0; s < ACCEL_STREAM_COUNT; s++) {
+			streams[s].subscribed = false;
+		}
+		atomic_inc(&tx_gen);
+		atomic_clear(&tx_slot_used);
+		atomic_clear(&tx_inflight);
+	}
+}
+
+bool accel_svc_subscribed(enum accel_stream stream)
+{
+	if (sink) {
+		return stream != ACCEL_STREAM_TRACE;
+	}
+	return accel_svc_requested(stream) && streams[stream].prio <= emit_lowest;
+}
+
+bool accel_svc_requested(enum accel_stream stream)
+{
+	return svc_conn && streams[stream].subscribed;
+}
+
+void accel_svc_set_emit(enum accel_stream_prio lowest)
+{
+	emit_lowest = lowest;
+}
+
+void accel_svc_set_sink(bool on)
+{
+	sink = on;
+}
+
+uint16_t accel_svc_payload_len(void)
+{
+	if (sink || !svc_conn) {
+		return ACCEL_SVC_MAX_PAYLOAD;
+	}
+	return MIN(bt_gatt_get_mtu(svc_conn) - 3, ACCEL_SVC_MAX_PAYLOAD);
+}
+
+void accel_svc_set_rate(enum accel_stream stream, uint16_t min_interval_ms)
+{
+	streams[stream].min_interval_ms = min_interval_ms;
+}
+
+int accel_svc_setting(const void *buf, uint16_t len)
+{
+	struct accel_setting s;
+
+	if (len != sizeof(s)) {
+		return -EINVAL;
+	}
+	memcpy(&s, buf, sizeof(s));
+	s.value = sys_le16_to_cpu(s.value);
+
+	switch (s.key) {
+	case ACCEL_SET_RATE:
+		if (s.index >= ACCEL_STREAM_COUNT) {
+			return -EINVAL;
+		}
+		accel_svc_set_rate(s.index, s.value);
+		break;
+	case ACCEL_SET_SKETCH_PERIOD:
+		if (!s.value) {
+			return -EINVAL;
+		}
+		sketch_set_period(s.value);
+		break;
+	case ACCEL_SET_ACTIG_EPOCH:
+		if (!s.value || s.value > ACTIG_EPOCH_S_MAX) {
+			return -EINVAL;
+		}
+		actigraphy_set_epoch(s.value);
+		break;
+	case ACCEL_SET_LIN_DECIM:
+		if (!s.value || s.value > UINT8_MAX) {
+			return -EINVAL;
+		}
+		gravity_set_decimation(s.value);
+		break;
+	case ACCEL_SET_LIN_THRESH:
+		gravity_set_threshold(s.value);
+		break;
+	default:
+		return -EINVAL;
+	}
+	LOG_INF("setting %u[%u] = %u", s.key, s.index, s.value);
+	return 0;
+}
+
+void accel_svc_set_prio(enum accel_stream stream, enum accel_stream_prio prio)
+{
+	streams[stream].prio = prio;
+}
+
+enum accel_stream_prio accel_svc_get_prio(enum accel_stream stream)
+{
+	return streams[stream].prio;
+}
+
+static int notify_slot(enum accel_stream stream, const void *data, uint16_t len)
+{
+	struct stream_state *st = &streams[stream];
+	atomic_val_t gen = atomic_get(&tx_gen);
+	int slot, err;
+
+	if (sink) {
+		st->sent++;
+		st->bytes += len;
+		return 0;
+	}
+
+	// the stack refuses it anyway; not the link's fault, so not reported
+	if (len > accel_svc_payload_len()) {
+		LOG_WRN_ONCE("%s: %u B over the MTU, dropped", st->name, len);
+		st->dropped++;
+		return -EMSGSIZE;
+	}
+	if (atomic_get(&tx_inflight) >= prio_slot_limit[st->prio]) {
+		st->dropped++;
+		return -EAGAIN;
+	}
+	slot = tx_slot_alloc();
+	if (slot < 0) {
+		st->dropped++;
+		return -EAGAIN;
+	}
+
+	tx_slots[slot].len = len;
+	tx_slots[slot].queued_at_ms = k_uptime_get_32();
+
+	struct bt_gatt_notify_params params = {
+		.attr = STREAM_VALUE_ATTR(stream),
+		.data = data,
+		.len = len,
+		.func = accel_notify_sent,
+		.user_data = UINT_TO_POINTER(slot | ((uint8_t)gen << 8)),
+	};
+
+	atomic_inc(&tx_inflight);
+	timeline_begin(TL_NOTIFY, stream);
+	err = bt_gatt_notify_cb(svc_conn, &params);
+	timeline_end(TL_NOTIFY, stream);
+	if (err) {
+		// unless the link went meanwhile and took the slot with it
+		if (atomic_get(&tx_gen) == gen) {
+			atomic_dec(&tx_inflight);
+			atomic_clear_bit(&tx_slot_used, slot);
+		}
+		st->dropped++;
+		// only a full TX queue says something about the link
+		if (err == -ENOMEM) {
+			link_adapt_tx_failed();
+		}
+		return err;
+	}
+	st->sent++;
+	st->bytes += len;
+	link_adapt_tx_queued(len);
+
+	return 0;
+}
+
+int accel_svc_send(enum accel_stream stream, const void *data, uint16_t len)
+{
+	struct stream_state *st = &streams[stream];
+	uint32_t now = k_uptime_get_32();
+
+	if (!accel_svc_subscribed(stream)) {
+		return -ENOTCONN;
+	}
+	if (st->min_interval_ms && st->sent &&
+	    now - st->last_sent_ms < st->min_interval_ms) {
+		return -EAGAIN;
+	}
+
+	int err = notify_slot(stream, data, len);
+
+	if (!err) {
+		st->last_sent_ms = now;
+	}
+	return err;
+}
+
+uint8_t *accel_svc_reserve(uint16_t *cap)
+{
+	if (!atomic_cas(&tx_buf_busy, 0, 1)) {
+		return NULL;
+	}
+	*cap = accel_svc_payload_len();
+	return tx_buf;
+}
+
+int accel_svc_commit(enum accel_stream stream, uint16_t len)
+{
+	int err = accel_svc_send(stream, tx_buf, len);
+
+	atomic_clear(&tx_buf_busy);
+	return err;
+}
+
+void accel_svc_release(void)
+{
+	atomic_clear(&tx_buf_busy);
+}
+
+int accel_svc_send_raw(uint16_t seq, const struct bma400_fifo_sensor_data *samples, uint16_t count,
+		       uint8_t *offset)
+{
+	uint16_t cap;
+	int err = 0;
+
+	if (!accel_svc_subscribed(ACCEL_STREAM_RAW)) {
+		return -ENOTCONN;
+	}
+	if (*offset >= count) {
+		return 0;
+	}
+	samples += *offset;
+	count -= *offset;
+
+	while (count) {
+		uint8_t *buf = accel_svc_reserve(&cap);
+
+		if (!buf) {
+			err = -EBUSY;
+			break;
+		}
+
+		uint8_t n = MIN(count, (cap - sizeof(struct accel_raw_hdr)) / 6);
+		uint8_t *p = buf;
+
+		timeline_begin(TL_ENCODE, ACCEL_STREAM_RAW);
+		sys_put_le16(seq, p);
+		p[2] = *offset;
+		p[3] = n;
+		p += sizeof(struct accel_raw_hdr);
+		for (int i = 0; i < n; i++) {
+			sys_put_le16(samples[i].x, p);
+			sys_put_le16(samples[i].y, p + 2);
+			sys_put_le16(samples[i].z, p + 4);
+			p += 6;
+		}
+		timeline_end(TL_ENCODE, ACCEL_STREAM_RAW);
+
+		err = accel_svc_commit(ACCEL_STREAM_RAW, p - buf);
+		if (err) {
+			break;
+		}
+		samples += n;
+		count -= n;
+		*offset += n;
+	}
+
+	return err;
+}
+
+int accel_svc_send_event(enum accel_event id, uint16_t arg)
+{
+	struct accel_event_pkt evt = {
+		.id = id,
+		.uptime_ms = sys_cpu_to_le32(k_uptime_get_32()),
+		.arg = sys_cpu_to_le16(arg),
+	};
+
+	return accel_svc_send(ACCEL_STREAM_EVENTS, &evt, sizeof(evt));
+}
+
+void accel_svc_get_counts(uint16_t sent[ACCEL_STREAM_COUNT], uint16_t dropped[ACCEL_STREAM_COUNT])
+{
+	for (int s = 0; s < ACCEL_STREAM_COUNT; s++) {
+		sent[s] = streams[s].sent;
+		dropped[s] = streams[s].dropped;
+	}
+}
+
+uint32_t accel_svc_get_bytes(enum accel_stream stream)
+{
+	return streams[stream].bytes;
+}
+
+const char *accel_svc_stream_name(enum accel_stream stream)
+{
+	return streams[stream].name;
+}
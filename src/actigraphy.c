@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+#include "actigraphy.h"
+#include "accel_svc.h"
+#include "fixmath.h"
+#include "sensor_cfg.h"
+
+LOG_MODULE_REGISTER(actigraphy, LOG_LEVEL_INF);
+
+// 2nd order band-pass, 0.29-1.63 Hz at 25 Hz (RBJ, 0 dB at 0.69 Hz), Q14
+#define BP_B0   2364
+#define BP_A1   (-27623)
+#define BP_A2   11657
+BUILD_ASSERT(SENSOR_ODR_HZ == 25, "actigraphy band-pass coefficients are for 25 Hz");
+
+#define DEADBAND_LSB   (ACTIG_DEADBAND_MG * SENSOR_LSB_PER_G / 1000)
+// one ActiGraph count is 16.64 mg on a 10 Hz stream, in LSB * 100
+#define LSB_PER_COUNT_X100   (SENSOR_LSB_PER_G * 1664 / 1000)
+
+// the feedback state keeps 4 extra fraction bits, otherwise the rounding
+// error is amplified ~40x by the poles and shows up as a DC offset (counts at rest)
+#define BP_STATE_FRAC 4
+
+struct bp_state {
+	int32_t x1, x2;
+	int32_t y1, y2;   // Q4
+};
+
+static struct bp_state bp[3];
+static bool bp_primed;
+static uint32_t acc[3];
+static uint32_t epoch_samples;
+static uint32_t epoch_len = CONFIG_APP_ACTIGRAPHY_EPOCH_S * SENSOR_ODR_HZ;
+static uint8_t epoch_s = CONFIG_APP_ACTIGRAPHY_EPOCH_S;
+static atomic_t epoch_req;   // from the settings write, applied on the sensor queue
+static uint32_t epoch_start_s;
+
+static struct actig_record ring[ACTIG_RING_RECORDS];
+static uint16_t ring_head;
+static uint16_t ring_used;
+static uint16_t next_seq;   // seq of the record at the tail
+
+static int32_t bandpass(struct bp_state *st, int32_t x)
+{
+	int64_t acc = ((int64_t)BP_B0 * (x - st->x2) << BP_STATE_FRAC) -
+		      (int64_t)BP_A1 * st->y1 - (int64_t)BP_A2 * st->y2;
+	int32_t y = (int32_t)((acc + (1 << 13)) >> 14);
+
+	st->x2 = st->x1;
+	st->x1 = x;
+	st->y2 = st->y1;
+	st->y1 = y;
+
+	return (y + (1 << (BP_STATE_FRAC - 1))) >> BP_STATE_FRAC;
+}
+
+static uint16_t to_counts(uint32_t sum)
+{
+	// sum is in LSB at SENSOR_ODR_HZ, counts are defined on a 10 Hz stream
+	uint64_t c = (uint64_t)sum * 10 * 100 / ((uint64_t)SENSOR_ODR_HZ * LSB_PER_COUNT_X100);
+
+	return MIN(c, UINT16_MAX);
+}
+
+static void close_epoch(void)
+{
+	struct actig_record *r = &ring[ring_head];
+	uint32_t vm2 = 0;
+
+	r->start_s = epoch_start_s;
+	for (int a = 0; a < 3; a++) {
+		r->counts[a] = to_counts(acc[a]);
+		vm2 += (uint32_t)r->counts[a] * r->counts[a];
+		acc[a] = 0;
+	}
+	r->vm = MIN(isqrt32(vm2), UINT16_MAX);
+
+	ring_head = (ring_head + 1) % ACTIG_RING_RECORDS;
+	if (ring_used == ACTIG_RING_RECORDS) {
+		// nobody collected them, oldest epoch is lost
+		next_seq++;
+	} else {
+		ring_used++;
+	}
+
+	epoch_samples = 0;
+}
+
+void actigraphy_set_epoch(uint8_t seconds)
+{
+	atomic_set(&epoch_req, CLAMP(seconds, 1, ACTIG_EPOCH_S_MAX));
+}
+
+static void apply_epoch(void)
+{
+	uint8_t seconds = atomic_clear(&epoch_req);
+
+	if (!seconds || seconds == epoch_s) {
+		return;
+	}
+	if (epoch_samples) {
+		close_epoch();
+	}
+	epoch_s = seconds;
+	epoch_len = seconds * SENSOR_ODR_HZ;
+	LOG_INF("epoch %u s", seconds);
+}
+
+void actigraphy_process(const struct bma400_fifo_sensor_data *samples, uint16_t count)
+{
+	apply_epoch();
+
+	for (int i = 0; i < count; i++) {
+		const int32_t v[3] = { samples[i].x, samples[i].y, samples[i].z };
+
+		if (epoch_samples == 0) {
+			epoch_start_s = k_uptime_get_32() / 1000;
+		}
+		if (!bp_primed) {
+			// start from the first sample so gravity does not ring through the first epoch
+			for (int a = 0; a < 3; a++) {
+				bp[a].x1 = bp[a].x2 = v[a];
+			}
+			bp_primed = true;
+		}
+		for (int a = 0; a < 3; a++) {
+			int32_t y = bandpass(&bp[a], v[a]);
+
+			y = (y < 0) ? -y : y;
+			if (y > DEADBAND_LSB) {
+				acc[a] += y - DEADBAND_LSB;
+			}
+		}
+		if (++epoch_samples >= epoch_len) {
+			close_epoch();
+		}
+	}
+}
+
+void actigraphy_flush(void)
+{
+	uint16_t cap;
+
+	if (!accel_svc_subscribed(ACCEL_STREAM_ACTIGRAPHY) || ring_used < ACTIG_BULK_RECORDS) {
+		return;
+	}
+
+	while (ring_used) {
+		uint8_t *buf = accel_svc_reserve(&cap);
+
+		if (!buf) {
+			break;
+		}
+
+		uint16_t tail = (ring_head + ACTIG_RING_RECORDS - ring_used) % ACTIG_RING_RECORDS;
+		uint8_t n = MIN(ring_used, (cap - sizeof(struct actig_pkt_hdr)) / sizeof(struct actig_record));
+		struct actig_pkt_hdr *hdr = (struct actig_pkt_hdr *)buf;
+		uint8_t *p = buf + sizeof(*hdr);
+
+		hdr->seq = sys_cpu_to_le16(next_seq);
+		hdr->epoch_s = epoch_s;
+		hdr->n = n;
+		for (int i = 0; i < n; i++) {
+			const struct actig_record *r = &ring[(tail + i) % ACTIG_RING_RECORDS];
+
+			sys_put_le32(r->start_s, p);
+			sys_put_le16(r->counts[0], p + 4);
+			sys_put_le16(r->counts[1], p + 6);
+			sys_put_le16(r->counts[2], p + 8);
+			sys_put_le16(r->vm, p + 10);
+			p += sizeof(*r);
+		}
+
+		if (accel_svc_commit(ACCEL_STREAM_ACTIGRAPHY, p - buf)) {
+			// try again with the next batch
+			break;
+		}
+		ring_used -= n;
+		next_seq += n;
+	}
+}
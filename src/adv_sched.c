@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include "adv_sched.h"
+#include "power_gov.h"
+
+LOG_MODULE_REGISTER(adv_sched, LOG_LEVEL_INF);
+
+#define ADV_MS_MIN   20
+#define ADV_MS_MAX   10240
+
+static const char *const phase_names[ADV_PHASE_COUNT] = {
+	"off", "fast", "slow", "connected",
+};
+
+static const struct bt_data *adv_ad;
+static size_t adv_ad_len;
+
+static atomic_t started;
+static atomic_t connected;
+static atomic_t pending;        // BIT(adv_trigger) since the last run
+static atomic_t trig_count[ADV_TRIG_COUNT];
+
+static struct k_spinlock lock;
+static struct adv_sched_cfg cfg_pending;
+static bool cfg_new;
+
+// only the work item changes these (phase and interval under the lock,
+// the counters read them)
+static struct adv_sched_cfg cfg = {
+	.fast_s = CONFIG_APP_ADV_FAST_S,
+	.fast_ms = CONFIG_APP_ADV_FAST_MS,
+	.slow_s = CONFIG_APP_ADV_SLOW_S,
+	.slow_ms = CONFIG_APP_ADV_SLOW_MS,
+};
+static enum adv_phase phase;
+static uint16_t interval_ms;    // 0 while not advertising
+static uint32_t phase_until;    // uptime the fast or slow phase ends
+static bool retry;
+
+static struct {
+	uint32_t since_ms;
+	uint32_t ms[ADV_PHASE_COUNT];
+	uint64_t mev;               // advertising events, thousandths
+	uint32_t windows;
+} st;
+
+static void adv_work_fn(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(adv_work, adv_work_fn);
+
+// with the lock held
+static void st_update(uint32_t now)
+{
+	uint32_t dt = now - st.since_ms;
+
+	st.ms[phase] += dt;
+	if (interval_ms) {
+		st.mev += (uint64_t)dt * 1000 / interval_ms;
+	}
+	st.since_ms = now;
+}
+
+static int adv_run(uint16_t ms)
+{
+	// min = max, so the counters know the interval (0.625 ms units)
+	uint32_t iv = (uint32_t)ms * 8 / 5;
+	struct bt_le_adv_param param = BT_LE_ADV_PARAM_INIT(BT_LE_ADV_OPT_CONN, iv, iv, NULL);
+
+	bt_le_adv_stop();
+	if (!ms) {
+		return 0;
+	}
+	return bt_le_adv_start(&param, adv_ad, adv_ad_len, NULL, 0);
+}
+
+static void enter(enum adv_phase next, uint32_t now)
+{
+	uint16_t ms = next == ADV_PHASE_FAST ? cfg.fast_ms :
+		      next == ADV_PHASE_SLOW ? cfg.slow_ms : 0;
+	int err = 0;
+
+	// connected, the controller has stopped advertising already
+	if (next != ADV_PHASE_CONN) {
+		err = adv_run(ms);
+	}
+	retry = err != 0;
+	if (err) {
+		LOG_WRN("%s advertising failed (err %d)", phase_names[next], err);
+		ms = 0;
+	}
+
+	K_SPINLOCK(&lock) {
+		st_update(now);
+		if (next == ADV_PHASE_FAST && phase != ADV_PHASE_FAST) {
+			st.windows++;
+		}
+		phase = next;
+		interval_ms = ms;
+	}
+	power_gov_set_adv(ms);
+	LOG_INF("%s, %u ms", phase_names[next], ms);
+}
+
+static void adv_work_fn(struct k_work *work)
+{
+	uint32_t now = k_uptime_get_32();
+	atomic_val_t trig = atomic_clear(&pending);
+	enum adv_phase next = phase;
+
+	K_SPINLOCK(&lock) {
+		if (cfg_new) {
+			cfg = cfg_pending;
+			cfg_new = false;
+		}
+	}
+
+	if (atomic_get(&connected)) {
+		next = ADV_PHASE_CONN;
+	} else if (trig) {
+		// a trigger while fast only moves the end
+		next = ADV_PHASE_FAST;
+		phase_until = now + cfg.fast_s * MSEC_PER_SEC;
+	} else if (phase == ADV_PHASE_FAST && (int32_t)(now - phase_until) >= 0) {
+		next = cfg.slow_s ? ADV_PHASE_SLOW : ADV_PHASE_OFF;
+		phase_until = now + cfg.slow_s * MSEC_PER_SEC;
+	} else if (phase == ADV_PHASE_SLOW && cfg.slow_s != ADV_SCHED_FOREVER &&
+		   (int32_t)(now - phase_until) >= 0) {
+		next = ADV_PHASE_OFF;
+	}
+
+	if (next != phase || retry) {
+		enter(next, now);
+	}
+
+	if (retry) {
+		k_work_reschedule(&adv_work, K_MSEC(ADV_SCHED_RETRY_MS));
+	} else if (next == ADV_PHASE_FAST ||
+		   (next == ADV_PHASE_SLOW && cfg.slow_s != ADV_SCHED_FOREVER)) {
+		k_work_reschedule(&adv_work, K_MSEC(MAX((int32_t)(phase_until - now), 0)));
+	}
+}
+
+void adv_sched_start(const struct bt_data *ad, size_t ad_len)
+{
+	adv_ad = ad;
+	adv_ad_len = ad_len;
+	K_SPINLOCK(&lock) {
+		st_update(k_uptime_get_32());
+	}
+	LOG_INF("fast %u s at %u ms, slow %u s at %u ms", cfg.fast_s, cfg.fast_ms, cfg.slow_s,
+		cfg.slow_ms);
+	atomic_set(&started, 1);
+	adv_sched_trigger(ADV_TRIG_RESET);
+}
+
+void adv_sched_trigger(enum adv_trigger trig)
+{
+	if (!atomic_get(&started) || atomic_get(&connected)) {
+		return;
+	}
+	atomic_inc(&trig_count[trig]);
+	atomic_or(&pending, BIT(trig));
+	k_work_reschedule(&adv_work, K_NO_WAIT);
+}
+
+// The link going away is a trigger of its own (ADV_TRIG_DISCONNECT), once
+// the connection object is free for the next one.
+void adv_sched_set_conn(bool conn)
+{
+	atomic_set(&connected, conn);
+	if (conn) {
+		k_work_reschedule(&adv_work, K_NO_WAIT);
+	}
+}
+
+bool adv_sched_listening(void)
+{
+	return atomic_get(&started) && !atomic_get(&connected);
+}
+
+int adv_sched_configure(const void *buf, uint16_t len)
+{
+	struct adv_sched_cfg c;
+
+	if (len != sizeof(c)) {
+		return -EINVAL;
+	}
+	memcpy(&c, buf, sizeof(c));
+	c.fast_s = sys_le16_to_cpu(c.fast_s);
+	c.fast_ms = sys_le16_to_cpu(c.fast_ms);
+	c.slow_s = sys_le16_to_cpu(c.slow_s);
+	c.slow_ms = sys_le16_to_cpu(c.slow_ms);
+	if (!c.fast_s || !IN_RANGE(c.fast_ms, ADV_MS_MIN, ADV_MS_MAX) ||
+	    (c.slow_s && !IN_RANGE(c.slow_ms, ADV_MS_MIN, ADV_MS_MAX))) {
+		return -EINVAL;
+	}
+
+	K_SPINLOCK(&lock) {
+		cfg_pending = c;
+		cfg_new = true;
+	}
+	return 0;
+}
+
+void adv_sched_get_stats(struct adv_sched_stats *stats)
+{
+	K_SPINLOCK(&lock) {
+		st_update(k_uptime_get_32());
+		memcpy(stats->ms, st.ms, sizeof(st.ms));
+		stats->events = st.mev / 1000;
+		stats->windows = st.windows;
+	}
+	stats->charge_uc = (uint64_t)stats->events * POWER_GOV_ADV_EVENT_NC / 1000;
+	for (int t = 0; t < ADV_TRIG_COUNT; t++) {
+		stats->triggers[t] = atomic_get(&trig_count[t]);
+	}
+}
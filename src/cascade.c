@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/util.h>
+#include "cascade.h"
+
+LOG_MODULE_REGISTER(cascade, LOG_LEVEL_INF);
+
+#define MOTION_LSB  (CASCADE_MOTION_MG * SENSOR_LSB_PER_G / 1000)
+#define TILT_LSB    (CASCADE_TILT_MG * SENSOR_LSB_PER_G / 1000)
+#define IDLE_WINDOWS (CONFIG_APP_CASCADE_IDLE_S * SENSOR_ODR_HZ / CASCADE_WINDOW)
+
+// one window of the confirm level or of the stream, same rule for both
+struct window {
+	uint16_t n;
+	int16_t lo[3];
+	int16_t hi[3];
+	int32_t sum[3];
+};
+
+static const char *const level_names[CASCADE_LEVEL_COUNT] = {
+	"trigger", "confirm", "stream",
+};
+
+// everything here runs on the sensor queue, no locking
+static enum cascade_level level = CASCADE_STREAM;
+static uint32_t since_ms;
+static struct cascade_stats stats;
+
+static struct window win = {
+	.lo = { INT16_MAX, INT16_MAX, INT16_MAX },
+	.hi = { INT16_MIN, INT16_MIN, INT16_MIN },
+};
+static int16_t rest[3];      // window mean when the device last came to rest
+static bool have_rest;
+static uint32_t still_windows;
+static bool idle_pending;
+
+static void win_reset(struct window *w)
+{
+	w->n = 0;
+	for (int a = 0; a < 3; a++) {
+		w->lo[a] = INT16_MAX;
+		w->hi[a] = INT16_MIN;
+		w->sum[a] = 0;
+	}
+}
+
+// true once the window is full
+static bool win_push(struct window *w, const struct bma400_fifo_sensor_data *s)
+{
+	const int16_t v[3] = { s->x, s->y, s->z };
+
+	for (int a = 0; a < 3; a++) {
+		w->lo[a] = MIN(w->lo[a], v[a]);
+		w->hi[a] = MAX(w->hi[a], v[a]);
+		w->sum[a] += v[a];
+	}
+	return ++w->n == CASCADE_WINDOW;
+}
+
+static bool win_moving(const struct window *w)
+{
+	for (int a = 0; a < 3; a++) {
+		if (w->hi[a] - w->lo[a] > MOTION_LSB) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool win_tilted(const struct window *w)
+{
+	if (!have_rest) {
+		return false;
+	}
+	for (int a = 0; a < 3; a++) {
+		if (abs(w->sum[a] / w->n - rest[a]) > TILT_LSB) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void win_rest(const struct window *w)
+{
+	for (int a = 0; a < 3; a++) {
+		rest[a] = w->sum[a] / w->n;
+	}
+	have_rest = true;
+}
+
+static void account(void)
+{
+	uint32_t now = k_uptime_get_32();
+
+	stats.ms[level] += now - since_ms;
+	since_ms = now;
+}
+
+void cascade_set_level(enum cascade_level next)
+{
+	account();
+	LOG_INF("%s -> %s (trigger %u s, confirm %u s, stream %u s)", level_names[level],
+		level_names[next], stats.ms[CASCADE_TRIGGER] / 1000,
+		stats.ms[CASCADE_CONFIRM] / 1000, stats.ms[CASCADE_STREAM] / 1000);
+	level = next;
+	win_reset(&win);
+	still_windows = 0;
+	idle_pending = false;
+}
+
+enum cascade_verdict cascade_confirm(const struct bma400_fifo_sensor_data *samples,
+				     uint16_t count)
+{
+	for (uint16_t i = 0; i < count; i++) {
+		if (!win_push(&win, &samples[i])) {
+			continue;
+		}
+
+		bool moving = win_moving(&win);
+		bool tilted = win_tilted(&win);
+
+		LOG_DBG("window: moving %d tilted %d", moving, tilted);
+		win_reset(&win);
+		if (moving || tilted) {
+			stats.promoted++;
+			return CASCADE_PROMOTE;
+		}
+		stats.rejected++;
+		return CASCADE_DEMOTE;
+	}
+	return CASCADE_PENDING;
+}
+
+void cascade_confirm_timeout(void)
+{
+	stats.timeouts++;
+	win_reset(&win);
+}
+
+void cascade_process(const struct bma400_fifo_sensor_data *samples, uint16_t count)
+{
+	for (uint16_t i = 0; i < count; i++) {
+		if (!win_push(&win, &samples[i])) {
+			continue;
+		}
+		if (win_moving(&win)) {
+			still_windows = 0;
+		} else {
+			win_rest(&win);
+			still_windows++;
+			if (IDLE_WINDOWS && still_windows == IDLE_WINDOWS) {
+				idle_pending = true;
+			}
+		}
+		win_reset(&win);
+	}
+}
+
+bool cascade_take_idle(void)
+{
+	if (!idle_pending) {
+		return false;
+	}
+	idle_pending = false;
+	stats.idle++;
+	return true;
+}
+
+void cascade_get_stats(struct cascade_stats *out)
+{
+	account();
+	*out = stats;
+}
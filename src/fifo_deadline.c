@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/util.h>
+#include "fifo_deadline.h"
+#include "timeline.h"
+
+LOG_MODULE_REGISTER(fifo_deadline, LOG_LEVEL_INF);
+
+static struct k_spinlock lock;
+static struct fifo_deadline_stats stats;
+static uint16_t cap_bytes;
+static k_tid_t reader_tid;
+static int base_prio;
+
+// set in the interrupt, cleared by the drain
+static uint32_t edge_cyc;
+static bool edge_pending;
+static bool boosted;
+static uint16_t drains_on_time;
+
+static void warn_expiry(struct k_timer *timer)
+{
+	K_SPINLOCK(&lock) {
+		stats.warnings++;
+		if (!boosted && reader_tid) {
+			k_thread_priority_set(reader_tid, base_prio - FIFO_DEADLINE_BOOST);
+			boosted = true;
+		}
+		drains_on_time = 0;
+	}
+	timeline_trigger();
+	LOG_WRN("drain late, %u%% of the %u ms budget gone", FIFO_DEADLINE_WARN_PCT,
+		stats.budget_us / 1000);
+}
+
+K_TIMER_DEFINE(warn_timer, warn_expiry, NULL);
+
+void fifo_deadline_config(uint32_t odr_hz, uint8_t frame_bytes, uint16_t wm_bytes,
+			  uint16_t cap_frames, k_tid_t reader)
+{
+	// the watermark fires with the frame that crosses it, the first frame
+	// that doesn't fit comes cap - edge sample periods later
+	uint16_t edge_frames = DIV_ROUND_UP(wm_bytes, frame_bytes);
+	uint16_t max_frames = MIN(cap_frames, FIFO_DEADLINE_HW_BYTES / frame_bytes);
+	uint32_t periods = max_frames >= edge_frames ? max_frames + 1 - edge_frames : 0;
+
+	K_SPINLOCK(&lock) {
+		stats = (struct fifo_deadline_stats){
+			.budget_us = periods * USEC_PER_SEC / odr_hz,
+			.min_slack_us = INT32_MAX,
+		};
+		cap_bytes = max_frames * frame_bytes;
+		reader_tid = reader;
+		base_prio = k_thread_priority_get(reader);
+		boosted = false;
+		edge_pending = false;
+	}
+	LOG_INF("budget %u ms (%u frames after the watermark at %u Hz)",
+		stats.budget_us / 1000, periods, odr_hz);
+}
+
+void fifo_deadline_edge(void)
+{
+	K_SPINLOCK(&lock) {
+		// a second edge before the drain doesn't move the deadline
+		if (!edge_pending && stats.budget_us) {
+			edge_cyc = k_cycle_get_32();
+			edge_pending = true;
+			k_timer_start(&warn_timer,
+				      K_USEC(stats.budget_us / 100 * FIFO_DEADLINE_WARN_PCT), K_NO_WAIT);
+		}
+	}
+}
+
+static uint8_t hist_bucket(uint32_t us)
+{
+	uint8_t b = 0;
+
+	for (us /= FIFO_DEADLINE_HIST_MIN_US; us && b < FIFO_DEADLINE_HIST_BUCKETS - 1; us >>= 1) {
+		b++;
+	}
+	return b;
+}
+
+void fifo_deadline_drained(uint16_t fill_bytes)
+{
+	uint32_t latency_us;
+	int32_t slack_us;
+	bool report = false;
+	bool restore = false;
+
+	k_timer_stop(&warn_timer);
+
+	K_SPINLOCK(&lock) {
+		// drains without an edge (the first one, a stolen semaphore) have nothing to measure
+		if (!edge_pending) {
+			K_SPINLOCK_BREAK;
+		}
+		edge_pending = false;
+		latency_us = k_cyc_to_us_floor32(k_cycle_get_32() - edge_cyc);
+		slack_us = (int32_t)stats.budget_us - (int32_t)latency_us;
+
+		stats.drains++;
+		stats.hist[hist_bucket(latency_us)]++;
+		stats.max_latency_us = MAX(stats.max_latency_us, latency_us);
+		stats.min_slack_us = MIN(stats.min_slack_us, slack_us);
+		stats.max_fill_bytes = MAX(stats.max_fill_bytes, fill_bytes);
+		if (slack_us < 0 || fill_bytes > cap_bytes) {
+			stats.missed++;
+		}
+
+		if (boosted && ++drains_on_time >= FIFO_DEADLINE_RECOVER_DRAINS) {
+			k_thread_priority_set(reader_tid, base_prio);
+			boosted = false;
+			restore = true;
+		}
+		report = stats.drains % FIFO_DEADLINE_REPORT_DRAINS == 0;
+	}
+
+	if (restore) {
+		LOG_INF("reader back to priority %d", base_prio);
+	}
+	if (report) {
+		LOG_INF("drains %u max latency %u us min slack %d us warned %u missed %u max fill %u",
+			stats.drains, stats.max_latency_us, stats.min_slack_us, stats.warnings,
+			stats.missed, stats.max_fill_bytes);
+	}
+}
+
+void fifo_deadline_get_stats(struct fifo_deadline_stats *out)
+{
+	K_SPINLOCK(&lock) {
+		*out = stats;
+	}
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+#include "fifo_trace.h"
+#include "accel_svc.h"
+#include "bma400.h"
+#include "spi_trace.h"
+
+LOG_MODULE_REGISTER(fifo_trace, LOG_LEVEL_INF);
+
+// bma400_get_regs() reads through a BMA400_MAX_LEN stack buffer that also
+// holds the SPI dummy byte, a longer snapshot is read in pieces
+#define REG_READ_CHUNK (BMA400_MAX_LEN - 1)
+
+// [0] is the sequence byte, the rest the next piece of the record stream
+static uint8_t chunk[ACCEL_SVC_MAX_PAYLOAD];
+static uint16_t chunk_len = 1;
+static uint8_t chunk_seq;
+static bool started;
+static bool failed;
+
+static void flush(void)
+{
+	if (chunk_len <= 1 || failed) {
+		return;
+	}
+	chunk[0] = chunk_seq;
+	if (accel_svc_send(ACCEL_STREAM_TRACE, chunk, chunk_len)) {
+		failed = true;
+	} else {
+		chunk_seq++;
+	}
+	chunk_len = 1;
+}
+
+static void put(const void *data, uint16_t len)
+{
+	const uint8_t *p = data;
+	uint16_t max = accel_svc_payload_len();
+
+	while (len && !failed) {
+		uint16_t n = MIN(len, max - chunk_len);
+
+		memcpy(&chunk[chunk_len], p, n);
+		chunk_len += n;
+		p += n;
+		len -= n;
+		if (chunk_len >= max) {
+			flush();
+		}
+	}
+}
+
+static void put_rec(uint8_t type, uint16_t len)
+{
+	struct fifo_trace_rec rec = {
+		.type = type,
+		.len = sys_cpu_to_le16(len),
+		.t_ms = sys_cpu_to_le32(k_uptime_get_32()),
+	};
+
+	put(&rec, sizeof(rec));
+}
+
+static void start(struct bma400_dev *dev)
+{
+	struct fifo_trace_header hdr = {
+		.magic = sys_cpu_to_le32(FIFO_TRACE_MAGIC),
+		.version = sys_cpu_to_le16(FIFO_TRACE_VERSION),
+		.chip_id = dev->chip_id,
+	};
+	struct fifo_trace_regs regs = {
+		.first = FIFO_TRACE_REG_FIRST,
+	};
+
+	for (int r = 0; r < sizeof(regs.v); r += REG_READ_CHUNK) {
+		SPI_TRACED(bma400_get_regs, FIFO_TRACE_REG_FIRST + r, &regs.v[r],
+			   MIN(REG_READ_CHUNK, sizeof(regs.v) - r), dev);
+	}
+
+	put_rec(FIFO_TRACE_REC_HEADER, sizeof(hdr));
+	put(&hdr, sizeof(hdr));
+	put_rec(FIFO_TRACE_REC_REGS, sizeof(regs));
+	put(&regs, sizeof(regs));
+	LOG_INF("trace capture started");
+}
+
+void fifo_trace_capture(struct bma400_dev *dev, uint16_t int_status,
+			const uint8_t *fifo, uint16_t len)
+{
+	uint16_t status_le = sys_cpu_to_le16(int_status);
+
+	if (!accel_svc_subscribed(ACCEL_STREAM_TRACE)) {
+		started = false;
+		return;
+	}
+
+	// after a dropped chunk the phone can't parse on, begin a new trace
+	if (!started || failed) {
+		if (failed) {
+			LOG_WRN("trace chunk %u dropped, restarting", chunk_seq);
+		}
+		failed = false;
+		chunk_len = 1;
+		start(dev);
+		started = true;
+	}
+
+	// drop the SPI dummy byte
+	fifo += dev->dummy_byte;
+	len -= MIN(len, dev->dummy_byte);
+
+	put_rec(FIFO_TRACE_REC_DRAIN, sizeof(status_le) + len);
+	put(&status_le, sizeof(status_le));
+	put(fifo, len);
+	// don't hold a drain back until the next one
+	flush();
+}
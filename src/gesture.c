@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+#include "gesture.h"
+#include "cyccnt.h"
+
+LOG_MODULE_REGISTER(gesture, LOG_LEVEL_INF);
+
+#define DTW_INF UINT32_MAX
+
+// sensor samples are 12 bit, template points 8 bit at 16 LSB per unit
+#define SAMPLE_TO_Q15(v)  ((int16_t)((v) * 16))
+#define POINT_TO_Q15(p)   ((int16_t)((p) * 256))
+
+struct gesture_tmpl {
+	uint8_t id;           // 0 = slot empty
+	uint8_t len;
+	uint32_t threshold;
+	int16_t pts[GESTURE_TMPL_MAX][3];
+};
+
+static struct gesture_tmpl tmpls[GESTURE_MAX_TEMPLATES];
+static K_MUTEX_DEFINE(tmpl_lock);
+
+static int16_t win[GESTURE_WIN_MAX][3];
+static uint16_t win_len;
+static bool capturing;
+
+static struct gesture_stats stats;
+
+int gesture_load_template(const void *data, uint16_t len)
+{
+	const struct gesture_tmpl_wire *w = data;
+	struct gesture_tmpl *t;
+
+	if (len < sizeof(*w) || w->slot >= GESTURE_MAX_TEMPLATES ||
+	    w->len > GESTURE_TMPL_MAX || len != sizeof(*w) + w->len * 3) {
+		return -EINVAL;
+	}
+
+	k_mutex_lock(&tmpl_lock, K_FOREVER);
+	t = &tmpls[w->slot];
+	if (w->len == 0 || w->id == 0) {
+		t->id = 0;
+	} else {
+		t->id = w->id;
+		t->len = w->len;
+		t->threshold = sys_le16_to_cpu(w->threshold);
+		for (int i = 0; i < w->len; i++) {
+			for (int a = 0; a < 3; a++) {
+				t->pts[i][a] = POINT_TO_Q15(w->pts[i * 3 + a]);
+			}
+		}
+	}
+	k_mutex_unlock(&tmpl_lock);
+
+	LOG_INF("template slot %u: id %u, %u points", w->slot, w->id, w->len);
+	return 0;
+}
+
+static inline uint32_t l1_q15(const int16_t a[3], const int16_t b[3])
+{
+	uint32_t d = 0;
+
+	for (int k = 0; k < 3; k++) {
+		int32_t v = (int32_t)a[k] - b[k];
+
+		d += (v < 0) ? -v : v;
+	}
+	return d;
+}
+
+// DTW between the window and a template inside a band around the diagonal.
+// Gives up as soon as a whole row is above limit (the path can only get
+// more expensive) and returns DTW_INF.
+static uint32_t dtw(const struct gesture_tmpl *t, uint32_t limit)
+{
+	static uint32_t rows[2][GESTURE_TMPL_MAX + 1];
+	uint32_t *prev = rows[0], *cur = rows[1];
+	const uint16_t n = win_len, m = t->len;
+	const uint16_t band = MAX(GESTURE_BAND, (n > m) ? n - m : m - n);
+
+	for (int j = 0; j <= m; j++) {
+		prev[j] = DTW_INF;
+	}
+	prev[0] = 0;
+
+	for (int i = 1; i <= n; i++) {
+		int center = i * m / n;
+		int jlo = MAX(1, center - band);
+		int jhi = MIN(m, center + band);
+		uint32_t row_min = DTW_INF;
+
+		for (int j = 0; j <= m; j++) {
+			cur[j] = DTW_INF;
+		}
+		for (int j = jlo; j <= jhi; j++) {
+			uint32_t best = MIN(prev[j], MIN(prev[j - 1], cur[j - 1]));
+
+			if (best == DTW_INF) {
+				continue;
+			}
+			cur[j] = best + l1_q15(win[i - 1], t->pts[j - 1]);
+			row_min = MIN(row_min, cur[j]);
+		}
+		if (row_min > limit) {
+			stats.abandoned++;
+			return DTW_INF;
+		}
+
+		uint32_t *tmp = prev;
+
+		prev = cur;
+		cur = tmp;
+	}
+
+	return prev[m];
+}
+
+static uint8_t match_window(void)
+{
+	uint8_t best_id = 0;
+	uint32_t best_norm = DTW_INF;
+
+	stats.windows++;
+
+	k_mutex_lock(&tmpl_lock, K_FOREVER);
+	for (int s = 0; s < GESTURE_MAX_TEMPLATES; s++) {
+		const struct gesture_tmpl *t = &tmpls[s];
+
+		if (!t->id) {
+			continue;
+		}
+
+		// compare per step so short and long templates share one threshold scale
+		uint32_t steps = win_len + t->len;
+		uint32_t limit = MIN((uint64_t)t->threshold * steps, (uint64_t)DTW_INF - 1);
+
+		// the best match so far tightens the limit for the remaining ones
+		if (best_norm != DTW_INF) {
+			limit = MIN(limit, best_norm * steps);
+		}
+
+		uint32_t start = cyccnt_get();
+		uint32_t d = dtw(t, limit);
+		uint32_t cycles = cyccnt_get() - start;
+
+		stats.matches++;
+		stats.last_cycles = cycles;
+		stats.avg_cycles = stats.avg_cycles ? (stats.avg_cycles * 7 + cycles) / 8 : cycles;
+
+		if (d == DTW_INF) {
+			continue;
+		}
+		uint32_t norm = d / steps;
+
+		LOG_DBG("slot %d id %u: dist %u/step, %u cycles", s, t->id, norm, cycles);
+		if (norm <= t->threshold && norm < best_norm) {
+			best_norm = norm;
+			best_id = t->id;
+		}
+	}
+	k_mutex_unlock(&tmpl_lock);
+
+	if (best_id) {
+		stats.detected++;
+		LOG_INF("gesture %u (dist %u, %u samples, last match %u cycles)",
+			best_id, best_norm, win_len, stats.last_cycles);
+	}
+	return best_id;
+}
+
+uint8_t gesture_process(const struct bma400_fifo_sensor_data *samples, uint16_t count,
+			bool active)
+{
+	uint8_t id = 0;
+
+	if (!capturing && !active) {
+		return 0;
+	}
+	if (!capturing) {
+		capturing = true;
+		win_len = 0;
+	}
+
+	for (int i = 0; i < count && win_len < GESTURE_WIN_MAX; i++) {
+		win[win_len][0] = SAMPLE_TO_Q15(samples[i].x);
+		win[win_len][1] = SAMPLE_TO_Q15(samples[i].y);
+		win[win_len][2] = SAMPLE_TO_Q15(samples[i].z);
+		win_len++;
+	}
+
+	// motion stopped (or the window is full): close it and match
+	if (!active || win_len == GESTURE_WIN_MAX) {
+		if (win_len >= GESTURE_WIN_MIN) {
+			id = match_window();
+		}
+		capturing = false;
+	}
+
+	return id;
+}
+
+void gesture_get_stats(struct gesture_stats *out)
+{
+	*out = stats;
+}
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+#include "gravity.h"
+#include "accel_svc.h"
+#include "fixmath.h"
+#include "sensor_cfg.h"
+
+LOG_MODULE_REGISTER(gravity, LOG_LEVEL_INF);
+
+// one-pole low-pass coefficient, alpha = 1 / (1 + tau * fs) in Q15
+#define GRAVITY_ALPHA_Q15  ((int32_t)(32768LL * 1000 / (1000 + (int64_t)GRAVITY_TAU_MS * SENSOR_ODR_HZ)))
+
+static int32_t g_q15[3];   // gravity estimate in LSB, 15 fraction bits
+static bool primed;
+
+static uint8_t lin_decim = CONFIG_APP_GRAVITY_LIN_DECIM;
+static atomic_t decim_req;   // from the settings write, applied on the sensor queue
+static int32_t lin_thresh_lsb = CONFIG_APP_GRAVITY_LIN_THRESH_MG * SENSOR_LSB_PER_G / 1000;
+static int32_t lin_sum[3];
+static uint8_t lin_phase;
+static uint16_t lin_seq;
+static uint16_t grav_seq;
+
+void gravity_set_decimation(uint8_t decim)
+{
+	atomic_set(&decim_req, MAX(decim, 1));
+}
+
+static void apply_decimation(void)
+{
+	uint8_t decim = atomic_clear(&decim_req);
+
+	if (!decim || decim == lin_decim) {
+		return;
+	}
+	// the partial average is dropped
+	lin_decim = decim;
+	lin_phase = 0;
+	lin_sum[0] = lin_sum[1] = lin_sum[2] = 0;
+	LOG_INF("linear decimation %u", decim);
+}
+
+void gravity_set_threshold(uint16_t mg)
+{
+	lin_thresh_lsb = (int32_t)mg * SENSOR_LSB_PER_G / 1000;
+}
+
+static void send_gravity(void)
+{
+	int32_t g[3];
+	uint64_t sq = 0;
+
+	for (int a = 0; a < 3; a++) {
+		g[a] = g_q15[a] >> 15;
+		sq += (int64_t)g[a] * g[a];
+	}
+
+	uint32_t mag = isqrt64(sq);
+	struct gravity_pkt pkt = {
+		.seq = sys_cpu_to_le16(grav_seq++),
+		.mag = sys_cpu_to_le16(mag),
+	};
+
+	for (int a = 0; a < 3; a++) {
+		pkt.dir[a] = sys_cpu_to_le16(mag ? sat16(((int64_t)g[a] * (1 << 15)) / mag) : 0);
+	}
+	accel_svc_send(ACCEL_STREAM_GRAVITY, &pkt, sizeof(pkt));
+}
+
+void gravity_process(const struct bma400_fifo_sensor_data *samples, uint16_t count)
+{
+	bool want_lin = accel_svc_subscribed(ACCEL_STREAM_LINEAR);
+	bool want_grav = accel_svc_subscribed(ACCEL_STREAM_GRAVITY);
+	// decimated samples go straight into the notification payload
+	uint16_t cap = ACCEL_SVC_MAX_PAYLOAD;
+	uint8_t *buf = want_lin ? accel_svc_reserve(&cap) : NULL;
+	struct linear_pkt_hdr *hdr = (struct linear_pkt_hdr *)buf;
+	const uint8_t max_n = (cap - sizeof(struct linear_pkt_hdr)) / 3;
+	int32_t peak = 0;
+	uint8_t n = 0;
+
+	if (!want_lin && !want_grav) {
+		// start over from the next sample when someone subscribes again
+		primed = false;
+		return;
+	}
+	apply_decimation();
+
+	for (int i = 0; i < count; i++) {
+		const int32_t v[3] = { samples[i].x, samples[i].y, samples[i].z };
+
+		if (!primed) {
+			for (int a = 0; a < 3; a++) {
+				g_q15[a] = v[a] * (1 << 15);
+			}
+			primed = true;
+		}
+
+		for (int a = 0; a < 3; a++) {
+			g_q15[a] += (int32_t)(((int64_t)((v[a] * (1 << 15)) - g_q15[a]) * GRAVITY_ALPHA_Q15) >> 15);
+
+			int32_t lin = v[a] - (g_q15[a] >> 15);
+
+			lin_sum[a] += lin;
+			peak = MAX(peak, lin < 0 ? -lin : lin);
+		}
+
+		if (++lin_phase < lin_decim) {
+			continue;
+		}
+		lin_phase = 0;
+		if (n < max_n) {
+			int8_t *out = buf ? (int8_t *)(buf + sizeof(*hdr)) + n * 3 : NULL;
+
+			for (int a = 0; out && a < 3; a++) {
+				int32_t avg = lin_sum[a] / lin_decim;
+
+				out[a] = (int8_t)CLAMP(avg >> GRAVITY_LIN_SHIFT, INT8_MIN, INT8_MAX);
+			}
+			n++;
+		}
+		lin_sum[0] = lin_sum[1] = lin_sum[2] = 0;
+	}
+
+	if (want_grav) {
+		send_gravity();
+	}
+
+	if (n) {
+		// sequence advances even for suppressed batches so the phone sees the gap
+		uint16_t seq = lin_seq;
+
+		lin_seq += n;
+		if (buf && peak >= lin_thresh_lsb) {
+			hdr->seq = sys_cpu_to_le16(seq);
+			hdr->decim = lin_decim;
+			hdr->n = n;
+			accel_svc_commit(ACCEL_STREAM_LINEAR, sizeof(*hdr) + n * 3);
+			return;
+		}
+	}
+	if (buf) {
+		accel_svc_release();
+	}
+}
@@ -0,0 +1,341 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/hci.h>
+#include <zephyr/bluetooth/hci_vs.h>
+#include "link_adapt.h"
+
+LOG_MODULE_REGISTER(link_adapt, LOG_LEVEL_INF);
+
+// TX power steps supported by the nRF52 radio (dBm), lowest first
+static const int8_t tx_power_steps[] = { -40, -20, -16, -12, -8, -4, 0, 3, 4 };
+#define TX_POWER_DEFAULT_IDX 6 // 0 dBm
+
+// Rough radio current for each step (uA, DC/DC on, 3 V) from the nRF52832 PS.
+// Only used for the goodput-per-joule estimate, so it does not need to be exact.
+static const uint16_t tx_current_ua[] = { 2900, 3400, 3600, 3900, 4200, 4600, 5300, 7000, 7500 };
+#define RX_CURRENT_UA  5400
+#define SUPPLY_MV      3000
+
+// on-air bytes added to every notification (preamble, AA, LL header, CRC, L2CAP + ATT header)
+#define NOTIFY_OVERHEAD_BYTES 17
+// empty LL packet the central sends back for every data packet
+#define ACK_AIR_BYTES         10
+
+enum link_phy {
+	LINK_PHY_1M,
+	LINK_PHY_2M,
+	LINK_PHY_CODED,
+};
+
+static const char *const phy_names[] = { "1M", "2M", "Coded" };
+// air time per byte in us (Coded uses S=8)
+static const uint8_t phy_us_per_byte[] = { 8, 4, 64 };
+
+static struct bt_conn *la_conn;
+static uint16_t la_handle;
+static uint8_t tx_idx = TX_POWER_DEFAULT_IDX;
+static enum link_phy cur_phy = LINK_PHY_1M;
+static bool phy_pending;
+static uint8_t phy_wait;        // periods the pending update has been waited for
+
+// filled from the notify path, drained by the work item every period
+static atomic_t tx_queued_bytes;
+static atomic_t tx_done_bytes;
+static atomic_t tx_done_pkts;
+static atomic_t tx_slow_pkts;
+static atomic_t tx_failed;
+
+static uint32_t last_goodput_per_mj;
+
+static void link_adapt_work_fn(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(link_adapt_work, link_adapt_work_fn);
+
+static int read_conn_rssi(int8_t *rssi)
+{
+	struct bt_hci_cp_read_rssi *cp;
+	struct bt_hci_rp_read_rssi *rp;
+	struct net_buf *buf, *rsp = NULL;
+	int err;
+
+	buf = bt_hci_cmd_create(BT_HCI_OP_READ_RSSI, sizeof(*cp));
+	if (!buf) {
+		return -ENOBUFS;
+	}
+	cp = net_buf_add(buf, sizeof(*cp));
+	cp->handle = sys_cpu_to_le16(la_handle);
+
+	err = bt_hci_cmd_send_sync(BT_HCI_OP_READ_RSSI, buf, &rsp);
+	if (err) {
+		return err;
+	}
+	rp = (void *)rsp->data;
+	*rssi = rp->rssi;
+	net_buf_unref(rsp);
+
+	return 0;
+}
+
+static int write_conn_tx_power(int8_t dbm)
+{
+	struct bt_hci_cp_vs_write_tx_power_level *cp;
+	struct bt_hci_rp_vs_write_tx_power_level *rp;
+	struct net_buf *buf, *rsp = NULL;
+	int err;
+
+	buf = bt_hci_cmd_create(BT_HCI_OP_VS_WRITE_TX_POWER_LEVEL, sizeof(*cp));
+	if (!buf) {
+		return -ENOBUFS;
+	}
+	cp = net_buf_add(buf, sizeof(*cp));
+	cp->handle = sys_cpu_to_le16(la_handle);
+	cp->handle_type = BT_HCI_VS_LL_HANDLE_TYPE_CONN;
+	cp->tx_power_level = dbm;
+
+	err = bt_hci_cmd_send_sync(BT_HCI_OP_VS_WRITE_TX_POWER_LEVEL, buf, &rsp);
+	if (err) {
+		return err;
+	}
+	rp = (void *)rsp->data;
+	if (rp->status) {
+		LOG_WRN("TX power %d dBm refused (status 0x%02x)", dbm, rp->status);
+		net_buf_unref(rsp);
+		return -EIO;
+	}
+	LOG_DBG("TX power %d dBm (selected %d)", dbm, rp->selected_tx_power);
+	net_buf_unref(rsp);
+
+	return 0;
+}
+
+static void request_phy(enum link_phy phy)
+{
+	const struct bt_conn_le_phy_param *param;
+	int err;
+
+	if (phy == cur_phy || phy_pending) {
+		return;
+	}
+
+	switch (phy) {
+	case LINK_PHY_2M:
+		param = BT_CONN_LE_PHY_PARAM_2M;
+		break;
+#if defined(CONFIG_BT_CTLR_PHY_CODED)
+	case LINK_PHY_CODED:
+		param = BT_CONN_LE_PHY_PARAM_CODED;
+		break;
+#endif
+	case LINK_PHY_1M:
+		param = BT_CONN_LE_PHY_PARAM_1M;
+		break;
+	default:
+		// Coded requested but the controller can't do it (nRF52832), stay on 1M
+		if (cur_phy == LINK_PHY_1M) {
+			return;
+		}
+		param = BT_CONN_LE_PHY_PARAM_1M;
+		break;
+	}
+
+	err = bt_conn_le_phy_update(la_conn, param);
+	if (err) {
+		LOG_WRN("PHY update failed (err %d)", err);
+		phy_pending = false;
+		return;
+	}
+	phy_pending = true;
+	phy_wait = 0;
+}
+
+static void set_tx_idx(uint8_t idx)
+{
+	if (idx == tx_idx) {
+		return;
+	}
+	if (write_conn_tx_power(tx_power_steps[idx]) == 0) {
+		tx_idx = idx;
+	}
+}
+
+// energy spent on the radio for a given number of payload bytes/packets, in nJ
+static uint64_t radio_energy_nj(uint32_t bytes, uint32_t pkts)
+{
+	uint64_t tx_us = (uint64_t)(bytes + pkts * NOTIFY_OVERHEAD_BYTES) * phy_us_per_byte[cur_phy];
+	uint64_t rx_us = (uint64_t)pkts * ACK_AIR_BYTES * phy_us_per_byte[cur_phy];
+
+	// uA * us * mV = fJ, divide down to nJ
+	return (tx_us * tx_current_ua[tx_idx] + rx_us * RX_CURRENT_UA) * SUPPLY_MV / 1000000;
+}
+
+static void link_adapt_work_fn(struct k_work *work)
+{
+	int8_t rssi;
+	uint32_t queued, done, pkts, slow, failed;
+	uint32_t loss_pct = 0;
+	uint32_t slow_pct = 0;
+	uint8_t idx = tx_idx;
+
+	if (!la_conn) {
+		return;
+	}
+
+	queued = atomic_clear(&tx_queued_bytes);
+	done = atomic_clear(&tx_done_bytes);
+	pkts = atomic_clear(&tx_done_pkts);
+	slow = atomic_clear(&tx_slow_pkts);
+	failed = atomic_clear(&tx_failed);
+
+	if (queued) {
+		loss_pct = (queued > done) ? (queued - done) * 100 / queued : 0;
+	}
+	if (pkts) {
+		slow_pct = slow * 100 / pkts;
+	}
+
+	// no answer from the peer, ask again when the RSSI still says so
+	if (phy_pending && ++phy_wait >= LINK_ADAPT_PHY_TIMEOUT) {
+		LOG_WRN("PHY update not completed, giving up on it");
+		phy_pending = false;
+	}
+
+	if (read_conn_rssi(&rssi)) {
+		LOG_WRN("RSSI read failed");
+		goto out;
+	}
+
+	// goodput per joule over the last period, for the current TX power/PHY
+	uint64_t nj = radio_energy_nj(done, pkts);
+	uint32_t goodput_per_mj = nj ? (uint32_t)((uint64_t)done * 1000000 / nj) : 0;
+
+	LOG_INF("rssi %d dBm, tx %d dBm, %s PHY, %u B acked, %u%% slow, %u fail, %u B/mJ (was %u)",
+		rssi, tx_power_steps[tx_idx], phy_names[cur_phy], done, slow_pct, failed,
+		goodput_per_mj, last_goodput_per_mj);
+	if (goodput_per_mj) {
+		last_goodput_per_mj = goodput_per_mj;
+	}
+
+	// A lot of late acks or lost bytes means the central is missing packets
+	// even if the RSSI looks fine (interference): the PHY is picked as if it
+	// were one step weaker, and TX power never goes down on such a period.
+	bool lossy = slow_pct > 20 || loss_pct > 10;
+
+	if (lossy) {
+		rssi -= 6;
+	}
+
+	if (rssi > LINK_ADAPT_RSSI_STRONG) {
+		if (idx > 0 && !lossy) {
+			idx--;
+		}
+		request_phy(LINK_PHY_2M);
+	} else if (rssi > LINK_ADAPT_RSSI_GOOD) {
+		// TX power stays, only leave Coded once we are clearly back in range
+		if (cur_phy == LINK_PHY_CODED) {
+			request_phy(LINK_PHY_1M);
+		}
+	} else if (rssi > LINK_ADAPT_RSSI_WEAK) {
+		// hysteresis: neither the steps up below nor the way back above
+	} else if (rssi > LINK_ADAPT_RSSI_EDGE) {
+		if (idx < ARRAY_SIZE(tx_power_steps) - 1) {
+			idx++;
+		}
+		if (cur_phy == LINK_PHY_2M) {
+			request_phy(LINK_PHY_1M);
+		}
+	} else {
+		idx = ARRAY_SIZE(tx_power_steps) - 1;
+		request_phy(LINK_PHY_CODED);
+	}
+	// and up a step in any band where the RSSI alone would not raise it
+	if (lossy && idx == tx_idx && idx < ARRAY_SIZE(tx_power_steps) - 1) {
+		idx++;
+	}
+
+	set_tx_idx(idx);
+
+out:
+	k_work_reschedule(&link_adapt_work, K_MSEC(LINK_ADAPT_PERIOD_MS));
+}
+
+void link_adapt_start(struct bt_conn *conn)
+{
+	int err;
+
+	err = bt_hci_get_conn_handle(conn, &la_handle);
+	if (err) {
+		LOG_ERR("No conn handle (err %d)", err);
+		return;
+	}
+
+	la_conn = conn;
+	tx_idx = TX_POWER_DEFAULT_IDX;
+	cur_phy = LINK_PHY_1M;
+	phy_pending = false;
+	phy_wait = 0;
+	last_goodput_per_mj = 0;
+	atomic_clear(&tx_queued_bytes);
+	atomic_clear(&tx_done_bytes);
+	atomic_clear(&tx_done_pkts);
+	atomic_clear(&tx_slow_pkts);
+	atomic_clear(&tx_failed);
+
+	k_work_reschedule(&link_adapt_work, K_MSEC(LINK_ADAPT_PERIOD_MS));
+}
+
+void link_adapt_stop(void)
+{
+	la_conn = NULL;
+	k_work_cancel_delayable(&link_adapt_work);
+}
+
+void link_adapt_tx_queued(uint16_t len)
+{
+	atomic_add(&tx_queued_bytes, len);
+}
+
+void link_adapt_tx_failed(void)
+{
+	atomic_inc(&tx_failed);
+}
+
+void link_adapt_tx_done(uint16_t len, uint32_t queued_at_ms)
+{
+	atomic_add(&tx_done_bytes, len);
+	atomic_inc(&tx_done_pkts);
+	if (k_uptime_get_32() - queued_at_ms > LINK_ADAPT_SLOW_TX_MS) {
+		atomic_inc(&tx_slow_pkts);
+	}
+}
+
+void link_adapt_phy_updated(struct bt_conn *conn, uint8_t tx_phy, uint8_t rx_phy)
+{
+	ARG_UNUSED(rx_phy);
+
+	if (conn != la_conn) {
+		return;
+	}
+	phy_pending = false;
+
+	switch (tx_phy) {
+	case BT_GAP_LE_PHY_2M:
+		cur_phy = LINK_PHY_2M;
+		break;
+	case BT_GAP_LE_PHY_CODED:
+		cur_phy = LINK_PHY_CODED;
+		break;
+	default:
+		cur_phy = LINK_PHY_1M;
+		break;
+	}
+	LOG_INF("PHY now %s", phy_names[cur_phy]);
+}
@@ -9,21 +9,53 @@
 // Change Line 419
 
 
+#include <string.h>
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/device.h>
 #include <zephyr/pm/device.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
 #include <zephyr/devicetree.h>
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/drivers/spi.h>
 #include "bma400.h"
 #include "bma400_defs.h"
+#include "sensor_cfg.h"
 
 //BLE STUFF
 #include <zephyr/bluetooth/bluetooth.h>
 #include <zephyr/bluetooth/conn.h>
 #include <zephyr/bluetooth/gatt.h>
 #include <zephyr/bluetooth/gap.h>
+#include "link_adapt.h"
+#include "accel_svc.h"
+#include "accel_features.h"
+#include "retained_ring.h"
+#include "actigraphy.h"
+#include "gravity.h"
+#include "gesture.h"
+#include "sketch.h"
+#include "reduce.h"
+#include "cyccnt.h"
+#include "stage_prof.h"
+#include "fifo_trace.h"
+#include "fifo_deadline.h"
+#include "timesync.h"
+#include "timeline.h"
+#include "spi_trace.h"
+#include "wake_tune.h"
+#include "rollup.h"
+#include "wear_state.h"
+#include "sensor_seq.h"
+#include "power_gov.h"
+#include "adv_sched.h"
+#include "cascade.h"
+#if defined(CONFIG_APP_SENSOR_EMUL)
+#include "sensor_emul.h"
+#elif defined(CONFIG_APP_TRACE_REPLAY)
+#include "trace_replay.h"
+#endif
 
 //////////////////////////////////////////////////////////////////////////
 //																		//
@@ -32,34 +64,9 @@
 //////////////////////////////////////////////////////////////////////////
 #define DEVICE_NAME       CONFIG_BT_DEVICE_NAME
 #define DEVICE_NAME_LEN   (sizeof(DEVICE_NAME) - 1)
-#define BT_UUID_ACCEL_SERVICE_VAL \ 
-	BT_UUID_128_ENCODE(0x12345678,0x1234,0x5678,0x1234,0x1234567890ab)
-
-#define BT_UUID_ACCEL_CHAR_VAL \
-	BT_UUID_128_ENCODE(0x12345679,0x1234,0x5678,0x1234,0x1234567890ab)
-
-
-static struct bt_uuid_128 accel_service_uuid = BT_UUID_INIT_128(BT_UUID_ACCEL_SERVICE_VAL);
-static struct bt_uuid_128 accel_char_uuid    = BT_UUID_INIT_128(BT_UUID_ACCEL_CHAR_VAL);	
-
-static uint8_t accel_value[6] = {0};
-
-static void accel_ccc_cfg_changed(const struct bt_gatt_attr *attr,uint16_t value){
-	bool notif_enabled = (value == BT_GATT_CCC_NOTIFY);
-	printk("Accel notifications %s\n",notif_enabled ? "enabled" : "disabled");
-}
-
-BT_GATT_SERVICE_DEFINE(accel_svc,
-	BT_GATT_PRIMARY_SERVICE(&accel_service_uuid),
-	BT_GATT_CHARACTERISTIC(&accel_char_uuid.uuid,
-			       BT_GATT_CHRC_NOTIFY,
-			       BT_GATT_PERM_NONE,
-			       NULL, NULL, accel_value),
-	BT_GATT_CCC(accel_ccc_cfg_changed,
-		    BT_GATT_PERM_READ | BT_GATT_PERM_WRITE)
-);
 
 static struct bt_conn *current_conn;
+static void request_conn_param(void);
 
 static void connected(struct bt_conn *conn, uint8_t err)
 {
@@ -69,20 +76,42 @@ static void connected(struct bt_conn *conn, uint8_t err)
 	}
 	printk("Connected\n");
 	current_conn = bt_conn_ref(conn);
+	accel_svc_set_conn(current_conn);
+	link_adapt_start(current_conn);
+	power_gov_set_conn(current_conn);
+	adv_sched_set_conn(true);
+	request_conn_param();
 }
 
 static void disconnected(struct bt_conn *conn, uint8_t reason)
 {
 	printk("Disconnected (reason 0x%02x)\n", reason);
+	link_adapt_stop();
+	accel_svc_set_conn(NULL);
+	power_gov_set_conn(NULL);
+	adv_sched_set_conn(false);
 	if (current_conn) {
 		bt_conn_unref(current_conn);
 		current_conn = NULL;
 	}
 }
 
+// the connection object is free again, advertising can start
+static void recycled(void)
+{
+	adv_sched_trigger(ADV_TRIG_DISCONNECT);
+}
+
+static void le_phy_updated(struct bt_conn *conn, struct bt_conn_le_phy_info *param)
+{
+	link_adapt_phy_updated(conn, param->tx_phy, param->rx_phy);
+}
+
 BT_CONN_CB_DEFINE(conn_callbacks) = {
 	.connected = connected,
 	.disconnected = disconnected,
+	.recycled = recycled,
+	.le_phy_updated = le_phy_updated,
 };
 
 static const struct bt_data ad[] = {
@@ -97,29 +126,12 @@ static void bt_ready(int err)
 		return;
 	}
 	printk("Bluetooth initialized\n");
-	err = bt_le_adv_start(BT_LE_ADV_CONN_FAST_2, ad, ARRAY_SIZE(ad),
-			      NULL, 0);
-	if (err) {
-		printk("Advertising failed to start (err %d)\n", err);
-		return;
-	}
-	printk("Advertising started\n");
-}
-
-// for sending to android phone
-static void send_accel_notification(int16_t x, int16_t y, int16_t z){
-	if(!current_conn) return;
-	accel_value[0] = x & 0xFF;
-	accel_value[1] = (x >> 8) & 0xFF;
-	accel_value[2] = y & 0xFF;
-	accel_value[3] = (y >> 8) & 0xFF;
-	accel_value[4] = z & 0xFF;
-	accel_value[5] = (z >> 8) & 0xFF;
-	int err = bt_gatt_notify(current_conn, &accel_svc.attrs[1],
-				 accel_value, sizeof(accel_value));
+	err = timesync_start();
 	if (err) {
-		printk("Notify failed (err %d)\n", err);
+		printk("Hub beacon scan failed to start (err %d)\n", err);
 	}
+	// advertising follows the sensor from here (adv_sched.h)
+	adv_sched_start(ad, ARRAY_SIZE(ad));
 }
 
 
@@ -132,32 +144,55 @@ LOG_MODULE_REGISTER(app, LOG_LEVEL_DBG);
 //						Embedded functionality for sensor				//
 //																		//
 //////////////////////////////////////////////////////////////////////////
-// threads
-#define STACKSIZE 2048
-#define THREAD_READ_BMA_PRIORITY 7
-K_SEM_DEFINE(bma400_ready, 0, 1);
+// FIFO drains run on the sensor work queue (sensor_seq.h)
+static void drain_bma400(struct k_work *work);
+static K_WORK_DEFINE(drain_work, drain_bma400);
+// cascade level in effect (cascade.h); only streaming has the FIFO on the pin
+static atomic_t level = ATOMIC_INIT(CASCADE_STREAM);
 
+#if defined(CONFIG_APP_SENSOR_SPI)
 // SPI
 #define SPIOP	SPI_WORD_SET(8) | SPI_TRANSFER_MSB
 struct spi_dt_spec spispec = SPI_DT_SPEC_GET(DT_NODELABEL(bma400), SPIOP, 0);
-uint8_t rx_buffer[128] = {0};
+
+// Bus profile, from the board overlay: the clock of the bma400 node and
+// whether its controller moves the bytes by DMA (SPIM) or from the CPU
+// (legacy SPI, nRF52832 because of errata 58). A full FIFO read has to fit
+// in CONFIG_APP_SPI_DRAIN_MAX_US.
+#define BMA400_BUS            DT_BUS(DT_NODELABEL(bma400))
+#define SPI_HZ                DT_PROP(DT_NODELABEL(bma400), spi_max_frequency)
+#define SPI_DMA               DT_NODE_HAS_COMPAT(BMA400_BUS, nordic_nrf_spim)
+#define SPI_CPU_NS_PER_BYTE   1000    // legacy SPI: an interrupt per byte
+#define SPI_DRAIN_US(bytes)   ((uint64_t)(bytes) * (8000000000ULL / SPI_HZ + \
+				(SPI_DMA ? 0 : SPI_CPU_NS_PER_BYTE)) / 1000)
 
 // interrupt GPIO
 #define int_NODE DT_ALIAS(int1)
 static const struct gpio_dt_spec int_pin = GPIO_DT_SPEC_GET(int_NODE, gpios);
 static struct gpio_callback int_cb_data;
+#endif
 
 // BMA400
-#define BMA400_REG_FIFO_CONFIG_1                  UINT8_C(0x27)
 #define FIFOINTER 3
-#define FIFO_SAMPLES 25 // number of samples for fifo content
-#define FIFO_WATERMARK_LEVEL    UINT16_C(FIFO_SAMPLES*3) // 4 bytes per frame (XYZ+header)
+#define FIFO_WATERMARK_LEVEL    UINT16_C(FIFO_SAMPLES*3) // 19 frames of FIFO_FRAME_BYTES at boot, the power governor moves it
 #define FIFO_FULL_SIZE          UINT16_C(1024)
 #define FIFO_SIZE               (FIFO_FULL_SIZE + BMA400_FIFO_BYTES_OVERREAD)
 #define FIFO_ACCEL_FRAME_COUNT  UINT8_C(FIFO_SAMPLES)
 
+#if defined(CONFIG_APP_SENSOR_SPI)
+BUILD_ASSERT(SPI_HZ <= 10000000, "the BMA400 takes 10 MHz SPI at most");
+// address byte + dummy byte + the FIFO with overread
+BUILD_ASSERT(SPI_DRAIN_US(2 + FIFO_SIZE) <= CONFIG_APP_SPI_DRAIN_MAX_US,
+	     "full FIFO drain too slow for this bus profile");
+#endif
+
 BMA400_INTF_RET_TYPE read_reg_spi(uint8_t reg_address, uint8_t* data, uint32_t len, void* intf_ptr);
 BMA400_INTF_RET_TYPE write_reg_spi(uint8_t reg_address, const uint8_t* data, uint32_t len, void* intf_ptr);
+static void program_wake(const struct wake_tune_cfg *cfg);
+static void apply_profile(const struct power_gov_profile *p);
+static void enter_trigger(bool off);
+static void start_confirm(void);
+static void drain_confirm(void);
 void bma400_delay_us(uint32_t period, void *intf_ptr) {
 	k_usleep(period);
 }
@@ -166,8 +201,16 @@ static uint8_t              dev_addr    = 31;
 struct bma400_dev           bma_sensor         = {
         .intf = BMA400_SPI_INTF,
         .intf_ptr = &dev_addr,
+#if defined(CONFIG_APP_SENSOR_EMUL)
+        .read = sensor_emul_read,
+        .write = sensor_emul_write,
+#elif defined(CONFIG_APP_TRACE_REPLAY)
+        .read = trace_replay_read,
+        .write = trace_replay_write,
+#else
         .read = read_reg_spi,
         .write = write_reg_spi,
+#endif
         .delay_us = bma400_delay_us,
         .read_write_len = 8
 };
@@ -178,19 +221,51 @@ struct bma400_fifo_data fifo_frame;
 struct bma400_device_conf fifo_conf;
 struct bma400_sensor_conf conf;
 uint8_t fifo_buff[FIFO_SIZE] = { 0 };
-struct bma400_sensor_conf settings;
 struct bma400_fifo_sensor_data accel_data[FIFO_SAMPLES] = { { 0 } };
+// FIFO format of the power governor's profile in effect
+static uint8_t fifo_frame_bytes = FIFO_FRAME_BYTES;
 
 
 void bma_int_handler(const struct device *dev, struct gpio_callback *cb, uint32_t pins)
 {
-	// set the semaphore
-	//LOG_INF("INT fired! pins=0x%08x", pins);
-	printk("inside INT Handler\n");
-	k_sem_give(&bma400_ready);
-	printk("Post INT Handler\n");
+	timeline_mark(TL_BMA_IRQ, 0);
+	// below streaming it is the wake-up motion or the confirm window, no
+	// FIFO to time
+	if (atomic_get(&level) == CASCADE_STREAM) {
+		fifo_deadline_edge();
+		timesync_edge();
+	}
+	timeline_mark(TL_SEM_GIVE, 0);
+	k_work_submit_to_queue(sensor_seq_queue(), &drain_work);
+}
+
+#if !defined(CONFIG_APP_SENSOR_SPI)
+// emulated/replayed sensor: interrupt comes as a plain call
+static void bma_soft_irq(void)
+{
+	timeline_mark(TL_BMA_IRQ, 0);
+	if (atomic_get(&level) == CASCADE_STREAM) {
+		fifo_deadline_edge();
+		timesync_edge();
+	}
+	timeline_mark(TL_SEM_GIVE, 0);
+	k_work_submit_to_queue(sensor_seq_queue(), &drain_work);
+}
 
+// no SPI peripheral to wake up
+static void bus_resume(void) {}
+static void bus_suspend(void) {}
+#else
+static void bus_resume(void)
+{
+	pm_device_action_run(DEVICE_DT_GET(BMA400_BUS), PM_DEVICE_ACTION_RESUME);
+}
+
+static void bus_suspend(void)
+{
+	pm_device_action_run(DEVICE_DT_GET(BMA400_BUS), PM_DEVICE_ACTION_SUSPEND);
 }
+#endif
 
 
 // for reading every sample
@@ -218,56 +293,252 @@ void bma_int_handler(const struct device *dev, struct gpio_callback *cb, uint32_
 // 	}
 // }
 
-// for reading every 25 samples from a buffer
-void thread_read_bma400(void)
-{
-        static int count = 0;
-        while(1){
-                LOG_INF("In the read thread\n");
- 				bt_addr_le_t addr;
- 				size_t count = 1;
-	 			bt_id_get(&addr, &count);
-				printk("MAC Address: %02X:%02X:%02X:%02X:%02X:%02X\n",
-        		addr.a.val[5], addr.a.val[4], addr.a.val[3],
-		        addr.a.val[2], addr.a.val[1], addr.a.val[0]);
-                k_sem_take(&bma400_ready, K_FOREVER); // Sleep here if semaphore is at 0
-				printk("made it past lock\n");
-                // Enable SPI
-                const struct device *cons = DEVICE_DT_GET(DT_NODELABEL(spi1));
-                pm_device_action_run(cons, PM_DEVICE_ACTION_RESUME);
-				printk("made it enabling SPI\n");
-                // read data from bma400 fifo
-                bma400_get_fifo_data(&fifo_frame, &bma_sensor);
-                uint16_t accel_frames_req = FIFO_SAMPLES;
-                bma400_extract_accel(&fifo_frame, accel_data, &accel_frames_req, &bma_sensor);
-				printk("read data from bma400 fifo\n");
-                // after reading, disable the interrupt and put the bma400 to sleep
-               	//int_en.type = BMA400_FIFO_WM_INT_EN;
-                //int_en.conf = BMA400_DISABLE;
-                //int8_t rslt = bma400_enable_interrupt(&int_en, 1, &bma_sensor);
-                //bma400_set_power_mode(BMA400_MODE_SLEEP,&bma_sensor);
-
-                // Disable SPI
-                pm_device_action_run(cons, PM_DEVICE_ACTION_SUSPEND);
-
-                // Read the data and convert to m/s^2
-                for(int i = 0; i < 25; i++)
-                {
-                        // first convert to m/s^2, we configured to +/- 2G, so 1G = 1024
-            //             float x_f = (float)(accel_data[i].x)*9.8/1024.0f; 
-            // float y_f = (float)(accel_data[i].y)*9.8/1024.0f; 
-            // float z_f = (float)(accel_data[i].z)*9.8/1024.0f; 
-
-                        // can print here or write to a buffer
- 			// //send_accel_notification(x_f,y_f,z_f);
-			// int whole = (int)x_f;
-			// int fract = (int)((x_f - whole) * 100);
-			// LOG_INF("x=%d.%02d",whole,fract); //print data to console
-            //     }
-			LOG_INF("x=%d\n",accel_data[i].x);
-				}
-        }
+// counters for the diagnostics stream
+static uint32_t drain_count;
+static uint32_t sample_count;
+
+// samples of the oldest ring block already sent, a block cut short by the
+// rate limit or a full TX queue goes on from there on the next batch
+static uint16_t raw_seq;
+static uint8_t raw_offset;
+
+// Hands one decoded FIFO batch to every stream that has a subscriber.
+// Nothing is packed or computed for streams nobody listens to. int_status
+// only comes with the first block of a drain, active (GEN1 asserted) with
+// every block of it.
+static void process_batch(const struct bma400_fifo_sensor_data *samples, uint16_t count,
+			  uint16_t int_status, bool status_read, bool active, uint32_t t)
+{
+	sample_count += count;
+
+	// Raw data always goes through the retained ring, so blocks left over
+	// from before a reset (and anything recorded while nobody listened) are
+	// sent ahead of the new batch.
+	uint16_t seq = retained_ring_push(samples, count);
+	while (accel_svc_subscribed(ACCEL_STREAM_RAW)) {
+		const struct retained_block *blk = retained_ring_peek();
+
+		if (!blk) {
+			break;
+		}
+		if (blk->seq != raw_seq) {
+			// a new block, or the one in progress was overwritten
+			raw_seq = blk->seq;
+			raw_offset = 0;
+		}
+		if (accel_svc_send_raw(blk->seq, blk->s, blk->count, &raw_offset)) {
+			break;
+		}
+		retained_ring_pop();
+	}
+	t = stage_prof_mark(STAGE_RING, t);
+
+	timesync_process(seq, samples, count);
+	t = stage_prof_mark(STAGE_SYNC, t);
+
+	// epochs are recorded all the time and collected in bulk
+	actigraphy_process(samples, count);
+	actigraphy_flush();
+	t = stage_prof_mark(STAGE_ACTIG, t);
+
+	// history is kept all the time too, queries are answered from the work queue
+	rollup_process(samples, count);
+	t = stage_prof_mark(STAGE_ROLLUP, t);
+
+	gravity_process(samples, count);
+	t = stage_prof_mark(STAGE_GRAVITY, t);
+	wake_tune_process(samples, count, int_status, status_read);
+	t = stage_prof_mark(STAGE_WAKE, t);
+	wear_state_process(samples, count);
+	cascade_process(samples, count);
+	t = stage_prof_mark(STAGE_WEAR, t);
+	sketch_process(samples, count);
+	t = stage_prof_mark(STAGE_SKETCH, t);
+	reduce_process(samples, count);
+	t = stage_prof_mark(STAGE_REDUCE, t);
+
+	if (accel_svc_subscribed(ACCEL_STREAM_FEATURES)) {
+		struct accel_features_pkt feat;
+
+		features_compute(samples, count, &feat);
+		accel_svc_send(ACCEL_STREAM_FEATURES, &feat, sizeof(feat));
+		t = stage_prof_mark(STAGE_FEATURES, t);
+	}
+
+	if (accel_svc_subscribed(ACCEL_STREAM_EVENTS)) {
+		if (int_status & BMA400_ASSERTED_GEN1_INT) {
+			accel_svc_send_event(ACCEL_EVT_ACTIVITY, 0);
+		}
+		if (int_status & BMA400_ASSERTED_S_TAP_INT) {
+			accel_svc_send_event(ACCEL_EVT_SINGLE_TAP, 0);
+		}
+		if (int_status & BMA400_ASSERTED_D_TAP_INT) {
+			accel_svc_send_event(ACCEL_EVT_DOUBLE_TAP, 0);
+		}
+		if (int_status & BMA400_ASSERTED_ORIENT_CH) {
+			accel_svc_send_event(ACCEL_EVT_ORIENT, 0);
+		}
+		if (int_status & BMA400_ASSERTED_FIFO_FULL_INT) {
+			accel_svc_send_event(ACCEL_EVT_FIFO_OVERFLOW, count);
+		}
+
+		// gestures only go out as ids on this stream, so only look for them here
+		uint8_t gesture = gesture_process(samples, count, active);
+		if (gesture) {
+			accel_svc_send_event(ACCEL_EVT_GESTURE, gesture);
+		}
+		t = stage_prof_mark(STAGE_EVENTS, t);
+	}
+
+	if (accel_svc_subscribed(ACCEL_STREAM_DIAG)) {
+		struct accel_diag_pkt diag = {
+			.uptime_ms = sys_cpu_to_le32(k_uptime_get_32()),
+			.drains = sys_cpu_to_le32(drain_count),
+			.samples = sys_cpu_to_le32(sample_count),
+		};
+		uint16_t sent[ACCEL_STREAM_COUNT], dropped[ACCEL_STREAM_COUNT];
+		struct fifo_deadline_stats dl;
+		struct adv_sched_stats adv;
+		struct cascade_stats cs;
+		struct gesture_stats gs;
+
+		fifo_deadline_get_stats(&dl);
+		diag.min_slack_ms = sys_cpu_to_le16(dl.drains ?
+			CLAMP(dl.min_slack_us / 1000, INT16_MIN, INT16_MAX) : INT16_MAX);
+		diag.deadline_missed = sys_cpu_to_le16(MIN(dl.missed, UINT16_MAX));
+		adv_sched_get_stats(&adv);
+		diag.adv_ms = sys_cpu_to_le32(adv.ms[ADV_PHASE_FAST] + adv.ms[ADV_PHASE_SLOW]);
+		diag.adv_uc = sys_cpu_to_le32(adv.charge_uc);
+		cascade_get_stats(&cs);
+		for (int l = 0; l < ARRAY_SIZE(cs.ms); l++) {
+			diag.cascade_ms[l] = sys_cpu_to_le32(cs.ms[l]);
+		}
+		gesture_get_stats(&gs);
+		diag.gesture_runs = sys_cpu_to_le16(MIN(gs.matches, UINT16_MAX));
+		diag.gesture_abandoned = sys_cpu_to_le16(MIN(gs.abandoned, UINT16_MAX));
+		diag.gesture_detected = sys_cpu_to_le16(MIN(gs.detected, UINT16_MAX));
+		diag.gesture_cycles = sys_cpu_to_le32(gs.avg_cycles);
+		accel_svc_get_counts(sent, dropped);
+		for (int s = 0; s < ACCEL_STREAM_COUNT; s++) {
+			diag.sent[s] = sys_cpu_to_le16(sent[s]);
+			diag.dropped[s] = sys_cpu_to_le16(dropped[s]);
+		}
+		accel_svc_send(ACCEL_STREAM_DIAG, &diag, sizeof(diag));
+		stage_prof_mark(STAGE_DIAG, t);
+	}
 }
+
+// Drains the FIFO, on the sensor work queue (sensor_seq.h) so it interleaves
+// with any reconfiguration sequence in progress. Submitted from the
+// interrupt; a submit while it is queued is dropped like a second sem give.
+static void drain_bma400(struct k_work *work)
+{
+	timeline_mark(TL_SEM_TAKE, 0);
+	bus_resume();
+	if (atomic_get(&level) == CASCADE_TRIGGER) {
+		// GEN1 is all that is on the pin now, but the status says for sure
+		uint16_t wake_status = 0;
+		SPI_TRACED(bma400_get_interrupt_status, &wake_status, &bma_sensor);
+		bus_suspend();
+		if (wake_status & BMA400_ASSERTED_GEN1_INT) {
+			start_confirm();
+		}
+		return;
+	}
+	if (atomic_get(&level) == CASCADE_CONFIRM) {
+		drain_confirm();
+		return;
+	}
+	uint32_t t = cyccnt_get();
+	uint32_t t_drain = t;
+	// events need the status before the drain, only read it if someone
+	// listens; unconnected, motion and taps open advertising windows
+	uint16_t int_status = 0;
+	bool status_read = accel_svc_subscribed(ACCEL_STREAM_EVENTS) ||
+			   accel_svc_subscribed(ACCEL_STREAM_TRACE) ||
+			   adv_sched_listening();
+	if (status_read) {
+		SPI_TRACED(bma400_get_interrupt_status, &int_status, &bma_sensor);
+		if (int_status & BMA400_ASSERTED_GEN1_INT) {
+			adv_sched_trigger(ADV_TRIG_MOTION);
+		}
+		if (int_status & (BMA400_ASSERTED_S_TAP_INT | BMA400_ASSERTED_D_TAP_INT)) {
+			adv_sched_trigger(ADV_TRIG_TAP);
+		}
+	}
+	// read data from bma400 fifo
+	// (get_fifo_data trims length to what was read, so reset it every time)
+	fifo_frame.length = FIFO_SIZE;
+	timeline_begin(TL_FIFO_READ, 0);
+	SPI_TRACED(bma400_get_fifo_data, &fifo_frame, &bma_sensor);
+	uint16_t fifo_bytes = fifo_frame.length - MIN(fifo_frame.length, bma_sensor.dummy_byte);
+	timeline_end(TL_FIFO_READ, fifo_bytes);
+	fifo_deadline_drained(fifo_bytes);
+	drain_count++;
+	timesync_drained(fifo_bytes / fifo_frame_bytes);
+	fifo_trace_capture(&bma_sensor, int_status, fifo_frame.data, fifo_frame.length);
+	// thresholds from the last tune, while the bus is up anyway
+	struct wake_tune_cfg tuned;
+	if (wake_tune_take(&tuned)) {
+		program_wake(&tuned);
+	}
+	if (wear_state_temp_due()) {
+		int16_t temp_dc;
+		if (SPI_TRACED(bma400_get_temperature_data, &temp_dc, &bma_sensor) == BMA400_OK) {
+			wear_state_temp(temp_dc);
+		}
+	}
+	LOG_DBG("drained %u B at level %d", fifo_bytes, (int)atomic_get(&level));
+	// after reading, disable the interrupt and put the bma400 to sleep
+	//int_en.type = BMA400_FIFO_WM_INT_EN;
+	//int_en.conf = BMA400_DISABLE;
+	//int8_t rslt = bma400_enable_interrupt(&int_en, 1, &bma_sensor);
+	//bma400_set_power_mode(BMA400_MODE_SLEEP,&bma_sensor);
+
+	// Disable SPI
+	bus_suspend();
+
+	// this batch is still processed, the next edge is a wake-up
+	bool off = wear_state_take_off();
+
+	if (off || cascade_take_idle()) {
+		enter_trigger(off);
+	} else {
+		// from the power governor, switched between this drain and the next
+		const struct power_gov_profile *prof = power_gov_pending();
+
+		if (prof) {
+			apply_profile(prof);
+		}
+	}
+
+	// A drain holds more than the FIFO_SAMPLES that fit in accel_data once
+	// the watermark is raised; the decoder picks up where it stopped, so it
+	// goes through the stages a block at a time. The one-shot status bits
+	// go with the first block, the GEN1 activity state with all of them so
+	// a gesture window stays open across the drain.
+	uint16_t accel_frames_req = FIFO_SAMPLES;
+
+	for (uint16_t frames = 0; accel_frames_req == FIFO_SAMPLES; frames += accel_frames_req) {
+		accel_frames_req = FIFO_SAMPLES;
+		timeline_begin(TL_DECODE, 0);
+		bma400_extract_accel(&fifo_frame, accel_data, &accel_frames_req, &bma_sensor);
+		timeline_end(TL_DECODE, accel_frames_req);
+		// nothing (left) to decode: no empty block goes to the stages
+		if (!accel_frames_req) {
+			break;
+		}
+
+		t = stage_prof_mark(STAGE_DRAIN, t);
+		timeline_begin(TL_PROCESS, accel_frames_req);
+		process_batch(accel_data, accel_frames_req, frames ? 0 : int_status,
+			      !frames && status_read, int_status & BMA400_ASSERTED_GEN1_INT, t);
+		timeline_end(TL_PROCESS, accel_frames_req);
+		t = cyccnt_get();
+	}
+	power_gov_drain(fifo_bytes, cyccnt_to_us(cyccnt_get() - t_drain));
+}
+
 // for testing if SPI works
 	
 // void thread_read_bma400(void)
@@ -297,8 +568,7 @@ void thread_read_bma400(void)
 
 
 
-// Need to make sure stack is big enough to run NN code
-K_THREAD_DEFINE(thread_read_bma400_id, STACKSIZE*4, thread_read_bma400, NULL, NULL, NULL, THREAD_READ_BMA_PRIORITY, 0, 0);
+#if defined(CONFIG_APP_SENSOR_SPI)
 BMA400_INTF_RET_TYPE read_reg_spi(uint8_t reg_address, uint8_t* data, uint32_t len, void* intf_ptr)
 {
 	int err;
@@ -312,26 +582,27 @@ BMA400_INTF_RET_TYPE read_reg_spi(uint8_t reg_address, uint8_t* data, uint32_t l
 	// therefore, if we want to read 1 byte from the sensor, we need to read 3 bytes from the sensor (1 during send, 2 during read)
 	// Since the BMA400 API already adds the dummy byte, we only need to add one more byte
 	// This extra byte is because the first read happens during the register write, so we need to read again	
+	// It is skipped (NULL buffer) and the rest goes straight into data, so a
+	// FIFO read of any length is one DMA transfer without a bounce buffer.
 
 	uint8_t tx_buffer = reg_address;
 	struct spi_buf tx_spi_buf		= {.buf = (void *)&tx_buffer, .len = 1};
 	struct spi_buf_set tx_spi_buf_set 	= {.buffers = &tx_spi_buf, .count = 1};
-	struct spi_buf rx_spi_bufs 		= {.buf = rx_buffer, .len = len+1};
-	struct spi_buf_set rx_spi_buf_set	= {.buffers = &rx_spi_bufs, .count = 1};
+	struct spi_buf rx_spi_bufs[2]		= {{.buf = NULL, .len = 1}, {.buf = data, .len = len}};
+	struct spi_buf_set rx_spi_buf_set	= {.buffers = rx_spi_bufs, .count = 2};
 	
 
 	/* STEP 4.2 - Call the transceive function */
+	timeline_begin(TL_SPI, reg_address);
+	uint32_t t0 = spi_trace_begin();
 	err = spi_transceive_dt(&spispec, &tx_spi_buf_set, &rx_spi_buf_set);
+	spi_trace_end(t0, reg_address, len);
+	timeline_end(TL_SPI, reg_address);
 	if (err < 0) {
 		LOG_ERR("spi_transceive_dt() failed, err: %d, 0x%02X", err,tx_buffer);
 		// return err;
 	}
 
-	for(int i = 0; i < len; i++)
-	{
-		data[i] = rx_buffer[i+1]; // data[0] = dummy byte, data[1] = data
-	}
-
 	return 0;
 }
 
@@ -351,7 +622,11 @@ BMA400_INTF_RET_TYPE write_reg_spi(uint8_t reg_address, const uint8_t* data, uin
 	struct spi_buf_set tx_spi_buf_set	= {.buffers = &tx_spi_buf, .count = 1};
 
 	/* STEP 5.2 - call the spi_write_dt function with SPISPEC to write buffers */
+	timeline_begin(TL_SPI, reg_address);
+	uint32_t t0 = spi_trace_begin();
 	err = spi_write_dt(&spispec, &tx_spi_buf_set);
+	spi_trace_end(t0, reg_address, len);
+	timeline_end(TL_SPI, reg_address);
 	if (err < 0) {
 		LOG_ERR("spi_write_dt() failed, err %d", err);
 		return err;
@@ -359,21 +634,22 @@ BMA400_INTF_RET_TYPE write_reg_spi(uint8_t reg_address, const uint8_t* data, uin
 
 	return 0;
 }
+#endif
 
 void init_fifo_watermark()
 {
 	conf.type = BMA400_ACCEL;
-	int8_t rslt = bma400_get_sensor_conf(&conf, 1, &bma_sensor);
+	int8_t rslt = SPI_TRACED(bma400_get_sensor_conf, &conf, 1, &bma_sensor);
 
-	conf.param.accel.odr = BMA400_ODR_25HZ;
-	conf.param.accel.range = BMA400_RANGE_4G;
+	conf.param.accel.odr = SENSOR_ODR;
+	conf.param.accel.range = SENSOR_RANGE;
 	conf.param.accel.data_src = BMA400_DATA_SRC_ACCEL_FILT_1;
 
-	rslt = bma400_set_sensor_conf(&conf, 1, &bma_sensor);
+	rslt = SPI_TRACED(bma400_set_sensor_conf, &conf, 1, &bma_sensor);
 
 	fifo_conf.type = BMA400_FIFO_CONF;
 
-	rslt = bma400_get_device_conf(&fifo_conf, 1, &bma_sensor);
+	rslt = SPI_TRACED(bma400_get_device_conf, &fifo_conf, 1, &bma_sensor);
 
 	fifo_conf.param.fifo_conf.conf_regs = BMA400_FIFO_8_BIT_EN | BMA400_FIFO_X_EN 
 										| BMA400_FIFO_Y_EN 
@@ -383,7 +659,7 @@ void init_fifo_watermark()
 	fifo_conf.param.fifo_conf.fifo_watermark = FIFO_WATERMARK_LEVEL;
 	fifo_conf.param.fifo_conf.fifo_wm_channel = BMA400_INT_CHANNEL_1;
 
-	rslt = bma400_set_device_conf(&fifo_conf, 1, &bma_sensor);
+	rslt = SPI_TRACED(bma400_set_device_conf, &fifo_conf, 1, &bma_sensor);
 
 	fifo_frame.data = fifo_buff;
 	fifo_frame.length = FIFO_SIZE;
@@ -391,38 +667,371 @@ void init_fifo_watermark()
 	int_en.type = BMA400_FIFO_WM_INT_EN;
 	int_en.conf = BMA400_ENABLE;
 
-	bma400_set_power_mode(BMA400_MODE_NORMAL,&bma_sensor);
-	rslt = bma400_enable_interrupt(&int_en, 1, &bma_sensor);
+	SPI_TRACED(bma400_set_power_mode, BMA400_MODE_NORMAL,&bma_sensor);
+	rslt = SPI_TRACED(bma400_enable_interrupt, &int_en, 1, &bma_sensor);
 }
 
-void init_activity()
+static enum bma400_int_chan wake_int_chan;
+static struct wake_tune_cfg wake_cfg;
+
+// GEN1 = activity, GEN2 = inactivity, both against the 1 Hz low-pass
+// reference (the deviation wake_tune.c measures)
+static void program_wake(const struct wake_tune_cfg *cfg)
 {
-	settings.type = BMA400_GEN1_INT;
-	bma400_get_sensor_conf(&settings, 1, &bma_sensor);
+	wake_cfg = *cfg;
+	struct bma400_sensor_conf gen[2] = {
+		{ .type = BMA400_GEN1_INT },
+		{ .type = BMA400_GEN2_INT },
+	};
+
+	SPI_TRACED(bma400_get_sensor_conf, gen, 2, &bma_sensor);
+	for (int i = 0; i < 2; i++) {
+		struct bma400_gen_int_conf *g = &gen[i].param.gen_int;
+
+		g->axes_sel = BMA400_AXIS_XYZ_EN;
+		g->data_src = BMA400_DATA_SRC_ACC_FILT1;
+		g->ref_update = BMA400_UPDATE_LP_EVERY_TIME;
+	}
+	// only activity may ever wake the host, GEN2 is read from the status
+	gen[0].param.gen_int.int_chan = wake_int_chan;
+	gen[1].param.gen_int.int_chan = BMA400_UNMAP_INT_PIN;
+	gen[0].param.gen_int.criterion_sel = BMA400_ACTIVITY_INT;
+	gen[0].param.gen_int.evaluate_axes = BMA400_ANY_AXES_INT;
+	gen[0].param.gen_int.hysteresis = cfg->act_hyst;
+	gen[0].param.gen_int.gen_int_thres = cfg->act_thres;
+	gen[0].param.gen_int.gen_int_dur = cfg->act_dur;
+	gen[1].param.gen_int.criterion_sel = BMA400_INACTIVITY_INT;
+	gen[1].param.gen_int.evaluate_axes = BMA400_ALL_AXES_INT;
+	gen[1].param.gen_int.hysteresis = BMA400_HYST_0_MG;
+	gen[1].param.gen_int.gen_int_thres = cfg->inact_thres;
+	gen[1].param.gen_int.gen_int_dur = cfg->inact_dur;
+
+	SPI_TRACED(bma400_set_sensor_conf, gen, 2, &bma_sensor);
+}
 
-	settings.param.gen_int.int_chan = BMA400_INT_CHANNEL_1;
-    settings.param.gen_int.axes_sel = BMA400_AXIS_XYZ_EN;
-    settings.param.gen_int.data_src = BMA400_DATA_SRC_ACC_FILT1;
-	settings.param.gen_int.criterion_sel = BMA400_ACTIVITY_INT;
-	settings.param.gen_int.evaluate_axes = BMA400_ANY_AXES_INT;
-    settings.param.gen_int.ref_update = BMA400_UPDATE_EVERY_TIME;
-	settings.param.gen_int.hysteresis = BMA400_HYST_48_MG;
-	settings.param.gen_int.gen_int_thres = 0x10;
-	settings.param.gen_int.gen_int_dur = 15;
+void init_activity(enum bma400_int_chan int_chan)
+{
+	struct wake_tune_cfg cfg;
+	struct bma400_sensor_conf tap = { .type = BMA400_TAP_INT };
+	struct bma400_int_enable gen_en[3] = {
+		{ .type = BMA400_GEN1_INT_EN, .conf = BMA400_ENABLE },
+		{ .type = BMA400_GEN2_INT_EN, .conf = BMA400_ENABLE },
+		{ .type = BMA400_SINGLE_TAP_INT_EN, .conf = BMA400_ENABLE },
+	};
+
+	// fixed thresholds until wake_tune has seen enough background
+	wake_int_chan = int_chan;
+	wake_tune_defaults(&cfg);
+	program_wake(&cfg);
+
+	// taps on the face, status only: they open advertising windows (adv_sched.h)
+	SPI_TRACED(bma400_get_sensor_conf, &tap, 1, &bma_sensor);
+	tap.param.tap.axes_sel = BMA400_TAP_Z_AXIS_EN;
+	tap.param.tap.int_chan = BMA400_UNMAP_INT_PIN;
+	SPI_TRACED(bma400_set_sensor_conf, &tap, 1, &bma_sensor);
+
+	SPI_TRACED(bma400_set_power_mode, BMA400_MODE_NORMAL,&bma_sensor);
+	SPI_TRACED(bma400_enable_interrupt, gen_en, ARRAY_SIZE(gen_en), &bma_sensor);
+}
 
-	bma400_set_sensor_conf(&settings, 1, &bma_sensor);
+// Bring-up on the sensor queue like every later access: the watermark
+// interrupt is live before the activity setup is done, and its drain has to
+// queue behind it rather than share the bus with another thread.
+static void sensor_bringup(struct k_work *work)
+{
+	bus_resume();
+	SPI_TRACED(bma400_init, &bma_sensor);
+	// init_activity(BMA400_INT_CHANNEL_1);
+	init_fifo_watermark();	// interupts for fifo buffers
+	// GEN1 without a pin: only its status bit is used to cut out gesture windows
+	init_activity(BMA400_UNMAP_INT_PIN);
+	bus_suspend();
+}
 
-	int_en.type = BMA400_GEN1_INT_EN;
-	int_en.conf = BMA400_ENABLE;
+static K_WORK_DEFINE(bringup_work, sensor_bringup);
+
+// slow link while nothing is streamed, the central may refuse; worn, the
+// power governor's profile has the say
+#define OFF_BODY_CONN_PARAM  BT_LE_CONN_PARAM(320, 400, 4, 1000)   // 400-500 ms, 4 skipped
+
+static void set_conn_param(const struct bt_le_conn_param *param)
+{
+	if (current_conn) {
+		int err = bt_conn_le_param_update(current_conn, param);
+
+		if (err) {
+			LOG_WRN("conn param update failed (err %d)", err);
+		}
+	}
+}
+
+static void request_conn_param(void)
+{
+	const struct power_gov_profile *p = power_gov_active();
+
+	if (atomic_get(&level) != CASCADE_STREAM) {
+		set_conn_param(OFF_BODY_CONN_PARAM);
+	} else {
+		set_conn_param(BT_LE_CONN_PARAM(p->conn_min, p->conn_max, p->conn_latency,
+						p->conn_timeout));
+	}
+}
+
+// Power governor profiles: oversampling, FIFO format and watermark in one
+// sequence, right after a drain so the old format is out of the FIFO. The
+// FIFO service budget and the sample clock follow once it is through.
+static const struct power_gov_profile *profile_next;
+static struct sensor_seq_step profile_seq[4];
+
+static void profile_done(int8_t rslt)
+{
+	const struct power_gov_profile *p = profile_next;
+	uint16_t wm = p->wm_frames * p->frame_bytes;
+
+	if (rslt != BMA400_OK) {
+		// tried again after the next drain
+		LOG_ERR("profile %s failed (%d)", p->name, rslt);
+		return;
+	}
+	fifo_frame_bytes = p->frame_bytes;
+	fifo_deadline_config(SENSOR_ODR_HZ, p->frame_bytes, wm, FIFO_FULL_SIZE / p->frame_bytes,
+			     k_work_queue_thread_get(sensor_seq_queue()));
+	timesync_set_odr(SENSOR_ODR_HZ, p->wm_frames);
+	power_gov_applied(p);
+	request_conn_param();
+}
+
+static void apply_profile(const struct power_gov_profile *p)
+{
+	uint16_t wm = p->wm_frames * p->frame_bytes;
+
+	profile_seq[0] = (struct sensor_seq_step)SEQ_FIELDS(BMA400_FV(BMA400_F_OSR, p->osr));
+	profile_seq[1] = (struct sensor_seq_step)SEQ_FIELDS(
+				BMA400_FV(BMA400_F_FIFO_8_BIT, p->frame_bytes == FIFO_FRAME_BYTES));
+	profile_seq[2] = (struct sensor_seq_step)SEQ_FIELDS(BMA400_FV(BMA400_F_FIFO_WM_LO, wm & 0xFF));
+	profile_seq[3] = (struct sensor_seq_step)SEQ_FIELDS(BMA400_FV(BMA400_F_FIFO_WM_HI, wm >> 8));
+	profile_next = p;
+	// busy: still pending, the next drain tries again
+	sensor_seq_start(profile_seq, ARRAY_SIZE(profile_seq), profile_done);
+}
+
+// Sensing cascade (cascade.h). The trigger level is the lowest-power
+// profile: no FIFO interrupt, sensor in low power mode (25 Hz, minimal
+// oversampling) with the tuned GEN1 as the only thing on the pin. A GEN1
+// wake-up keeps the sensor there and has the FIFO collect one confirm
+// window; only a window that holds up goes back to normal mode streaming.
+// The FIFO flushes itself on the way back to normal mode. Every switch is a
+// sequence on the sensor queue, the power mode waits don't hold up drains.
+static bool wake_pending;    // GEN1 while still switching down to the trigger
+static bool off_body;        // demoted by wear_state.h rather than for being idle
+
+BUILD_ASSERT(CASCADE_WINDOW * FIFO_FRAME_BYTES_12BIT <= FIFO_FULL_SIZE,
+	     "confirm window does not fit in the FIFO");
+BUILD_ASSERT(CONFIG_APP_CASCADE_CONFIRM_TIMEOUT_S > CONFIG_APP_CASCADE_CONFIRM_S,
+	     "confirm timeout shorter than the window");
+
+static void confirm_timeout_fn(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(confirm_timeout, confirm_timeout_fn);
+
+static void set_level(enum cascade_level l)
+{
+	atomic_set(&level, l);
+	cascade_set_level(l);
+	timesync_pause(l != CASCADE_STREAM);
+	if (accel_svc_subscribed(ACCEL_STREAM_EVENTS)) {
+		accel_svc_send_event(ACCEL_EVT_LEVEL, l);
+	}
+}
+
+// the watermark enable is one bit: one read-modify-write of INT_CONFIG0
+// rather than both INT_CONFIG registers through bma400_enable_interrupt()
+static int8_t off_body_int(void)
+{
+	wake_int_chan = BMA400_INT_CHANNEL_1;
+	program_wake(&wake_cfg);
+	return BMA400_FIELDS_SET(&bma_sensor, BMA400_FV(BMA400_F_EN_FIFO_WM, 0));
+}
+
+// GEN1 off the pin, the confirm window is what comes next
+static int8_t confirm_int(void)
+{
+	wake_int_chan = BMA400_UNMAP_INT_PIN;
+	program_wake(&wake_cfg);
+	return BMA400_OK;
+}
+
+static int8_t worn_int(void)
+{
+	wake_int_chan = BMA400_UNMAP_INT_PIN;
+	program_wake(&wake_cfg);
+	return BMA400_FIELDS_SET(&bma_sensor, BMA400_FV(BMA400_F_EN_FIFO_WM, 1));
+}
+
+static const struct sensor_seq_step off_body_seq[] = {
+	SEQ_CALL(off_body_int),
+	SEQ_POWER_MODE(BMA400_MODE_LOW_POWER),
+};
+
+// confirm window back down to the trigger, still in low power mode
+static const struct sensor_seq_step back_seq[] = {
+	SEQ_CALL(off_body_int),
+};
+
+// watermarks of the window or of the profile in effect
+static struct sensor_seq_step confirm_seq[5];
+static struct sensor_seq_step worn_seq[5];
+
+static void off_body_done(int8_t rslt)
+{
+	if (rslt != BMA400_OK) {
+		LOG_ERR("low-power profile failed (%d)", rslt);
+	}
+	set_level(CASCADE_TRIGGER);
+	if (wake_pending) {
+		start_confirm();
+	}
+}
+
+static void confirm_done(int8_t rslt)
+{
+	if (rslt != BMA400_OK) {
+		// the timeout takes it back to the trigger
+		LOG_ERR("confirm window failed (%d)", rslt);
+	}
+	wake_pending = false;
+	set_level(CASCADE_CONFIRM);
+	k_work_reschedule_for_queue(sensor_seq_queue(), &confirm_timeout,
+				    K_SECONDS(CONFIG_APP_CASCADE_CONFIRM_TIMEOUT_S));
+}
 
-	bma400_set_power_mode(BMA400_MODE_NORMAL,&bma_sensor);
-	bma400_enable_interrupt(&int_en, 1, &bma_sensor);
+static void worn_done(int8_t rslt)
+{
+	if (rslt != BMA400_OK) {
+		LOG_ERR("back to the worn profile failed (%d)", rslt);
+	}
+	wake_pending = false;
+	set_level(CASCADE_STREAM);
+	power_gov_low_power(false);
+
+	wear_state_resume();
+	request_conn_param();
+	adv_sched_trigger(ADV_TRIG_MOTION);
+	if (off_body && accel_svc_subscribed(ACCEL_STREAM_EVENTS)) {
+		accel_svc_send_event(ACCEL_EVT_WEAR, 1);
+	}
+	off_body = false;
+}
+
+static void enter_trigger(bool off)
+{
+	atomic_set(&level, CASCADE_TRIGGER);
+	if (sensor_seq_start(off_body_seq, ARRAY_SIZE(off_body_seq), off_body_done)) {
+		LOG_ERR("sensor busy, staying in the worn profile");
+		atomic_set(&level, CASCADE_STREAM);
+		// only a take-off stopped the detector, an idle drop left it running
+		if (off) {
+			wear_state_resume();
+		}
+		return;
+	}
+
+	off_body = off;
+	power_gov_low_power(true);
+	request_conn_param();
+	if (off && accel_svc_subscribed(ACCEL_STREAM_EVENTS)) {
+		accel_svc_send_event(ACCEL_EVT_WEAR, 0);
+	}
+}
+
+static void start_confirm(void)
+{
+	uint16_t wm = CASCADE_WINDOW * fifo_frame_bytes;
+
+	confirm_seq[0] = (struct sensor_seq_step)SEQ_CALL(confirm_int);
+	confirm_seq[1] = (struct sensor_seq_step)SEQ_FIELDS(BMA400_FV(BMA400_F_FIFO_WM_LO, wm & 0xFF));
+	confirm_seq[2] = (struct sensor_seq_step)SEQ_FIELDS(BMA400_FV(BMA400_F_FIFO_WM_HI, wm >> 8));
+	// whatever the FIFO kept from before the wake-up is not in the window
+	confirm_seq[3] = (struct sensor_seq_step)SEQ_WRITE(BMA400_REG_COMMAND, BMA400_FIFO_FLUSH_CMD);
+	confirm_seq[4] = (struct sensor_seq_step)SEQ_FIELDS(BMA400_FV(BMA400_F_EN_FIFO_WM, 1));
+	wake_pending = false;
+	if (sensor_seq_start(confirm_seq, ARRAY_SIZE(confirm_seq), confirm_done)) {
+		// still on the way down (or back)
+		wake_pending = true;
+	}
+}
+
+static void promote(void)
+{
+	const struct power_gov_profile *p = power_gov_active();
+	uint16_t wm = p->wm_frames * p->frame_bytes;
+
+	worn_seq[0] = (struct sensor_seq_step)SEQ_FIELDS(
+				BMA400_FV(BMA400_F_POWER_MODE, BMA400_MODE_NORMAL));
+	worn_seq[1] = (struct sensor_seq_step)SEQ_WAIT_US(10000);
+	worn_seq[2] = (struct sensor_seq_step)SEQ_FIELDS(BMA400_FV(BMA400_F_FIFO_WM_LO, wm & 0xFF));
+	worn_seq[3] = (struct sensor_seq_step)SEQ_FIELDS(BMA400_FV(BMA400_F_FIFO_WM_HI, wm >> 8));
+	worn_seq[4] = (struct sensor_seq_step)SEQ_CALL(worn_int);
+	if (sensor_seq_start(worn_seq, ARRAY_SIZE(worn_seq), worn_done)) {
+		// the next window decides again
+		return;
+	}
+	k_work_cancel_delayable(&confirm_timeout);
+}
+
+static void demote(void)
+{
+	if (sensor_seq_start(back_seq, ARRAY_SIZE(back_seq), off_body_done)) {
+		return;
+	}
+	k_work_cancel_delayable(&confirm_timeout);
+}
+
+static void confirm_timeout_fn(struct k_work *work)
+{
+	if (atomic_get(&level) != CASCADE_CONFIRM) {
+		return;
+	}
+	if (sensor_seq_busy()) {
+		k_work_reschedule_for_queue(sensor_seq_queue(), &confirm_timeout, K_SECONDS(1));
+		return;
+	}
+	LOG_WRN("no confirm window in %d s", CONFIG_APP_CASCADE_CONFIRM_TIMEOUT_S);
+	cascade_confirm_timeout();
+	demote();
+}
+
+// CASCADE_CONFIRM: the window, drained at its watermark, only goes to the
+// verdict; none of the stages see it. Bus already up.
+static void drain_confirm(void)
+{
+	uint32_t t_drain = cyccnt_get();
+	enum cascade_verdict v = CASCADE_PENDING;
+
+	fifo_frame.length = FIFO_SIZE;
+	SPI_TRACED(bma400_get_fifo_data, &fifo_frame, &bma_sensor);
+	bus_suspend();
+	uint16_t fifo_bytes = fifo_frame.length - MIN(fifo_frame.length, bma_sensor.dummy_byte);
+
+	// what comes in while switching belongs to no window
+	if (!sensor_seq_busy()) {
+		for (uint16_t n = FIFO_SAMPLES; n == FIFO_SAMPLES && v == CASCADE_PENDING;) {
+			bma400_extract_accel(&fifo_frame, accel_data, &n, &bma_sensor);
+			v = cascade_confirm(accel_data, n);
+		}
+	}
+	power_gov_drain(fifo_bytes, cyccnt_to_us(cyccnt_get() - t_drain));
+
+	if (v == CASCADE_PROMOTE) {
+		promote();
+	} else if (v == CASCADE_DEMOTE) {
+		demote();
+	}
 }
 
 void init_read_lp()
 {
 	conf.type = BMA400_ACCEL;
-	int8_t rslt = bma400_get_sensor_conf(&conf, 1, &bma_sensor);
+	int8_t rslt = SPI_TRACED(bma400_get_sensor_conf, &conf, 1, &bma_sensor);
 
 	conf.param.accel.odr = BMA400_ODR_25HZ;
 	conf.param.accel.range = BMA400_RANGE_4G;
@@ -430,19 +1039,20 @@ void init_read_lp()
 	conf.param.accel.osr_lp = BMA400_ACCEL_OSR_SETTING_0;
 	conf.param.accel.int_chan = BMA400_INT_CHANNEL_1;
 
-	rslt = bma400_set_sensor_conf(&conf, 1, &bma_sensor);
+	rslt = SPI_TRACED(bma400_set_sensor_conf, &conf, 1, &bma_sensor);
 
 	int_en.type = BMA400_DRDY_INT_EN;
 	int_en.conf = BMA400_ENABLE;
 
-	bma400_set_power_mode(BMA400_MODE_LOW_POWER,&bma_sensor);
-	bma400_enable_interrupt(&int_en, 1, &bma_sensor);
+	SPI_TRACED(bma400_set_power_mode, BMA400_MODE_LOW_POWER,&bma_sensor);
+	SPI_TRACED(bma400_enable_interrupt, &int_en, 1, &bma_sensor);
 }
 
 int main(void)
 {
 	int err;
 	
+#if defined(CONFIG_APP_SENSOR_SPI)
 	/* STEP 10.1 - Check if SPI and GPIO devices are ready */
 	err = spi_is_ready_dt(&spispec);
 	if (!err) {
@@ -460,13 +1070,26 @@ int main(void)
 		LOG_ERR("Error: GPIO device is not ready, err: %d", err);
 		return -1;
 	}
+	LOG_INF("SPI %u kHz %s, full FIFO drain ~%u us", SPI_HZ / 1000, SPI_DMA ? "DMA" : "CPU",
+		(uint32_t)SPI_DRAIN_US(2 + FIFO_SIZE));
+#endif
+	// the executor for drains and reconfigurations, before any interrupt
+	sensor_seq_init(&bma_sensor, bus_resume, bus_suspend);
+	power_gov_init();
+
 	err = bt_enable(bt_ready);
 	if(err){
+		// keep sampling into the retained ring without BLE (and on native_sim,
+		// which has no controller unless one is passed in)
 		printk("bt_enable failed (err %d)\n",err);
-		return -1;
 	} else{
 		printk("bt_enable() called, waiting for callback...\n");
 	}
+#if defined(CONFIG_APP_SENSOR_EMUL)
+	sensor_emul_start(bma_soft_irq);
+#elif defined(CONFIG_APP_TRACE_REPLAY)
+	trace_replay_start(bma_soft_irq);
+#else
 	/* STEP 3 - Configure the interrupt on the button's pin */
 	err = gpio_pin_interrupt_configure_dt(&int_pin, GPIO_INT_EDGE_RISING);
 	// err = gpio_pin_interrupt_configure_dt(&int_pin, GPIO_INT_LEVEL_ACTIVE);
@@ -476,13 +1099,22 @@ int main(void)
 	printk("Line After intHandler\n");
 	/* STEP 7 - Add the callback function by calling gpio_add_callback()   */
 	gpio_add_callback(int_pin.port, &int_cb_data);
+#endif
 
 
-	bma400_init(&bma_sensor);
-  
+	cyccnt_init();
+	retained_ring_init();
 
-	// init_activity();
-	init_fifo_watermark();	// interupts for fifo buffers
+	// the drain decodes a block at a time, the whole FIFO is usable
+	fifo_deadline_config(SENSOR_ODR_HZ, FIFO_FRAME_BYTES, FIFO_WATERMARK_LEVEL,
+			     FIFO_FULL_SIZE / FIFO_FRAME_BYTES,
+			     k_work_queue_thread_get(sensor_seq_queue()));
+	timesync_config(SENSOR_ODR_HZ, DIV_ROUND_UP(FIFO_WATERMARK_LEVEL, FIFO_FRAME_BYTES));
+
+	struct k_work_sync sync;
+
+	k_work_submit_to_queue(sensor_seq_queue(), &bringup_work);
+	k_work_flush(&bringup_work, &sync);
 //	init_read_lp();	// THIS IS INTERRUPTS EVERY TIME THERE IS DATA READY
 
 	//const struct device *cons = DEVICE_DT_GET(DT_NODELABEL(spi1));
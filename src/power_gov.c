@@ -0,0 +1,415 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/conn.h>
+#include "power_gov.h"
+#include "sensor_cfg.h"
+
+LOG_MODULE_REGISTER(power_gov, LOG_LEVEL_INF);
+
+// Richest first. "normal" is what the sensor is set up with at boot.
+// name, osr, FIFO frame, watermark frames, conn min/max/latency/timeout, lowest prio
+static const struct power_gov_profile profiles[] = {
+	{ "full",    3, FIFO_FRAME_BYTES_12BIT, 19,  24,  40, 0, 400,  ACCEL_PRIO_LOW },
+	{ "normal",  0, FIFO_FRAME_BYTES,       19,  24,  40, 0, 400,  ACCEL_PRIO_LOW },
+	{ "reduced", 0, FIFO_FRAME_BYTES,       50,  80, 100, 0, 400,  ACCEL_PRIO_NORMAL },
+	{ "eco",     0, FIFO_FRAME_BYTES,      100, 200, 240, 2, 2000, ACCEL_PRIO_NORMAL },
+	{ "minimal", 0, FIFO_FRAME_BYTES,      200, 320, 400, 4, 1000, ACCEL_PRIO_HIGH },
+};
+#define PROFILE_BOOT 1
+
+// Current model, typical figures at 3 V with the DC/DC on. Good enough to
+// rank the profiles; the scale takes up what it gets wrong on a given board.
+#define SLEEP_NA            3000   // system ON, RTC running, RAM retained
+#define CPU_UA              3700   // running from flash at 64 MHz
+#define DRAIN_WAKE_NC       30     // interrupt, HFCLK start, queue switch
+#define BUS_NC_PER_BYTE     2
+#define BMA_LP_NA           850    // low power mode, 25 Hz
+static const uint16_t bma_normal_na[] = { 3500, 5800, 9600, 14500 };  // by OSR
+#define CONN_EVENT_NC       2000   // empty connection event
+#define NOTIFY_NC           400    // per notification: headers, ack, turnaround
+#define NOTIFY_NC_PER_BYTE  45     // 1M PHY, 8 us at ~5.5 mA
+#define SCAN_NA             5400000 // radio in RX, scaled by the scan duty
+#define SYNC_EVENT_NC       2500   // one periodic advertising packet received
+
+enum link_state {
+	LINK_IDLE,
+	LINK_ADV,
+	LINK_CONN,
+	LINK_STATE_COUNT
+};
+
+static const struct power_gov_profile *active = &profiles[PROFILE_BOOT];
+static uint8_t want = PROFILE_BOOT;
+
+static atomic_t cfg_budget_na = ATOMIC_INIT(CONFIG_APP_POWER_GOV_BUDGET_UA * 1000);
+static uint32_t budget_na;
+static int64_t debt_nc;
+static uint32_t scale_q10 = 1024;
+static uint32_t last_raw_na;       // unscaled projection for the period now over
+static uint32_t last_projected_na;
+static uint32_t cpu_ns_per_sample;
+
+// from the drain (sensor queue)
+static atomic_t drains;
+static atomic_t drain_bytes;
+static atomic_t drain_cpu_us;
+
+// time split of the current period, from the sensor queue and the BT callbacks
+static struct k_spinlock lock;
+static struct {
+	uint32_t since_ms;
+	uint32_t lp_ms;
+	uint32_t link_ms[LINK_STATE_COUNT];
+	uint32_t adv_mev;       // advertising events, thousandths
+	uint32_t scan_pct_ms;   // scan time weighted by duty
+	uint32_t sync_mev;      // hub beacons received, thousandths
+	bool lp;
+	enum link_state link;
+	uint16_t adv_ms;        // interval while advertising
+	uint8_t scan_pct;
+	uint16_t sync_ms;
+	struct bt_conn *conn;
+} acc;
+// advertising interval and hub timeline at the end of the last period, for
+// the projection
+static uint16_t adv_ms;
+static uint8_t scan_pct;
+static uint16_t sync_ms;
+
+// per stream, notifications and bytes per 1000 s while it was emitted
+static struct {
+	uint16_t sent;
+	uint32_t bytes;
+	uint32_t pkt_per_ks;
+	uint32_t bytes_per_ks;
+} rate[ACCEL_STREAM_COUNT];
+
+static void gov_work_fn(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(gov_work, gov_work_fn);
+
+// with the lock held
+static void acc_update(uint32_t now)
+{
+	uint32_t dt = now - acc.since_ms;
+
+	if (acc.lp) {
+		acc.lp_ms += dt;
+	}
+	acc.link_ms[acc.link] += dt;
+	if (acc.link == LINK_ADV) {
+		acc.adv_mev += dt * 1000 / acc.adv_ms;
+	}
+	acc.scan_pct_ms += dt * acc.scan_pct;
+	if (acc.sync_ms) {
+		acc.sync_mev += dt * 1000 / acc.sync_ms;
+	}
+	acc.since_ms = now;
+}
+
+static uint32_t project_na(const struct power_gov_profile *p, enum link_state link)
+{
+	uint64_t na = SLEEP_NA + bma_normal_na[p->osr];
+
+	na += (uint64_t)SENSOR_ODR_HZ *
+	      (DRAIN_WAKE_NC + BUS_NC_PER_BYTE * p->wm_frames * p->frame_bytes) / p->wm_frames;
+	// per sample as measured, including the stages of streams a leaner
+	// profile would drop; the scale corrects for it over time
+	na += (uint64_t)SENSOR_ODR_HZ * cpu_ns_per_sample * CPU_UA / 1000000;
+	// the same for every profile, but it counts against the budget
+	na += (uint64_t)SCAN_NA * scan_pct / 100;
+	if (sync_ms) {
+		na += SYNC_EVENT_NC * 1000 / sync_ms;
+	}
+
+	if (link == LINK_ADV) {
+		na += POWER_GOV_ADV_EVENT_NC * 1000 / adv_ms;
+	} else if (link == LINK_CONN) {
+		uint64_t pkt_ks = 0, bytes_ks = 0;
+
+		for (int s = 0; s < ACCEL_STREAM_COUNT; s++) {
+			if (accel_svc_get_prio(s) <= p->lowest_prio) {
+				pkt_ks += rate[s].pkt_per_ks;
+				bytes_ks += rate[s].bytes_per_ks;
+			}
+		}
+		// latency only skips events while there is nothing to send
+		uint32_t iv_us = (p->conn_min + p->conn_max) * 1250 / 2;
+		uint32_t skip = pkt_ks ? 1 : 1 + p->conn_latency;
+
+		na += (uint64_t)CONN_EVENT_NC * USEC_PER_SEC / ((uint64_t)iv_us * skip);
+		na += (pkt_ks * NOTIFY_NC + bytes_ks * NOTIFY_NC_PER_BYTE) / 1000;
+	}
+	return MIN(na, UINT32_MAX);
+}
+
+static uint8_t pick(uint32_t target_na, enum link_state link)
+{
+	for (uint8_t i = 0; i < ARRAY_SIZE(profiles) - 1; i++) {
+		uint64_t na = ((uint64_t)project_na(&profiles[i], link) * scale_q10) >> 10;
+		// richer than the one wanted now only with room to spare, so it
+		// doesn't flap at the edge
+		uint64_t room = i < want ? (uint64_t)target_na * POWER_GOV_UP_PCT / 100 : target_na;
+
+		if (na <= room) {
+			return i;
+		}
+	}
+	return ARRAY_SIZE(profiles) - 1;
+}
+
+// charge of the period from the counters, nC
+static uint64_t account(uint32_t el_ms, uint32_t lp_ms, const uint32_t *link_ms,
+			uint32_t adv_mev, uint32_t scan_pct_ms, uint32_t sync_mev,
+			struct bt_conn *conn)
+{
+	uint32_t n = atomic_clear(&drains);
+	uint32_t bytes = atomic_clear(&drain_bytes);
+	uint32_t cpu_us = atomic_clear(&drain_cpu_us);
+	uint16_t sent[ACCEL_STREAM_COUNT], dropped[ACCEL_STREAM_COUNT];
+	uint32_t pkts = 0, pkt_bytes = 0;
+	uint64_t nc;
+
+	accel_svc_get_counts(sent, dropped);
+	for (int s = 0; s < ACCEL_STREAM_COUNT; s++) {
+		uint16_t dp = sent[s] - rate[s].sent;
+		uint32_t b = accel_svc_get_bytes(s);
+		uint32_t db = b - rate[s].bytes;
+
+		rate[s].sent = sent[s];
+		rate[s].bytes = b;
+		pkts += dp;
+		pkt_bytes += db;
+		if (accel_svc_subscribed(s)) {
+			rate[s].pkt_per_ks = (uint64_t)dp * 1000000 / el_ms;
+			rate[s].bytes_per_ks = (uint64_t)db * 1000000 / el_ms;
+		} else if (!accel_svc_requested(s)) {
+			rate[s].pkt_per_ks = 0;
+			rate[s].bytes_per_ks = 0;
+		}
+		// held back by the profile: keep the rate it had, for projecting
+		// the profiles that let it through again
+	}
+
+	uint32_t samples = bytes / active->frame_bytes;
+
+	if (samples) {
+		cpu_ns_per_sample = (uint64_t)cpu_us * 1000 / samples;
+	}
+
+	nc = (uint64_t)SLEEP_NA * el_ms / 1000;
+	nc += (uint64_t)bma_normal_na[active->osr] * (el_ms - lp_ms) / 1000;
+	nc += (uint64_t)BMA_LP_NA * lp_ms / 1000;
+	nc += (uint64_t)n * DRAIN_WAKE_NC + (uint64_t)bytes * BUS_NC_PER_BYTE;
+	nc += (uint64_t)cpu_us * CPU_UA / 1000;
+	nc += (uint64_t)POWER_GOV_ADV_EVENT_NC * adv_mev / 1000;
+	nc += (uint64_t)SCAN_NA / 100 * scan_pct_ms / 1000;
+	nc += (uint64_t)SYNC_EVENT_NC * sync_mev / 1000;
+
+	struct bt_conn_info info;
+
+	if (link_ms[LINK_CONN] && conn && !bt_conn_get_info(conn, &info) && info.le.interval) {
+		uint32_t skip = pkts ? 1 : 1 + info.le.latency;
+
+		nc += (uint64_t)CONN_EVENT_NC * link_ms[LINK_CONN] * 1000 /
+		      ((uint64_t)info.le.interval * 1250 * skip);
+	}
+	nc += (uint64_t)pkts * NOTIFY_NC + (uint64_t)pkt_bytes * NOTIFY_NC_PER_BYTE;
+
+	return nc;
+}
+
+static void gov_work_fn(struct k_work *work)
+{
+	uint32_t now = k_uptime_get_32();
+	uint32_t el_ms, lp_ms, adv_mev, scan_pct_ms, sync_mev, link_ms[LINK_STATE_COUNT];
+	enum link_state link;
+	struct bt_conn *conn;
+
+	k_work_reschedule(&gov_work, K_SECONDS(POWER_GOV_PERIOD_S));
+
+	K_SPINLOCK(&lock) {
+		acc_update(now);
+		lp_ms = acc.lp_ms;
+		memcpy(link_ms, acc.link_ms, sizeof(link_ms));
+		el_ms = link_ms[LINK_IDLE] + link_ms[LINK_ADV] + link_ms[LINK_CONN];
+		adv_mev = acc.adv_mev;
+		scan_pct_ms = acc.scan_pct_ms;
+		sync_mev = acc.sync_mev;
+		acc.lp_ms = 0;
+		memset(acc.link_ms, 0, sizeof(acc.link_ms));
+		acc.adv_mev = 0;
+		acc.scan_pct_ms = 0;
+		acc.sync_mev = 0;
+		link = acc.link;
+		adv_ms = acc.adv_ms;
+		scan_pct = acc.scan_pct;
+		sync_ms = acc.sync_ms;
+		conn = acc.conn;
+	}
+	if (!el_ms) {
+		return;
+	}
+
+	uint64_t nc = account(el_ms, lp_ms, link_ms, adv_mev, scan_pct_ms, sync_mev, conn);
+	uint32_t actual_na = MIN(nc * 1000 / el_ms, UINT32_MAX);
+
+	if (last_raw_na) {
+		uint32_t r = MIN((uint64_t)actual_na * 1024 / last_raw_na, 2048);
+
+		scale_q10 = CLAMP((3 * scale_q10 + r) / 4, 512, 2048);
+	}
+
+	uint32_t b = atomic_get(&cfg_budget_na);
+
+	if (b != budget_na) {
+		LOG_INF("budget %u uA", b / 1000);
+		budget_na = b;
+		debt_nc = 0;
+	}
+
+	uint32_t target_na = budget_na;
+
+	if (budget_na) {
+		debt_nc += ((int64_t)actual_na - budget_na) * el_ms / 1000;
+		// credit from a quiet spell buys at most half again the budget
+		debt_nc = MAX(debt_nc, -(int64_t)budget_na * POWER_GOV_PAYBACK_S / 2);
+		target_na = CLAMP((int64_t)budget_na - debt_nc / POWER_GOV_PAYBACK_S,
+				  budget_na / 2, budget_na + budget_na / 2);
+		want = pick(target_na, link);
+	}
+
+	const struct power_gov_profile *next = &profiles[want];
+	uint32_t raw_na = project_na(next, link);
+	uint32_t next_na = ((uint64_t)raw_na * scale_q10) >> 10;
+	uint32_t life_h = actual_na ? (uint64_t)CONFIG_APP_POWER_GOV_BATTERY_MAH * 1000000 / actual_na : 0;
+
+	LOG_INF("actual %u uA projected %u uA, target %u uA: %s (%u uA) scale %u%%",
+		actual_na / 1000, last_projected_na / 1000, target_na / 1000, next->name,
+		next_na / 1000, scale_q10 * 100 / 1024);
+
+	if (accel_svc_subscribed(ACCEL_STREAM_POWER)) {
+		struct power_gov_report rep = {
+			.uptime_ms = sys_cpu_to_le32(now),
+			.budget_na = sys_cpu_to_le32(budget_na),
+			.target_na = sys_cpu_to_le32(target_na),
+			.actual_na = sys_cpu_to_le32(actual_na),
+			.projected_na = sys_cpu_to_le32(last_projected_na),
+			.next_na = sys_cpu_to_le32(next_na),
+			.debt_uc = sys_cpu_to_le32((int32_t)CLAMP(debt_nc / 1000, INT32_MIN, INT32_MAX)),
+			.life_h = sys_cpu_to_le16(MIN(life_h, UINT16_MAX)),
+			.profile = want,
+			.scale_pct = MIN(scale_q10 * 100 / 1024, UINT8_MAX),
+		};
+
+		accel_svc_send(ACCEL_STREAM_POWER, &rep, sizeof(rep));
+	}
+
+	last_raw_na = raw_na;
+	last_projected_na = next_na;
+}
+
+void power_gov_init(void)
+{
+	K_SPINLOCK(&lock) {
+		acc.since_ms = k_uptime_get_32();
+	}
+	k_work_reschedule(&gov_work, K_SECONDS(POWER_GOV_PERIOD_S));
+}
+
+int power_gov_configure(const void *buf, uint16_t len)
+{
+	struct power_gov_cfg cfg;
+
+	if (len != sizeof(cfg.budget_na) && len != sizeof(cfg)) {
+		return -EINVAL;
+	}
+	memset(&cfg, 0xFF, sizeof(cfg));
+	memcpy(&cfg, buf, len);
+	for (int s = 0; s < ACCEL_STREAM_COUNT; s++) {
+		if (cfg.prio[s] != 0xFF && cfg.prio[s] > ACCEL_PRIO_LOW) {
+			return -EINVAL;
+		}
+	}
+
+	for (int s = 0; s < ACCEL_STREAM_COUNT; s++) {
+		if (cfg.prio[s] != 0xFF) {
+			accel_svc_set_prio(s, cfg.prio[s]);
+		}
+	}
+	// taken at the end of the period, with a full period of rates behind it
+	atomic_set(&cfg_budget_na, sys_le32_to_cpu(cfg.budget_na));
+	return 0;
+}
+
+const struct power_gov_profile *power_gov_pending(void)
+{
+	const struct power_gov_profile *p = &profiles[want];
+
+	return p != active ? p : NULL;
+}
+
+void power_gov_applied(const struct power_gov_profile *p)
+{
+	LOG_INF("profile %s -> %s", active->name, p->name);
+	active = p;
+	accel_svc_set_emit(p->lowest_prio);
+}
+
+const struct power_gov_profile *power_gov_active(void)
+{
+	return active;
+}
+
+void power_gov_drain(uint16_t bytes, uint32_t cpu_us)
+{
+	atomic_inc(&drains);
+	atomic_add(&drain_bytes, bytes);
+	atomic_add(&drain_cpu_us, cpu_us);
+}
+
+void power_gov_low_power(bool on)
+{
+	K_SPINLOCK(&lock) {
+		acc_update(k_uptime_get_32());
+		acc.lp = on;
+	}
+}
+
+void power_gov_set_conn(struct bt_conn *conn)
+{
+	K_SPINLOCK(&lock) {
+		acc_update(k_uptime_get_32());
+		acc.conn = conn;
+		acc.link = conn ? LINK_CONN : LINK_IDLE;
+	}
+}
+
+void power_gov_set_adv(uint16_t interval_ms)
+{
+	K_SPINLOCK(&lock) {
+		acc_update(k_uptime_get_32());
+		if (!acc.conn) {
+			acc.link = interval_ms ? LINK_ADV : LINK_IDLE;
+			acc.adv_ms = interval_ms;
+		}
+	}
+}
+
+void power_gov_set_timesync(uint8_t scan_pct, uint16_t sync_ms)
+{
+	K_SPINLOCK(&lock) {
+		acc_update(k_uptime_get_32());
+		acc.scan_pct = scan_pct;
+		acc.sync_ms = sync_ms;
+	}
+}
@@ -0,0 +1,447 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+#include "reduce.h"
+#include "accel_svc.h"
+#include "fixmath.h"
+#include "sensor_cfg.h"
+
+LOG_MODULE_REGISTER(reduce, LOG_LEVEL_INF);
+
+static const char *const mode_names[REDUCE_MODE_COUNT] = { "deadband", "door" };
+
+// points waiting for the link, the oldest go when it can't keep up
+#define PENDING_MAX  64
+
+struct reduce_tx {
+	struct reduce_point pts[PENDING_MAX];
+	uint8_t n;
+};
+
+static struct reducer red;
+static struct reduce_tx tx;
+static uint32_t sample_index;
+
+// from the BT thread, taken by the next batch; the defaults go in first
+static struct k_spinlock lock;
+static struct reduce_cfg cfg_pending = {
+	.mode = REDUCE_DOOR,
+	.tol_mg = { REDUCE_TOL_MG, REDUCE_TOL_MG, REDUCE_TOL_MG },
+};
+static bool cfg_new = true;
+static struct reduce_cfg cfg;
+
+static int64_t div_floor(int64_t a, int64_t b)
+{
+	int64_t q = a / b;
+
+	return (a % b && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+static int64_t div_ceil(int64_t a, int64_t b)
+{
+	return -div_floor(-a, b);
+}
+
+static void emit(struct reducer *r, const struct reduce_point *p, reduce_out_t out, void *user)
+{
+	r->anchor = *p;
+	for (int a = 0; a < 3; a++) {
+		r->lo[a] = INT64_MIN;
+		r->hi[a] = INT64_MAX;
+	}
+	out(p, user);
+}
+
+// Vertex at the last sample, on a line that is still inside every axis'
+// door, rounded to whole LSB.
+static void door_close(struct reducer *r, reduce_out_t out, void *user)
+{
+	int64_t dt = r->prev.index - r->anchor.index;
+	struct reduce_point vx = { .index = r->prev.index };
+
+	for (int a = 0; a < 3; a++) {
+		int64_t s = (int64_t)(r->prev.v[a] - r->anchor.v[a]) * 65536 / dt;
+
+		s = CLAMP(s, r->lo[a], r->hi[a]);
+		vx.v[a] = sat16(r->anchor.v[a] + div_floor(s * dt + (1 << 15), 1 << 16));
+	}
+	emit(r, &vx, out, user);
+}
+
+void reduce_init(struct reducer *r, uint8_t mode, const uint16_t tol_mg[3])
+{
+	r->mode = mode;
+	for (int a = 0; a < 3; a++) {
+		int32_t t = MIN((int32_t)tol_mg[a] * SENSOR_LSB_PER_G / 1000, INT16_MAX);
+
+		// vertices and the rebuilt line are rounded to whole LSB, which
+		// costs up to one
+		r->tol[a] = mode == REDUCE_DOOR ? MAX(t - 1, 0) : t;
+	}
+	reduce_reset(r);
+}
+
+void reduce_reset(struct reducer *r)
+{
+	r->open = false;
+}
+
+void reduce_push(struct reducer *r, uint32_t index, const int16_t v[3],
+		 reduce_out_t out, void *user)
+{
+	struct reduce_point cur = { .index = index, .v = { v[0], v[1], v[2] } };
+
+	if (!r->open || index != r->prev.index + 1) {
+		// a hole in the input: finish the segment before it, start over after it
+		if (r->open && r->mode == REDUCE_DOOR && r->prev.index != r->anchor.index) {
+			door_close(r, out, user);
+		}
+		r->open = true;
+		r->prev = cur;
+		emit(r, &cur, out, user);
+		return;
+	}
+
+	if (r->mode == REDUCE_DEADBAND) {
+		bool moved = index - r->anchor.index >= REDUCE_MAX_GAP;
+
+		for (int a = 0; a < 3; a++) {
+			moved = moved || abs(cur.v[a] - r->anchor.v[a]) > r->tol[a];
+		}
+		if (moved) {
+			emit(r, &cur, out, user);
+		}
+		r->prev = cur;
+		return;
+	}
+
+	if (index - r->anchor.index > REDUCE_MAX_GAP) {
+		door_close(r, out, user);
+	}
+	// the second pass starts from a vertex at the previous sample, one
+	// sample away always fits
+	for (int pass = 0; pass < 2; pass++) {
+		int64_t dt = index - r->anchor.index;
+		int64_t lo[3], hi[3];
+		bool fits = true;
+
+		for (int a = 0; a < 3; a++) {
+			int64_t d = cur.v[a] - r->anchor.v[a];
+
+			lo[a] = MAX(r->lo[a], div_ceil((d - r->tol[a]) * 65536, dt));
+			hi[a] = MIN(r->hi[a], div_floor((d + r->tol[a]) * 65536, dt));
+			fits = fits && lo[a] <= hi[a];
+		}
+		if (fits) {
+			memcpy(r->lo, lo, sizeof(lo));
+			memcpy(r->hi, hi, sizeof(hi));
+			break;
+		}
+		door_close(r, out, user);
+	}
+	r->prev = cur;
+}
+
+void reduce_rx_init(struct reduce_rx *rx)
+{
+	rx->have = false;
+}
+
+void reduce_rx_point(struct reduce_rx *rx, const struct reduce_point *p,
+		     reduce_rx_out_t out, void *user)
+{
+	if (rx->have && p->index > rx->last.index) {
+		int64_t dt = p->index - rx->last.index;
+
+		for (int64_t i = 1; i < dt; i++) {
+			int16_t v[3];
+
+			for (int a = 0; a < 3; a++) {
+				int64_t d = p->v[a] - rx->last.v[a];
+
+				v[a] = rx->mode == REDUCE_DOOR ?
+				       rx->last.v[a] + div_floor(2 * d * i + dt, 2 * dt) : rx->last.v[a];
+			}
+			out(rx->last.index + i, v, user);
+		}
+	}
+	out(p->index, p->v, user);
+	rx->last = *p;
+	rx->have = true;
+}
+
+int reduce_rx_packet(struct reduce_rx *rx, const uint8_t *buf, uint16_t len,
+		     reduce_rx_out_t out, void *user)
+{
+	if (len < sizeof(struct reduce_pkt_hdr)) {
+		return -EINVAL;
+	}
+
+	uint32_t index = sys_get_le32(buf);
+	uint8_t mode = buf[4];
+	uint8_t n = buf[5];
+
+	if (mode >= REDUCE_MODE_COUNT || len != sizeof(struct reduce_pkt_hdr) + n * REDUCE_PT_BYTES) {
+		return -EINVAL;
+	}
+	if (mode != rx->mode) {
+		rx->mode = mode;
+		rx->have = false;
+	}
+
+	const uint8_t *p = buf + sizeof(struct reduce_pkt_hdr);
+
+	for (int i = 0; i < n; i++, p += REDUCE_PT_BYTES) {
+		struct reduce_point pt;
+
+		index += sys_get_le16(p);
+		pt.index = index;
+		for (int a = 0; a < 3; a++) {
+			pt.v[a] = (int16_t)sys_get_le16(p + 2 + 2 * a);
+		}
+		reduce_rx_point(rx, &pt, out, user);
+	}
+	return 0;
+}
+
+static void tx_add(const struct reduce_point *p, void *user)
+{
+	struct reduce_tx *t = user;
+
+	if (t->n == PENDING_MAX) {
+		memmove(t->pts, t->pts + 1, (PENDING_MAX - 1) * sizeof(t->pts[0]));
+		t->n--;
+		LOG_WRN_ONCE("link behind, dropping the oldest points");
+	}
+	t->pts[t->n++] = *p;
+}
+
+static void tx_consume(struct reduce_tx *t, uint8_t k)
+{
+	memmove(t->pts, t->pts + k, (t->n - k) * sizeof(t->pts[0]));
+	t->n -= k;
+}
+
+// as many points from the front as fit in cap and in a 16 bit dt
+static uint16_t encode(uint8_t *buf, uint16_t cap, uint8_t mode, const struct reduce_tx *t,
+		       uint8_t *used)
+{
+	uint8_t *p = buf + sizeof(struct reduce_pkt_hdr);
+	uint8_t k = 0;
+
+	while (k < t->n && p + REDUCE_PT_BYTES <= buf + cap) {
+		uint32_t dt = k ? t->pts[k].index - t->pts[k - 1].index : 0;
+
+		if (dt > UINT16_MAX) {
+			break;
+		}
+		sys_put_le16(dt, p);
+		for (int a = 0; a < 3; a++) {
+			sys_put_le16(t->pts[k].v[a], p + 2 + 2 * a);
+		}
+		p += REDUCE_PT_BYTES;
+		k++;
+	}
+	sys_put_le32(t->pts[0].index, buf);
+	buf[4] = mode;
+	buf[5] = k;
+	*used = k;
+	return p - buf;
+}
+
+static void tx_flush(void)
+{
+	while (tx.n) {
+		uint16_t cap;
+		uint8_t *buf = accel_svc_reserve(&cap);
+		uint8_t k;
+
+		if (!buf) {
+			return;   // kept for the next batch
+		}
+		uint16_t len = encode(buf, cap, red.mode, &tx, &k);
+
+		if (accel_svc_commit(ACCEL_STREAM_REDUCED, len)) {
+			return;
+		}
+		tx_consume(&tx, k);
+	}
+}
+
+#if defined(CONFIG_APP_TRACE_REPLAY)
+// Replay runs both modes next to the stream and rebuilds their packets
+// with the reference reconstructor; every rebuilt sample is compared with
+// the input still in the history.
+#define HIST_LEN  512
+BUILD_ASSERT(HIST_LEN > REDUCE_MAX_GAP + FIFO_SAMPLES, "history shorter than a door segment");
+
+static struct reduce_point hist[HIST_LEN];
+static struct check {
+	struct reducer r;
+	struct reduce_rx rx;
+	struct reduce_tx tx;
+	uint32_t samples;
+	uint32_t points;
+	uint32_t bytes;
+	uint32_t checked;
+	uint16_t max_err[3];
+} checks[REDUCE_MODE_COUNT];
+
+static void check_out(uint32_t index, const int16_t v[3], void *user)
+{
+	struct check *c = user;
+	const struct reduce_point *h = &hist[index % HIST_LEN];
+
+	if (h->index != index) {
+		return;   // a hole in the input
+	}
+	c->checked++;
+	for (int a = 0; a < 3; a++) {
+		c->max_err[a] = MAX(c->max_err[a], abs(v[a] - h->v[a]));
+	}
+}
+
+static void check_init(const uint16_t tol_mg[3])
+{
+	for (int m = 0; m < REDUCE_MODE_COUNT; m++) {
+		memset(&checks[m], 0, sizeof(checks[m]));
+		reduce_init(&checks[m].r, m, tol_mg);
+		reduce_rx_init(&checks[m].rx);
+	}
+}
+
+static void check_push(uint32_t index, const int16_t v[3])
+{
+	hist[index % HIST_LEN] = (struct reduce_point){ .index = index, .v = { v[0], v[1], v[2] } };
+	for (int m = 0; m < REDUCE_MODE_COUNT; m++) {
+		checks[m].samples++;
+		reduce_push(&checks[m].r, index, v, tx_add, &checks[m].tx);
+	}
+}
+
+static void check_flush(void)
+{
+	for (int m = 0; m < REDUCE_MODE_COUNT; m++) {
+		struct check *c = &checks[m];
+
+		while (c->tx.n) {
+			uint8_t buf[ACCEL_SVC_MAX_PAYLOAD];
+			uint8_t k;
+			uint16_t len = encode(buf, sizeof(buf), m, &c->tx, &k);
+
+			c->bytes += len;
+			c->points += k;
+			reduce_rx_packet(&c->rx, buf, len, check_out, c);
+			tx_consume(&c->tx, k);
+		}
+	}
+}
+
+void reduce_report(void)
+{
+	for (int m = 0; m < REDUCE_MODE_COUNT; m++) {
+		const struct check *c = &checks[m];
+
+		printk("REPLAY reduce mode=%s tol_mg=%u/%u/%u samples=%u points=%u bytes=%u "
+		       "ratio_x100=%u checked=%u max_err_mg=%u/%u/%u\n",
+		       mode_names[m], cfg.tol_mg[0], cfg.tol_mg[1], cfg.tol_mg[2], c->samples,
+		       c->points, c->bytes,
+		       c->bytes ? (uint32_t)((uint64_t)c->samples * 6 * 100 / c->bytes) : 0,
+		       c->checked, c->max_err[0] * 1000 / SENSOR_LSB_PER_G,
+		       c->max_err[1] * 1000 / SENSOR_LSB_PER_G, c->max_err[2] * 1000 / SENSOR_LSB_PER_G);
+	}
+}
+#else
+static void check_init(const uint16_t tol_mg[3])
+{
+}
+
+static void check_push(uint32_t index, const int16_t v[3])
+{
+}
+
+static void check_flush(void)
+{
+}
+#endif
+
+void reduce_process(const struct bma400_fifo_sensor_data *samples, uint16_t count)
+{
+	bool want = accel_svc_subscribed(ACCEL_STREAM_REDUCED);
+	bool reinit = false;
+
+	K_SPINLOCK(&lock) {
+		if (cfg_new) {
+			cfg = cfg_pending;
+			cfg_new = false;
+			reinit = true;
+		}
+	}
+	if (reinit) {
+		// what is left goes out in the old mode first
+		if (want) {
+			tx_flush();
+		}
+		// cfg is packed, the reducers want an aligned array
+		const uint16_t tol_mg[3] = { cfg.tol_mg[0], cfg.tol_mg[1], cfg.tol_mg[2] };
+
+		tx.n = 0;
+		reduce_init(&red, cfg.mode, tol_mg);
+		check_init(tol_mg);
+		LOG_INF("%s, %u/%u/%u mg", mode_names[cfg.mode], cfg.tol_mg[0], cfg.tol_mg[1],
+			cfg.tol_mg[2]);
+	}
+
+	// the index counts every sample, sent or not
+	for (uint16_t i = 0; i < count; i++) {
+		const int16_t v[3] = { samples[i].x, samples[i].y, samples[i].z };
+
+		if (want) {
+			reduce_push(&red, sample_index + i, v, tx_add, &tx);
+		}
+		check_push(sample_index + i, v);
+	}
+	sample_index += count;
+	check_flush();
+
+	if (!want) {
+		reduce_reset(&red);
+		tx.n = 0;
+		return;
+	}
+	tx_flush();
+}
+
+int reduce_configure(const void *buf, uint16_t len)
+{
+	struct reduce_cfg c;
+
+	if (len != sizeof(c)) {
+		return -EINVAL;
+	}
+	memcpy(&c, buf, sizeof(c));
+	if (c.mode >= REDUCE_MODE_COUNT) {
+		return -EINVAL;
+	}
+	for (int a = 0; a < 3; a++) {
+		c.tol_mg[a] = sys_le16_to_cpu(c.tol_mg[a]);
+	}
+
+	K_SPINLOCK(&lock) {
+		cfg_pending = c;
+		cfg_new = true;
+	}
+	return 0;
+}
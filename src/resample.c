@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <string.h>
+#include "resample.h"
+#include "fixmath.h"
+
+void resample_init(struct resampler *rs, uint32_t period_us)
+{
+	*rs = (struct resampler){ .period_us = period_us };
+}
+
+void resample_reset(struct resampler *rs)
+{
+	rs->fill = 0;
+	rs->next = 0;
+}
+
+// Catmull-Rom between p1 and p2 at mu (Q15):
+// p1 + mu/2 * (p2 - p0 + mu * (2p0 - 5p1 + 4p2 - p3 + mu * (3(p1 - p2) + p3 - p0)))
+static int16_t cubic(int32_t p0, int32_t p1, int32_t p2, int32_t p3, int32_t mu)
+{
+	int64_t a = 3 * (p1 - p2) + p3 - p0;
+	int64_t b = 2 * p0 - 5 * p1 + 4 * p2 - p3 + ((a * mu) >> 15);
+	int64_t c = p2 - p0 + ((b * mu) >> 15);
+
+	return sat16(p1 + (int32_t)((c * mu + (1 << 15)) >> 16));
+}
+
+void resample_push(struct resampler *rs, int64_t t_us, const int16_t xyz[3],
+		   resample_out_t out, void *user)
+{
+	if (rs->fill && (t_us <= rs->t[rs->fill - 1] ||
+			 t_us - rs->t[rs->fill - 1] > (int64_t)RESAMPLE_MAX_GAP * rs->period_us)) {
+		resample_reset(rs);
+	}
+
+	if (rs->fill == 4) {
+		memmove(&rs->t[0], &rs->t[1], 3 * sizeof(rs->t[0]));
+		memmove(&rs->v[0], &rs->v[1], 3 * sizeof(rs->v[0]));
+		rs->fill = 3;
+	}
+	rs->t[rs->fill] = t_us;
+	memcpy(rs->v[rs->fill], xyz, sizeof(rs->v[0]));
+	if (++rs->fill < 4) {
+		return;
+	}
+
+	const int64_t t1 = rs->t[1];
+	const int64_t t2 = rs->t[2];
+
+	// first full window after a start: the grid begins at the first point past t1
+	if (rs->next * rs->period_us < t1) {
+		rs->next = (t1 + rs->period_us - 1) / rs->period_us;
+	}
+	for (; rs->next * rs->period_us < t2; rs->next++) {
+		int32_t mu = (int32_t)(((rs->next * rs->period_us - t1) << 15) / (t2 - t1));
+		int16_t o[3];
+
+		for (int a = 0; a < 3; a++) {
+			o[a] = cubic(rs->v[0][a], rs->v[1][a], rs->v[2][a], rs->v[3][a], mu);
+		}
+		out(rs->next, o, user);
+	}
+}
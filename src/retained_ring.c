@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/linker/section_tags.h>
+#include <zephyr/sys/crc.h>
+#include "retained_ring.h"
+
+LOG_MODULE_REGISTER(retained_ring, LOG_LEVEL_INF);
+
+#define RETAINED_RING_MAGIC 0x52524E47 // "RRNG"
+
+struct retained_hdr {
+	uint32_t magic;
+	uint32_t boot_count;
+	uint16_t head;       // next block to write
+	uint16_t tail;       // oldest unsent block
+	uint16_t used;
+	uint16_t next_seq;
+	uint32_t crc;        // over everything above
+};
+
+struct retained_ring {
+	struct retained_hdr hdr;
+	struct retained_block blocks[RETAINED_RING_BLOCKS];
+};
+
+static __noinit struct retained_ring rr;
+
+static uint32_t hdr_crc(const struct retained_hdr *h)
+{
+	return crc32_ieee((const uint8_t *)h, offsetof(struct retained_hdr, crc));
+}
+
+static uint32_t block_crc(const struct retained_block *b)
+{
+	return crc32_ieee((const uint8_t *)b, offsetof(struct retained_block, crc));
+}
+
+static bool block_valid(const struct retained_block *b)
+{
+	return b->count <= RETAINED_RING_BLOCK_MAX && b->crc == block_crc(b);
+}
+
+static void hdr_commit(void)
+{
+	rr.hdr.crc = hdr_crc(&rr.hdr);
+}
+
+static bool hdr_valid(void)
+{
+	return rr.hdr.magic == RETAINED_RING_MAGIC &&
+	       rr.hdr.crc == hdr_crc(&rr.hdr) &&
+	       rr.hdr.head < RETAINED_RING_BLOCKS &&
+	       rr.hdr.tail < RETAINED_RING_BLOCKS &&
+	       rr.hdr.used <= RETAINED_RING_BLOCKS &&
+	       (rr.hdr.tail + rr.hdr.used) % RETAINED_RING_BLOCKS == rr.hdr.head;
+}
+
+uint16_t retained_ring_init(void)
+{
+	if (!hdr_valid()) {
+		// cold boot (or garbage), start over
+		memset(&rr.hdr, 0, sizeof(rr.hdr));
+		rr.hdr.magic = RETAINED_RING_MAGIC;
+		hdr_commit();
+		LOG_INF("retained ring cleared");
+		return 0;
+	}
+
+	// The header is fine, check the blocks. A push into a full ring
+	// overwrites the tail, so a half written block from the reset sits at
+	// the front and is skipped; otherwise it is the newest and ends the
+	// run. What lies between is kept.
+	uint16_t skip = 0;
+	uint16_t good = 0;
+
+	while (skip < rr.hdr.used && !block_valid(&rr.blocks[(rr.hdr.tail + skip) % RETAINED_RING_BLOCKS])) {
+		skip++;
+	}
+	while (skip + good < rr.hdr.used &&
+	       block_valid(&rr.blocks[(rr.hdr.tail + skip + good) % RETAINED_RING_BLOCKS])) {
+		good++;
+	}
+	if (good != rr.hdr.used) {
+		LOG_WRN("retained ring: %u of %u blocks corrupt", rr.hdr.used - good, rr.hdr.used);
+		rr.hdr.tail = (rr.hdr.tail + skip) % RETAINED_RING_BLOCKS;
+		rr.hdr.used = good;
+		rr.hdr.head = (rr.hdr.tail + good) % RETAINED_RING_BLOCKS;
+	}
+
+	rr.hdr.boot_count++;
+	hdr_commit();
+	LOG_INF("retained ring: %u unsent blocks survived reset (boot %u)",
+		rr.hdr.used, rr.hdr.boot_count);
+
+	return rr.hdr.used;
+}
+
+uint16_t retained_ring_push(const struct bma400_fifo_sensor_data *samples, uint16_t count)
+{
+	struct retained_block *b = &rr.blocks[rr.hdr.head];
+
+	count = MIN(count, RETAINED_RING_BLOCK_MAX);
+
+	b->seq = rr.hdr.next_seq;
+	b->count = count;
+	b->boot = (uint8_t)rr.hdr.boot_count;
+	b->uptime_ms = k_uptime_get_32();
+	memcpy(b->s, samples, count * sizeof(*samples));
+	b->crc = block_crc(b);
+
+	// block is complete before the header points past it
+	rr.hdr.next_seq++;
+	rr.hdr.head = (rr.hdr.head + 1) % RETAINED_RING_BLOCKS;
+	if (rr.hdr.used == RETAINED_RING_BLOCKS) {
+		rr.hdr.tail = (rr.hdr.tail + 1) % RETAINED_RING_BLOCKS;
+	} else {
+		rr.hdr.used++;
+	}
+	hdr_commit();
+
+	return b->seq;
+}
+
+const struct retained_block *retained_ring_peek(void)
+{
+	if (!rr.hdr.used) {
+		return NULL;
+	}
+	return &rr.blocks[rr.hdr.tail];
+}
+
+void retained_ring_pop(void)
+{
+	if (!rr.hdr.used) {
+		return;
+	}
+	rr.hdr.tail = (rr.hdr.tail + 1) % RETAINED_RING_BLOCKS;
+	rr.hdr.used--;
+	hdr_commit();
+}
+
+uint16_t retained_ring_pending(void)
+{
+	return rr.hdr.used;
+}
+
+uint32_t retained_ring_boot_count(void)
+{
+	return rr.hdr.boot_count;
+}
@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+#include "rollup.h"
+#include "accel_svc.h"
+#include "fixmath.h"
+#include "sensor_cfg.h"
+
+LOG_MODULE_REGISTER(rollup, LOG_LEVEL_INF);
+
+// retry interval while the TX slots or the payload buffer are taken
+#define QUERY_RETRY_MS 20
+
+// running sums of one open period
+struct rollup_acc {
+	uint32_t start_s;
+	uint32_t n;
+	int32_t sum[3];
+	uint64_t sumsq[3];
+	int16_t min[3];
+	int16_t max[3];
+};
+
+struct tier {
+	struct rollup_rec *ring;
+	uint16_t len;
+	uint32_t period_s;
+	uint32_t total;         // records ever closed, the newest is total - 1
+	struct rollup_acc acc;
+};
+
+static struct rollup_rec sec_ring[ROLLUP_SECOND_RECORDS];
+static struct rollup_rec min_ring[ROLLUP_MINUTE_RECORDS];
+static struct rollup_rec hour_ring[ROLLUP_HOUR_RECORDS];
+
+static struct tier tiers[ROLLUP_TIER_COUNT] = {
+	[ROLLUP_SECOND] = { sec_ring, ROLLUP_SECOND_RECORDS, 1 },
+	[ROLLUP_MINUTE] = { min_ring, ROLLUP_MINUTE_RECORDS, 60 },
+	[ROLLUP_HOUR]   = { hour_ring, ROLLUP_HOUR_RECORDS, 3600 },
+};
+
+// the query sender reads the rings from the system work queue
+static struct k_spinlock lock;
+
+static struct {
+	bool active;
+	uint8_t tier;
+	uint32_t from_s;
+	uint32_t to_s;
+	uint32_t cursor;        // next record to look at, counts like tier.total
+	uint16_t seq;
+} query;
+
+static uint32_t next_sec_s;
+
+static void query_send(struct k_work *work);
+K_WORK_DELAYABLE_DEFINE(query_work, query_send);
+static struct k_work_sync query_sync;
+
+static void acc_reset(struct rollup_acc *acc, uint32_t start_s)
+{
+	*acc = (struct rollup_acc){ .start_s = start_s };
+	for (int a = 0; a < 3; a++) {
+		acc->min[a] = INT16_MAX;
+		acc->max[a] = INT16_MIN;
+	}
+}
+
+static void acc_merge(struct rollup_acc *dst, const struct rollup_acc *src)
+{
+	if (!dst->n) {
+		dst->start_s = src->start_s;
+	}
+	dst->n += src->n;
+	for (int a = 0; a < 3; a++) {
+		dst->sum[a] += src->sum[a];
+		dst->sumsq[a] += src->sumsq[a];
+		dst->min[a] = MIN(dst->min[a], src->min[a]);
+		dst->max[a] = MAX(dst->max[a], src->max[a]);
+	}
+}
+
+// closes the tier's open period, folding it into the next tier up
+static void tier_close(enum rollup_tier t)
+{
+	struct tier *tr = &tiers[t];
+	struct rollup_acc *acc = &tr->acc;
+
+	if (!acc->n) {
+		return;
+	}
+
+	struct rollup_rec rec = {
+		.start_s = acc->start_s,
+		.n = acc->n,
+	};
+
+	for (int a = 0; a < 3; a++) {
+		rec.min[a] = acc->min[a];
+		rec.max[a] = acc->max[a];
+		rec.mean[a] = sat16(acc->sum[a] / (int32_t)acc->n);
+		rec.rms[a] = MIN(isqrt64(acc->sumsq[a] / acc->n), UINT16_MAX);
+	}
+
+	K_SPINLOCK(&lock) {
+		tr->ring[tr->total % tr->len] = rec;
+		tr->total++;
+	}
+
+	if (t + 1 < ROLLUP_TIER_COUNT) {
+		struct tier *up = &tiers[t + 1];
+
+		// after a gap in the data this period can start past the open one above
+		if (up->acc.n && acc->start_s >= up->acc.start_s + up->period_s) {
+			tier_close(t + 1);
+		}
+		acc_merge(&up->acc, acc);
+		if (acc->start_s + tr->period_s >= up->acc.start_s + up->period_s) {
+			tier_close(t + 1);
+		}
+	}
+	acc_reset(acc, 0);
+}
+
+void rollup_process(const struct bma400_fifo_sensor_data *samples, uint16_t count)
+{
+	struct rollup_acc *sec = &tiers[ROLLUP_SECOND].acc;
+
+	for (int i = 0; i < count; i++) {
+		const int16_t v[3] = { samples[i].x, samples[i].y, samples[i].z };
+
+		if (!sec->n) {
+			uint32_t now_s = k_uptime_get_32() / 1000;
+
+			// seconds follow the samples, uptime only after a gap (a batch
+			// is processed up to a watermark period after its first sample)
+			acc_reset(sec, now_s > next_sec_s + 2 ? now_s : next_sec_s);
+			next_sec_s = sec->start_s + 1;
+		}
+		for (int a = 0; a < 3; a++) {
+			sec->sum[a] += v[a];
+			sec->sumsq[a] += (int32_t)v[a] * v[a];
+			sec->min[a] = MIN(sec->min[a], v[a]);
+			sec->max[a] = MAX(sec->max[a], v[a]);
+		}
+		if (++sec->n >= SENSOR_ODR_HZ) {
+			tier_close(ROLLUP_SECOND);
+		}
+	}
+}
+
+static uint8_t *put_rec(uint8_t *p, const struct rollup_rec *r)
+{
+	sys_put_le32(r->start_s, p);
+	sys_put_le32(r->n, p + 4);
+	p += 8;
+	for (int a = 0; a < 3; a++) {
+		sys_put_le16(r->min[a], p);
+		sys_put_le16(r->max[a], p + 6);
+		sys_put_le16(r->mean[a], p + 12);
+		sys_put_le16(r->rms[a], p + 18);
+		p += 2;
+	}
+	return p + 18;
+}
+
+static void query_send(struct k_work *work)
+{
+	while (query.active) {
+		uint16_t cap;
+		uint8_t *buf = accel_svc_reserve(&cap);
+
+		if (!buf) {
+			k_work_reschedule(&query_work, K_MSEC(QUERY_RETRY_MS));
+			return;
+		}
+
+		struct rollup_pkt_hdr *hdr = (struct rollup_pkt_hdr *)buf;
+		uint8_t *p = buf + sizeof(*hdr);
+		uint8_t per_pkt = (cap - sizeof(*hdr)) / sizeof(struct rollup_rec);
+		uint32_t cursor = query.cursor;
+		uint8_t n = 0;
+		bool done = false;
+
+		if (!per_pkt) {
+			// the header alone fits, it says why there is nothing else
+			hdr->tier = query.tier;
+			hdr->n = ROLLUP_N_MTU;
+			hdr->seq = sys_cpu_to_le16(query.seq);
+			if (accel_svc_commit(ACCEL_STREAM_ROLLUP, sizeof(*hdr)) == -EAGAIN) {
+				k_work_reschedule(&query_work, K_MSEC(QUERY_RETRY_MS));
+				return;
+			}
+			LOG_WRN("query refused, MTU too small for a record");
+			query.active = false;
+			return;
+		}
+
+		K_SPINLOCK(&lock) {
+			const struct tier *tr = &tiers[query.tier];
+
+			// records overwritten since the query started are gone
+			cursor = MAX(cursor, tr->total > tr->len ? tr->total - tr->len : 0);
+			while (n < per_pkt && cursor < tr->total) {
+				const struct rollup_rec *r = &tr->ring[cursor % tr->len];
+
+				if (query.to_s && r->start_s > query.to_s) {
+					cursor = tr->total;
+					break;
+				}
+				cursor++;
+				if (r->start_s >= query.from_s) {
+					p = put_rec(p, r);
+					n++;
+				}
+			}
+			done = cursor == tr->total;
+		}
+
+		hdr->tier = query.tier;
+		hdr->n = n;
+		hdr->seq = sys_cpu_to_le16(query.seq);
+
+		int err = accel_svc_commit(ACCEL_STREAM_ROLLUP, p - buf);
+
+		if (err == -EAGAIN) {
+			// nothing advanced, the same records go in the next try
+			k_work_reschedule(&query_work, K_MSEC(QUERY_RETRY_MS));
+			return;
+		}
+		if (err) {
+			LOG_WRN("query aborted (err %d)", err);
+			query.active = false;
+			return;
+		}
+		query.cursor = cursor;
+		query.seq++;
+		// the empty packet that ends the answer has gone out
+		if (!n && done) {
+			query.active = false;
+		}
+	}
+}
+
+int rollup_query(const void *buf, uint16_t len)
+{
+	struct rollup_query q;
+
+	if (len != sizeof(q)) {
+		return -EINVAL;
+	}
+	memcpy(&q, buf, sizeof(q));
+	if (q.tier >= ROLLUP_TIER_COUNT) {
+		return -EINVAL;
+	}
+
+	// a query_send already running reads the state rewritten below, wait it out
+	k_work_cancel_delayable_sync(&query_work, &query_sync);
+	query.tier = q.tier;
+	query.from_s = sys_le32_to_cpu(q.from_s);
+	query.to_s = sys_le32_to_cpu(q.to_s);
+	query.cursor = 0;
+	query.seq = 0;
+	query.active = true;
+	k_work_reschedule(&query_work, K_NO_WAIT);
+
+	LOG_INF("query tier %u from %u s to %u s", q.tier, query.from_s, query.to_s);
+	return 0;
+}
@@ -0,0 +1,334 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <math.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/spinlock.h>
+#include "sensor_emul.h"
+#include "sensor_cfg.h"
+#if defined(CONFIG_BOARD_NRF52_BSIM)
+#include "bs_cmd_line.h"
+#include "bs_dynargs.h"
+#include "posix_native_task.h"
+#endif
+
+LOG_MODULE_REGISTER(sensor_emul, LOG_LEVEL_INF);
+
+#define REG_COUNT       0x80
+#define FIFO_BYTES      1024
+
+// not in bma400_defs.h
+#define REG_FIFO_CONFIG_1   0x27
+#define REG_FIFO_CONFIG_2   0x28
+#define CMD_FIFO_FLUSH      0xB0
+
+// INT_STAT0 / INT_CONFIG0 share the bit layout
+#define INT0_GEN1       BIT(2)
+#define INT0_FIFO_FULL  BIT(5)
+#define INT0_FIFO_WM    BIT(6)
+
+static uint8_t regs[REG_COUNT];
+static uint8_t fifo[FIFO_BYTES];
+static uint16_t fifo_len;
+static uint8_t int_stat0;
+static uint32_t sample_n;
+static sensor_emul_irq_t emul_irq;
+static struct k_spinlock lock;
+
+// sensor oscillator error, so every simulated device runs at its own rate
+static int32_t odr_ppm;
+// samples since the timer was (re)started and when that was
+static uint32_t tick_n;
+static uint64_t tick_t0_us;
+
+// when each of the last frames went into the FIFO, for checking timestamps
+static uint64_t frame_us[FIFO_BYTES / 4];
+static uint32_t frames_in;
+
+static void emul_tick(struct k_timer *timer);
+static K_TIMER_DEFINE(emul_timer, emul_tick, NULL);
+
+static void reset_regs(void)
+{
+	memset(regs, 0, sizeof(regs));
+	regs[BMA400_REG_CHIP_ID] = BMA400_CHIP_ID;
+	regs[BMA400_REG_ACCEL_CONFIG_1] = 0x49; // reset value, 100 Hz
+	fifo_len = 0;
+	int_stat0 = 0;
+}
+
+static uint32_t odr_hz(void)
+{
+	uint8_t mode = regs[BMA400_REG_ACCEL_CONFIG_0] & BMA400_POWER_MODE_MSK;
+	uint8_t odr = regs[BMA400_REG_ACCEL_CONFIG_1] & 0x0F;
+
+	if (mode == BMA400_MODE_SLEEP) {
+		return 0;
+	}
+	// low power mode always runs at 25 Hz
+	if (mode == BMA400_MODE_LOW_POWER) {
+		return 25;
+	}
+	if (odr < BMA400_ODR_12_5HZ) {
+		odr = BMA400_ODR_12_5HZ;
+	}
+	return odr == BMA400_ODR_12_5HZ ? 12 : 25U << (odr - BMA400_ODR_25HZ);
+}
+
+// Samples are due at absolute times, so the rate is exact on average instead
+// of the period being rounded to kernel ticks.
+static void arm_next(void)
+{
+	uint32_t hz = odr_hz();
+
+	if (!hz) {
+		return;
+	}
+	k_timer_start(&emul_timer,
+		      K_TIMEOUT_ABS_US(tick_t0_us + (uint64_t)(tick_n + 1) * (1000000 + odr_ppm) / hz),
+		      K_NO_WAIT);
+}
+
+static void restart_timer(void)
+{
+	if (odr_hz()) {
+		tick_t0_us = k_ticks_to_us_floor64(k_uptime_ticks());
+		tick_n = 0;
+		arm_next();
+	} else {
+		k_timer_stop(&emul_timer);
+	}
+}
+
+static uint16_t watermark(void)
+{
+	return regs[REG_FIFO_CONFIG_1] | ((regs[REG_FIFO_CONFIG_2] & 0x07) << 8);
+}
+
+// Still phases sit flat with gravity on z, moving phases look roughly like
+// walking: ~1.5 Hz swing on z and x, slower sway on y. Values are 12 bit at
+// SENSOR_LSB_PER_G, the FIFO format decides how many bits are kept.
+static void next_sample(int16_t xyz[3], bool *moving)
+{
+	uint32_t hz = odr_hz();
+	float t = (float)sample_n / (float)hz;
+	float g = SENSOR_LSB_PER_G;
+	// small deterministic jitter so features/sketches don't see a constant
+	int16_t jitter = (int16_t)((sample_n * 1103515245U + 12345U) >> 28) - 8;
+
+	*moving = ((uint32_t)t / SENSOR_EMUL_PHASE_S) & 1;
+	if (*moving) {
+		xyz[0] = (int16_t)(0.30f * g * sinf(2.0f * 3.14159f * 1.5f * t)) + jitter;
+		xyz[1] = (int16_t)(0.15f * g * sinf(2.0f * 3.14159f * 0.75f * t)) - jitter;
+		xyz[2] = (int16_t)(g + 0.40f * g * sinf(2.0f * 3.14159f * 1.5f * t + 1.0f)) + jitter;
+	} else {
+		xyz[0] = jitter / 4;
+		xyz[1] = -jitter / 4;
+		xyz[2] = (int16_t)g + jitter / 4;
+	}
+	sample_n++;
+}
+
+static void emul_tick(struct k_timer *timer)
+{
+	uint8_t cfg = regs[BMA400_REG_FIFO_CONFIG_0];
+	uint8_t axes = (cfg & BMA400_FIFO_AXES_EN_MSK) >> BMA400_FIFO_AXES_EN_POS;
+	bool bits8 = cfg & BMA400_FIFO_8_BIT_EN;
+	uint8_t frame[7];
+	uint8_t n = 0;
+	int16_t xyz[3];
+	bool moving;
+	bool fire = false;
+
+	ARG_UNUSED(timer);
+
+	tick_n++;
+	next_sample(xyz, &moving);
+
+	K_SPINLOCK(&lock) {
+		uint8_t ien = regs[BMA400_REG_INT_CONF_0];
+		uint16_t wm = watermark();
+		bool was_above = wm && fifo_len >= wm;
+
+		if (moving && (ien & INT0_GEN1)) {
+			// INT1_MAP has the INT_CONFIG0 layout too; edge on a fresh status
+			fire = !(int_stat0 & INT0_GEN1) && (regs[BMA400_REG_INT_MAP] & INT0_GEN1);
+			int_stat0 |= INT0_GEN1;
+		}
+		if (!axes) {
+			K_SPINLOCK_BREAK;
+		}
+
+		frame[n++] = 0x80 | (axes << 1) | (bits8 ? 0 : 0x10);
+		for (int i = 0; i < 3; i++) {
+			if (!(axes & BIT(i))) {
+				continue;
+			}
+			if (bits8) {
+				frame[n++] = (uint8_t)(xyz[i] >> 4);
+			} else {
+				frame[n++] = xyz[i] & 0x0F;
+				frame[n++] = (uint8_t)((xyz[i] >> 4) & 0xFF);
+			}
+		}
+
+		if (fifo_len + n > FIFO_BYTES) {
+			// real part keeps the oldest data and stops writing
+			if (ien & INT0_FIFO_FULL) {
+				int_stat0 |= INT0_FIFO_FULL;
+			}
+		} else {
+			memcpy(&fifo[fifo_len], frame, n);
+			fifo_len += n;
+			frame_us[frames_in++ % ARRAY_SIZE(frame_us)] =
+				k_ticks_to_us_floor64(k_uptime_ticks());
+		}
+
+		if (wm && fifo_len >= wm) {
+			int_stat0 |= INT0_FIFO_WM;
+			// edge triggered like the GPIO: only on the way up
+			fire = fire || (!was_above && (ien & INT0_FIFO_WM));
+		}
+	}
+
+	if (fire && emul_irq) {
+		emul_irq();
+	}
+	arm_next();
+}
+
+static uint8_t read_one(uint8_t reg)
+{
+	uint8_t v;
+
+	switch (reg) {
+	case BMA400_REG_FIFO_LENGTH:
+		return fifo_len & 0xFF;
+	case BMA400_REG_FIFO_LENGTH + 1:
+		return (fifo_len >> 8) & 0x07;
+	case BMA400_REG_INT_STAT0:
+		// status clears on read
+		v = int_stat0;
+		int_stat0 = 0;
+		return v;
+	default:
+		return reg < REG_COUNT ? regs[reg] : 0;
+	}
+}
+
+BMA400_INTF_RET_TYPE sensor_emul_read(uint8_t reg_address, uint8_t *data, uint32_t len, void *intf_ptr)
+{
+	uint8_t reg = reg_address & ~BMA400_SPI_RD_MASK;
+
+	ARG_UNUSED(intf_ptr);
+
+	if (!len) {
+		return BMA400_INTF_RET_SUCCESS;
+	}
+
+	K_SPINLOCK(&lock) {
+		// SPI: the driver asks for one extra byte and drops the first
+		data[0] = 0xFF;
+
+		if (reg == BMA400_REG_FIFO_DATA) {
+			// burst reads of the FIFO don't auto-increment, they pop
+			uint32_t n = MIN(len - 1, fifo_len);
+
+			memcpy(&data[1], fifo, n);
+			memmove(fifo, &fifo[n], fifo_len - n);
+			fifo_len -= n;
+			// reading past the end returns empty frames
+			memset(&data[1 + n], BMA400_FIFO_EMPTY_FRAME, len - 1 - n);
+		} else {
+			for (uint32_t i = 1; i < len; i++) {
+				data[i] = read_one(reg + i - 1);
+			}
+		}
+	}
+
+	return BMA400_INTF_RET_SUCCESS;
+}
+
+BMA400_INTF_RET_TYPE sensor_emul_write(uint8_t reg_address, const uint8_t *data, uint32_t len, void *intf_ptr)
+{
+	bool retime = false;
+
+	ARG_UNUSED(intf_ptr);
+
+	K_SPINLOCK(&lock) {
+		for (uint32_t i = 0; i < len; i++) {
+			uint8_t reg = reg_address + i;
+
+			if (reg >= REG_COUNT) {
+				break;
+			}
+			if (reg == BMA400_REG_COMMAND) {
+				if (data[i] == BMA400_SOFT_RESET_CMD) {
+					reset_regs();
+					retime = true;
+				} else if (data[i] == CMD_FIFO_FLUSH) {
+					fifo_len = 0;
+				}
+				continue;
+			}
+			if (reg == BMA400_REG_ACCEL_CONFIG_0 &&
+			    (regs[reg] & BMA400_POWER_MODE_MSK) != (data[i] & BMA400_POWER_MODE_MSK) &&
+			    (regs[BMA400_REG_FIFO_CONFIG_0] & BMA400_FIFO_AUTO_FLUSH)) {
+				fifo_len = 0;
+			}
+			if (reg == BMA400_REG_ACCEL_CONFIG_0 || reg == BMA400_REG_ACCEL_CONFIG_1) {
+				retime = true;
+			}
+			regs[reg] = data[i];
+		}
+	}
+
+	if (retime) {
+		restart_timer();
+	}
+
+	return BMA400_INTF_RET_SUCCESS;
+}
+
+void sensor_emul_start(sensor_emul_irq_t irq)
+{
+	K_SPINLOCK(&lock) {
+		reset_regs();
+		sample_n = 0;
+		emul_irq = irq;
+	}
+	LOG_INF("emulated BMA400, %d s still / %d s moving, ODR %+d ppm", SENSOR_EMUL_PHASE_S,
+		SENSOR_EMUL_PHASE_S, odr_ppm);
+}
+
+uint64_t sensor_emul_frame_time_us(uint32_t frame)
+{
+	uint64_t t = 0;
+
+	K_SPINLOCK(&lock) {
+		if (frame < frames_in && frames_in - frame <= ARRAY_SIZE(frame_us)) {
+			t = frame_us[frame % ARRAY_SIZE(frame_us)];
+		}
+	}
+	return t;
+}
+
+#if defined(CONFIG_BOARD_NRF52_BSIM)
+static void add_args(void)
+{
+	static bs_args_struct_t args[] = {
+		{ .option = "odr_ppm", .name = "ppm", .type = 'i', .dest = &odr_ppm,
+		  .descript = "oscillator error of the emulated BMA400 in ppm (default 0)" },
+		ARG_TABLE_ENDMARKER
+	};
+
+	bs_add_extra_dynargs(args);
+}
+
+NATIVE_TASK(add_args, PRE_BOOT_1, 10);
+#endif
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "sensor_seq.h"
+#include "bma400.h"
+#include "spi_trace.h"
+#include "timeline.h"
+
+LOG_MODULE_REGISTER(sensor_seq, LOG_LEVEL_INF);
+
+// the drains run every processing stage, keep it big enough for NN code
+#define SENSOR_Q_STACK_SIZE  8192
+#define SENSOR_Q_PRIORITY    7
+
+K_THREAD_STACK_DEFINE(sensor_q_stack, SENSOR_Q_STACK_SIZE);
+static struct k_work_q sensor_q;
+
+static struct bma400_dev *bma;
+static void (*bus_on)(void);
+static void (*bus_off)(void);
+
+static struct {
+	const struct sensor_seq_step *steps;
+	uint8_t n;
+	uint8_t pc;
+	sensor_seq_done_t done;
+	bool busy;
+} seq;
+
+static void seq_run(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(seq_work, seq_run);
+
+static int8_t step_exec(const struct sensor_seq_step *st)
+{
+	uint8_t v = st->val;
+	int8_t rslt = BMA400_OK;
+
+	switch (st->op) {
+	case SENSOR_SEQ_UPDATE:
+		rslt = SPI_TRACED(bma400_get_regs, st->reg, &v, 1, bma);
+		v = (v & ~st->mask) | (st->val & st->mask);
+		/* fall through */
+	case SENSOR_SEQ_WRITE:
+		if (rslt == BMA400_OK) {
+			rslt = SPI_TRACED(bma400_set_regs, st->reg, &v, 1, bma);
+		}
+		break;
+	case SENSOR_SEQ_READ:
+		rslt = SPI_TRACED(bma400_get_regs, st->reg, &v, 1, bma);
+		break;
+	case SENSOR_SEQ_CALL:
+		rslt = st->fn();
+		break;
+	default:
+		break;
+	}
+	return rslt;
+}
+
+// Runs steps up to the next wait or the end, with the bus up only for that.
+static void seq_run(struct k_work *work)
+{
+	int8_t rslt = BMA400_OK;
+
+	bus_on();
+	while (seq.pc < seq.n) {
+		const struct sensor_seq_step *st = &seq.steps[seq.pc++];
+
+		timeline_mark(TL_SEQ_STEP, seq.pc - 1);
+		if (st->op == SENSOR_SEQ_WAIT) {
+			bus_off();
+			k_work_reschedule_for_queue(&sensor_q, &seq_work, K_USEC(st->us));
+			return;
+		}
+		rslt = step_exec(st);
+		if (rslt != BMA400_OK) {
+			LOG_ERR("step %u failed (%d)", seq.pc - 1, rslt);
+			break;
+		}
+	}
+	bus_off();
+
+	// cleared first, so done() may start the next one
+	seq.busy = false;
+	if (seq.done) {
+		seq.done(rslt);
+	}
+}
+
+void sensor_seq_init(struct bma400_dev *dev, void (*on)(void), void (*off)(void))
+{
+	struct k_work_queue_config cfg = { .name = "sensor" };
+
+	bma = dev;
+	bus_on = on;
+	bus_off = off;
+	k_work_queue_start(&sensor_q, sensor_q_stack, K_THREAD_STACK_SIZEOF(sensor_q_stack),
+			   SENSOR_Q_PRIORITY, &cfg);
+}
+
+struct k_work_q *sensor_seq_queue(void)
+{
+	return &sensor_q;
+}
+
+// only called from the queue itself, so no lock around seq
+int sensor_seq_start(const struct sensor_seq_step *steps, uint8_t n, sensor_seq_done_t done)
+{
+	if (seq.busy) {
+		return -EBUSY;
+	}
+	seq.steps = steps;
+	seq.n = n;
+	seq.pc = 0;
+	seq.done = done;
+	seq.busy = true;
+	k_work_reschedule_for_queue(&sensor_q, &seq_work, K_NO_WAIT);
+	return 0;
+}
+
+bool sensor_seq_busy(void)
+{
+	return seq.busy;
+}
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+#include "sketch.h"
+#include "accel_svc.h"
+#include "fixmath.h"
+
+LOG_MODULE_REGISTER(sketch, LOG_LEVEL_INF);
+
+// 32 bit counts, an hour at 25 Hz is already 90000 samples
+struct log_hist {
+	uint32_t n[SKETCH_BUCKETS];
+	uint32_t total;
+};
+
+static struct log_hist mag_hist;
+static struct log_hist rms_hist[3];
+static uint16_t mag_max;
+static uint32_t period_s = CONFIG_APP_SKETCH_PERIOD_S;
+static uint32_t period_start_s;
+static bool started;
+
+static struct sketch_snapshot snaps[SKETCH_SNAPSHOTS];
+static uint8_t snap_head;
+static uint8_t snap_used;
+
+// values below 4 get their own bucket, above that 4 buckets per octave
+static uint8_t log_bucket(uint32_t v)
+{
+	if (v < 4) {
+		return v;
+	}
+
+	int msb = 31 - __builtin_clz(v);
+	uint32_t sub = (v >> (msb - 2)) & 3;
+
+	return MIN((msb - 1) * 4 + sub, SKETCH_BUCKETS - 1);
+}
+
+uint16_t sketch_bucket_value(uint8_t bucket)
+{
+	if (bucket < 4) {
+		return bucket;
+	}
+	return (4 + (bucket & 3)) << (bucket / 4 - 1);
+}
+
+static void hist_add(struct log_hist *h, uint32_t v)
+{
+	h->n[log_bucket(v)]++;
+	h->total++;
+}
+
+static uint8_t hist_quantile(const struct log_hist *h, uint32_t permille)
+{
+	uint32_t rank = (uint64_t)h->total * permille / 1000;
+	uint32_t cum = 0;
+
+	for (int b = 0; b < SKETCH_BUCKETS; b++) {
+		cum += h->n[b];
+		if (cum > rank) {
+			return b;
+		}
+	}
+	return SKETCH_BUCKETS - 1;
+}
+
+static uint8_t hist_max(const struct log_hist *h)
+{
+	for (int b = SKETCH_BUCKETS - 1; b > 0; b--) {
+		if (h->n[b]) {
+			return b;
+		}
+	}
+	return 0;
+}
+
+static void flush_snapshots(void)
+{
+	while (snap_used && accel_svc_subscribed(ACCEL_STREAM_SKETCH)) {
+		uint8_t tail = (snap_head + SKETCH_SNAPSHOTS - snap_used) % SKETCH_SNAPSHOTS;
+
+		if (accel_svc_send(ACCEL_STREAM_SKETCH, &snaps[tail], sizeof(snaps[tail]))) {
+			break;
+		}
+		snap_used--;
+	}
+}
+
+static void publish(void)
+{
+	struct sketch_snapshot *s = &snaps[snap_head];
+
+	s->start_s = sys_cpu_to_le32(period_start_s);
+	s->samples = sys_cpu_to_le32(mag_hist.total);
+	s->mag_p50 = hist_quantile(&mag_hist, 500);
+	s->mag_p95 = hist_quantile(&mag_hist, 950);
+	s->mag_max = sys_cpu_to_le16(mag_max);
+	for (int a = 0; a < 3; a++) {
+		s->rms[a][0] = hist_quantile(&rms_hist[a], 500);
+		s->rms[a][1] = hist_quantile(&rms_hist[a], 950);
+		s->rms[a][2] = hist_max(&rms_hist[a]);
+	}
+
+	LOG_INF("sketch: %u samples, |a| p50 %u p95 %u max %u LSB", mag_hist.total,
+		sketch_bucket_value(s->mag_p50), sketch_bucket_value(s->mag_p95), mag_max);
+
+	snap_head = (snap_head + 1) % SKETCH_SNAPSHOTS;
+	snap_used = MIN(snap_used + 1, SKETCH_SNAPSHOTS);
+
+	memset(&mag_hist, 0, sizeof(mag_hist));
+	memset(rms_hist, 0, sizeof(rms_hist));
+	mag_max = 0;
+}
+
+void sketch_set_period(uint32_t seconds)
+{
+	period_s = MAX(seconds, 1);
+}
+
+void sketch_process(const struct bma400_fifo_sensor_data *samples, uint16_t count)
+{
+	uint32_t now_s = k_uptime_get_32() / 1000;
+	int32_t sum[3] = { 0 };
+	uint32_t sq[3] = { 0 };
+
+	if (!started) {
+		period_start_s = now_s;
+		started = true;
+	} else if (now_s - period_start_s >= period_s) {
+		publish();
+		period_start_s = now_s;
+	}
+
+	if (!count) {
+		return;
+	}
+
+	for (int i = 0; i < count; i++) {
+		const int32_t v[3] = { samples[i].x, samples[i].y, samples[i].z };
+		uint32_t m2 = 0;
+
+		for (int a = 0; a < 3; a++) {
+			m2 += v[a] * v[a];
+			sum[a] += v[a];
+			sq[a] += v[a] * v[a];
+		}
+
+		uint32_t mag = isqrt32(m2);
+
+		hist_add(&mag_hist, mag);
+		mag_max = MAX(mag_max, mag);
+	}
+
+	// RMS around the batch mean: var = E[x^2] - E[x]^2
+	for (int a = 0; a < 3; a++) {
+		int32_t mean = sum[a] / count;
+		int32_t var = (int32_t)(sq[a] / count) - mean * mean;
+
+		hist_add(&rms_hist[a], isqrt32(MAX(var, 0)));
+	}
+
+	flush_snapshots();
+}
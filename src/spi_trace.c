@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/util.h>
+#include "spi_trace.h"
+#include "cyccnt.h"
+
+#if defined(CONFIG_SHELL)
+#include <zephyr/shell/shell.h>
+#endif
+
+struct spi_trace_entry {
+	const char *api;
+	uint8_t reg;                // with the read bit
+	uint32_t n;
+	uint32_t bytes;
+	uint64_t cycles;
+	uint32_t max_cycles;
+	uint32_t hist[SPI_TRACE_HIST_BUCKETS];
+};
+
+static struct k_spinlock lock;
+static struct spi_trace_entry entries[SPI_TRACE_ENTRIES];
+static uint8_t used;
+static uint8_t last_hit;
+static uint32_t dropped;
+
+// Every driver call runs on the sensor queue (sensor_seq.h), bring-up
+// included, so one tag is enough.
+static const char *current_api = "-";
+
+const char *spi_trace_api_enter(const char *api)
+{
+	const char *prev = current_api;
+
+	current_api = api;
+	return prev;
+}
+
+void spi_trace_api_exit(const char *prev)
+{
+	current_api = prev;
+}
+
+uint32_t spi_trace_begin(void)
+{
+	return cyccnt_get();
+}
+
+static uint8_t hist_bucket(uint32_t us)
+{
+	uint8_t b = 0;
+
+	for (us /= SPI_TRACE_HIST_MIN_US; us && b < SPI_TRACE_HIST_BUCKETS - 1; us >>= 1) {
+		b++;
+	}
+	return b;
+}
+
+static struct spi_trace_entry *lookup(const char *api, uint8_t reg)
+{
+	struct spi_trace_entry *e = &entries[last_hit];
+
+	// the same register is usually hit many times in a row (FIFO, polling)
+	if (last_hit < used && e->api == api && e->reg == reg) {
+		return e;
+	}
+	for (uint8_t i = 0; i < used; i++) {
+		if (entries[i].api == api && entries[i].reg == reg) {
+			last_hit = i;
+			return &entries[i];
+		}
+	}
+	if (used == SPI_TRACE_ENTRIES) {
+		return NULL;
+	}
+	e = &entries[used];
+	e->api = api;
+	e->reg = reg;
+	last_hit = used++;
+	return e;
+}
+
+void spi_trace_end(uint32_t t0, uint8_t reg, uint32_t len)
+{
+	uint32_t cycles = cyccnt_get() - t0;
+
+	K_SPINLOCK(&lock) {
+		struct spi_trace_entry *e = lookup(current_api, reg);
+
+		if (!e) {
+			dropped++;
+			K_SPINLOCK_BREAK;
+		}
+		e->n++;
+		e->bytes += len;
+		e->cycles += cycles;
+		e->max_cycles = MAX(e->max_cycles, cycles);
+		e->hist[hist_bucket(cyccnt_to_us(cycles))]++;
+	}
+}
+
+void spi_trace_dump(void)
+{
+	static struct spi_trace_entry snap[SPI_TRACE_ENTRIES];
+	uint8_t order[SPI_TRACE_ENTRIES];
+	uint8_t n = 0;
+	uint32_t lost = 0;
+	uint64_t total = 0;
+
+	K_SPINLOCK(&lock) {
+		n = used;
+		lost = dropped;
+		memcpy(snap, entries, n * sizeof(snap[0]));
+	}
+
+	// insertion sort by total bus time, at most SPI_TRACE_ENTRIES of them
+	for (uint8_t i = 0; i < n; i++) {
+		uint8_t j = i;
+
+		total += snap[i].cycles;
+		for (; j > 0 && snap[order[j - 1]].cycles < snap[i].cycles; j--) {
+			order[j] = order[j - 1];
+		}
+		order[j] = i;
+	}
+
+	printk("spi_trace: %u entries, %u us bus time, %u transfers not counted\n", n,
+	       cyccnt_to_us((uint32_t)MIN(total, UINT32_MAX)), lost);
+	printk("%-28s %-6s %8s %8s %10s %6s %6s %5s\n", "api", "reg", "n", "bytes", "total_us",
+	       "avg_us", "max_us", "%");
+	for (uint8_t i = 0; i < n; i++) {
+		const struct spi_trace_entry *e = &snap[order[i]];
+		uint32_t total_us = cyccnt_to_us((uint32_t)MIN(e->cycles, UINT32_MAX));
+
+		printk("%-28s %c 0x%02x %8u %8u %10u %6u %6u %5u\n", e->api,
+		       e->reg & BIT(7) ? 'R' : 'W', e->reg & 0x7f, e->n, e->bytes, total_us,
+		       cyccnt_to_us((uint32_t)(e->cycles / e->n)), cyccnt_to_us(e->max_cycles),
+		       total ? (uint32_t)(e->cycles * 100 / total) : 0);
+		printk("%35s", "us <");
+		for (int b = 0; b < SPI_TRACE_HIST_BUCKETS; b++) {
+			if (b == SPI_TRACE_HIST_BUCKETS - 1) {
+				printk(" inf:%u", e->hist[b]);
+			} else {
+				printk(" %u:%u", SPI_TRACE_HIST_MIN_US << b, e->hist[b]);
+			}
+		}
+		printk("\n");
+	}
+}
+
+void spi_trace_reset(void)
+{
+	K_SPINLOCK(&lock) {
+		memset(entries, 0, sizeof(entries));
+		used = 0;
+		last_hit = 0;
+		dropped = 0;
+	}
+}
+
+#if defined(CONFIG_SHELL)
+static int cmd_dump(const struct shell *sh, size_t argc, char **argv)
+{
+	spi_trace_dump();
+	return 0;
+}
+
+static int cmd_reset(const struct shell *sh, size_t argc, char **argv)
+{
+	spi_trace_reset();
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_spi_trace,
+	SHELL_CMD(dump, NULL, "List register accesses by total bus time", cmd_dump),
+	SHELL_CMD(reset, NULL, "Clear the counters", cmd_reset),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(spi_trace, &sub_spi_trace, "SPI transfers per register and API", NULL);
+#endif
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "stage_prof.h"
+#include "cyccnt.h"
+
+LOG_MODULE_REGISTER(stage_prof, LOG_LEVEL_INF);
+
+static const char *const stage_names[STAGE_COUNT] = {
+	"drain", "ring", "sync", "actigraphy", "rollup", "gravity", "wake", "wear", "sketch",
+	"reduce", "features", "events", "diag",
+};
+
+static struct stage_stats stats[STAGE_COUNT];
+
+uint32_t stage_prof_mark(enum stage stage, uint32_t t0)
+{
+	uint32_t now = cyccnt_get();
+	uint32_t cycles = now - t0;
+	struct stage_stats *st = &stats[stage];
+
+	st->n++;
+	st->sum_cycles += cycles;
+	if (cycles > st->max_cycles) {
+		st->max_cycles = cycles;
+	}
+
+	return now;
+}
+
+void stage_prof_get(enum stage stage, struct stage_stats *out)
+{
+	*out = stats[stage];
+}
+
+const char *stage_prof_name(enum stage stage)
+{
+	return stage_names[stage];
+}
+
+void stage_prof_reset(void)
+{
+	memset(stats, 0, sizeof(stats));
+}
+
+void stage_prof_report(void)
+{
+	for (int s = 0; s < STAGE_COUNT; s++) {
+		const struct stage_stats *st = &stats[s];
+
+		if (!st->n) {
+			continue;
+		}
+		LOG_INF("stage %-10s n %u avg %u us max %u us", stage_names[s], st->n,
+			cyccnt_to_us((uint32_t)(st->sum_cycles / st->n)), cyccnt_to_us(st->max_cycles));
+	}
+}
@@ -0,0 +1,332 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+#include "timeline.h"
+
+#if defined(CONFIG_SEGGER_SYSTEMVIEW)
+#include <SEGGER_SYSVIEW.h>
+#elif defined(CONFIG_PERCEPIO_TRACERECORDER)
+#include <trcRecorder.h>
+#elif defined(CONFIG_TRACING_CTF)
+#include <zephyr/tracing/tracing.h>
+#else
+#include "cyccnt.h"
+#if defined(CONFIG_CPU_CORTEX_M)
+#include <cmsis_core.h> // __get_IPSR()
+#endif
+#if defined(CONFIG_USE_SEGGER_RTT)
+#include <SEGGER_RTT.h>
+#endif
+#endif
+
+LOG_MODULE_REGISTER(timeline, LOG_LEVEL_INF);
+
+static const char *const ev_names[TL_EV_COUNT] = {
+	[TL_BMA_IRQ] = "bma_irq",
+	[TL_SEM_GIVE] = "sem_give",
+	[TL_SEM_TAKE] = "sem_take",
+	[TL_SPI] = "spi",
+	[TL_FIFO_READ] = "fifo_read",
+	[TL_DECODE] = "decode",
+	[TL_PROCESS] = "process",
+	[TL_ENCODE] = "encode",
+	[TL_NOTIFY] = "notify",
+	[TL_NOTIFY_DONE] = "notify_done",
+	[TL_TRIGGER] = "trigger",
+	[TL_SEQ_STEP] = "seq_step",
+};
+
+#if defined(CONFIG_SEGGER_SYSTEMVIEW)
+
+// Marker names only reach a host that is already connected, otherwise the
+// markers show up by number (enum timeline_ev).
+static int timeline_init(void)
+{
+	for (int ev = 0; ev < TL_EV_COUNT; ev++) {
+		SEGGER_SYSVIEW_NameMarker(ev, ev_names[ev]);
+	}
+	return 0;
+}
+
+void timeline_begin(enum timeline_ev ev, uint16_t arg)
+{
+	SEGGER_SYSVIEW_MarkStart(ev);
+}
+
+void timeline_end(enum timeline_ev ev, uint16_t arg)
+{
+	SEGGER_SYSVIEW_MarkStop(ev);
+}
+
+void timeline_mark(enum timeline_ev ev, uint16_t arg)
+{
+	SEGGER_SYSVIEW_Mark(ev);
+}
+
+void timeline_trigger(void)
+{
+	SEGGER_SYSVIEW_Warn("timeline trigger");
+}
+
+#elif defined(CONFIG_PERCEPIO_TRACERECORDER)
+
+// one user event channel per event, so Tracealyzer can filter on them
+static TraceStringHandle_t channels[TL_EV_COUNT];
+
+static int timeline_init(void)
+{
+	for (int ev = 0; ev < TL_EV_COUNT; ev++) {
+		xTraceStringRegister(ev_names[ev], &channels[ev]);
+	}
+	return 0;
+}
+
+void timeline_begin(enum timeline_ev ev, uint16_t arg)
+{
+	xTracePrintF(channels[ev], "begin %d", arg);
+}
+
+void timeline_end(enum timeline_ev ev, uint16_t arg)
+{
+	xTracePrintF(channels[ev], "end %d", arg);
+}
+
+void timeline_mark(enum timeline_ev ev, uint16_t arg)
+{
+	xTracePrintF(channels[ev], "mark %d", arg);
+}
+
+void timeline_trigger(void)
+{
+	xTracePrint(channels[TL_TRIGGER], "trigger");
+}
+
+#elif defined(CONFIG_TRACING_CTF)
+
+// arg0: 0 begin, 1 end, 2 mark, arg1: the argument
+static int timeline_init(void)
+{
+	return 0;
+}
+
+void timeline_begin(enum timeline_ev ev, uint16_t arg)
+{
+	sys_trace_named_event(ev_names[ev], 0, arg);
+}
+
+void timeline_end(enum timeline_ev ev, uint16_t arg)
+{
+	sys_trace_named_event(ev_names[ev], 1, arg);
+}
+
+void timeline_mark(enum timeline_ev ev, uint16_t arg)
+{
+	sys_trace_named_event(ev_names[ev], 2, arg);
+}
+
+void timeline_trigger(void)
+{
+	timeline_mark(TL_TRIGGER, 0);
+}
+
+#else
+
+// record types, tools/timeline/metadata has the same numbers
+enum {
+	REC_BEGIN,
+	REC_END,
+	REC_MARK,
+	REC_SWITCHED_IN,   // arg = thread id
+	REC_SWITCHED_OUT,
+	REC_ISR_ENTER,     // arg = IRQ number
+	REC_ISR_EXIT,
+	REC_IDLE,
+};
+
+struct tl_rec {
+	uint32_t cyc;
+	uint8_t type;
+	uint8_t ev;
+	uint16_t arg;
+};
+
+BUILD_ASSERT(sizeof(struct tl_rec) == 8);
+
+#define RING_LEN         CONFIG_APP_TIMELINE_RECORDS
+#define POST_TRIGGER     (RING_LEN / 4)
+#define DUMP_TIMEOUT_MS  2000
+
+static struct tl_rec ring[RING_LEN];
+static atomic_t head;        // records since the last restart
+static atomic_t stop_at;     // head to stop at, 0 while no trigger is pending
+static atomic_t stopped;
+static atomic_t dump_queued;
+
+static void dump(struct k_work *work);
+K_WORK_DEFINE(dump_work, dump);
+
+// The kernel hooks run inside the scheduler, where submitting work isn't
+// allowed, so only pipeline events queue the dump.
+static void put(uint8_t type, uint8_t ev, uint16_t arg, bool can_submit)
+{
+	if (!atomic_get(&stopped)) {
+		atomic_val_t n = atomic_inc(&head);
+		struct tl_rec *rec = &ring[(uint32_t)n % RING_LEN];
+		atomic_val_t stop = atomic_get(&stop_at);
+
+		rec->cyc = cyccnt_get();
+		rec->type = type;
+		rec->ev = ev;
+		rec->arg = arg;
+		if (!stop || n + 1 < stop) {
+			return;
+		}
+		atomic_set(&stopped, 1);
+	}
+	if (can_submit && atomic_cas(&dump_queued, 0, 1)) {
+		k_work_submit(&dump_work);
+	}
+}
+
+static uint16_t thread_id(k_tid_t thread)
+{
+	return (uint16_t)((uintptr_t)thread >> 2);
+}
+
+static void list_thread(const struct k_thread *thread, void *user_data)
+{
+	const char *name = k_thread_name_get((k_tid_t)thread);
+
+	LOG_INF("thread %04x %s", thread_id((k_tid_t)thread), name ? name : "?");
+}
+
+#if defined(CONFIG_USE_SEGGER_RTT)
+static uint8_t rtt_buf[1024];
+
+static void rtt_write(const void *data, uint32_t len)
+{
+	const uint8_t *p = data;
+	int64_t until = k_uptime_get() + DUMP_TIMEOUT_MS;
+
+	// nothing reads the channel without a host attached, don't wait forever
+	while (len && k_uptime_get() < until) {
+		unsigned int n = SEGGER_RTT_Write(CONFIG_APP_TIMELINE_RTT_CHANNEL, p, len);
+
+		p += n;
+		len -= n;
+		if (len) {
+			k_msleep(1);
+		}
+	}
+}
+#endif
+
+static void dump(struct k_work *work)
+{
+	uint32_t n = atomic_get(&head);
+	uint32_t count = MIN(n, RING_LEN);
+	uint32_t first = (n - count) % RING_LEN;
+
+	LOG_INF("timeline: %u records", count);
+	k_thread_foreach(list_thread, NULL);
+
+#if defined(CONFIG_USE_SEGGER_RTT)
+	// oldest first: from the slot after the newest to the end, then the start
+	if (first + count > RING_LEN) {
+		rtt_write(&ring[first], (RING_LEN - first) * sizeof(ring[0]));
+		rtt_write(&ring[0], (first + count - RING_LEN) * sizeof(ring[0]));
+	} else {
+		rtt_write(&ring[first], count * sizeof(ring[0]));
+	}
+#else
+	ARG_UNUSED(first);
+	LOG_WRN("no RTT, timeline dropped");
+#endif
+
+	atomic_set(&stop_at, 0);
+	atomic_set(&head, 0);
+	atomic_set(&dump_queued, 0);
+	atomic_set(&stopped, 0);
+}
+
+static int timeline_init(void)
+{
+	cyccnt_init();
+#if defined(CONFIG_USE_SEGGER_RTT)
+	SEGGER_RTT_ConfigUpBuffer(CONFIG_APP_TIMELINE_RTT_CHANNEL, "timeline", rtt_buf,
+				  sizeof(rtt_buf), SEGGER_RTT_MODE_NO_BLOCK_TRIM);
+#endif
+	return 0;
+}
+
+void timeline_begin(enum timeline_ev ev, uint16_t arg)
+{
+	put(REC_BEGIN, ev, arg, true);
+}
+
+void timeline_end(enum timeline_ev ev, uint16_t arg)
+{
+	put(REC_END, ev, arg, true);
+}
+
+void timeline_mark(enum timeline_ev ev, uint16_t arg)
+{
+	put(REC_MARK, ev, arg, true);
+}
+
+void timeline_trigger(void)
+{
+	// a second trigger before the dump doesn't move the stop point
+	if (atomic_cas(&stop_at, 0, atomic_get(&head) + POST_TRIGGER)) {
+		LOG_WRN("timeline triggered");
+	}
+	put(REC_MARK, TL_TRIGGER, 0, true);
+}
+
+#if defined(CONFIG_TRACING_USER)
+static uint16_t irq_number(void)
+{
+#if defined(CONFIG_CPU_CORTEX_M)
+	return __get_IPSR() - 16;
+#else
+	return 0;
+#endif
+}
+
+void sys_trace_thread_switched_in_user(void)
+{
+	put(REC_SWITCHED_IN, 0, thread_id(k_current_get()), false);
+}
+
+void sys_trace_thread_switched_out_user(void)
+{
+	put(REC_SWITCHED_OUT, 0, thread_id(k_current_get()), false);
+}
+
+void sys_trace_isr_enter_user(int nested_interrupts)
+{
+	put(REC_ISR_ENTER, 0, irq_number(), false);
+}
+
+void sys_trace_isr_exit_user(int nested_interrupts)
+{
+	put(REC_ISR_EXIT, 0, irq_number(), false);
+}
+
+void sys_trace_idle_user(void)
+{
+	put(REC_IDLE, 0, 0, false);
+}
+#endif
+
+#endif
+
+SYS_INIT(timeline_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -0,0 +1,509 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/gap.h>
+#include "timesync.h"
+#include "accel_svc.h"
+#include "resample.h"
+#include "power_gov.h"
+#if defined(CONFIG_APP_SENSOR_EMUL) && defined(CONFIG_ARCH_POSIX)
+#include "sensor_emul.h"
+#endif
+
+LOG_MODULE_REGISTER(timesync, LOG_LEVEL_INF);
+
+// rates are dy/dx in Q20
+#define RATE_SHIFT      20
+// loop gains: offset moves by err/4, rate by err/32 per update
+#define PHASE_DIV       4
+#define FREQ_DIV        32
+// how far a rate may wander from nominal
+#define RATE_RANGE_PCT  5
+
+struct lin_track {
+	int64_t x_a;
+	int64_t y_a;
+	int64_t rate;
+	int64_t rate_nom;
+	uint16_t n;        // updates since (re)acquiring, 0 = nothing yet
+};
+
+static struct k_spinlock lock;
+static struct lin_track sample_clk;  // frame index -> local us
+static struct lin_track ref_clk;     // local us -> hub us
+static uint16_t edge_frames;
+static uint32_t grid_us;
+static int64_t frames_total;
+static int64_t batch_first;
+static int64_t edge_us;
+static bool edge_pending;
+
+static uint16_t beacons;
+static int16_t ref_err_us;
+
+// ACCEL_STREAM_GRID: resampled onto multiples of grid_us (resample.h), the
+// resampler state carried over from one batch to the next
+static struct {
+	struct resampler rs;
+	int64_t last;           // index of the last sample in buf
+	uint8_t buf[ACCEL_SVC_MAX_PAYLOAD];
+	uint8_t count;
+} grid;
+
+static int64_t local_us(void)
+{
+	return k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+static int64_t track_at(const struct lin_track *tr, int64_t x)
+{
+	return tr->y_a + (((x - tr->x_a) * tr->rate) >> RATE_SHIFT);
+}
+
+static bool track_locked(const struct lin_track *tr)
+{
+	return tr->n >= TIMESYNC_LOCK_UPDATES;
+}
+
+static void track_init(struct lin_track *tr, int64_t rate_nom)
+{
+	*tr = (struct lin_track){ .rate = rate_nom, .rate_nom = rate_nom };
+}
+
+// alpha-beta update with a new (x, y) pair, returns the residual
+static int64_t track_update(struct lin_track *tr, int64_t x, int64_t y, int64_t step)
+{
+	int64_t dx = x - tr->x_a;
+	int64_t err = 0;
+	int64_t range = tr->rate_nom / 100 * RATE_RANGE_PCT;
+
+	if (tr->n == 1 && dx > 0) {
+		// second point: the rate may be far off nominal, take it from the two
+		int64_t rate = ((y - tr->y_a) << RATE_SHIFT) / dx;
+
+		if (rate >= tr->rate_nom - range && rate <= tr->rate_nom + range) {
+			tr->rate = rate;
+			tr->x_a = x;
+			tr->y_a = y;
+			tr->n++;
+			return 0;
+		}
+		tr->n = 0;
+	} else if (tr->n) {
+		err = y - track_at(tr, x);
+		if (dx <= 0 || err > step || err < -step) {
+			// lost frames or beacons, start over from here
+			tr->n = 0;
+		}
+	}
+	if (!tr->n) {
+		tr->x_a = x;
+		tr->y_a = y;
+		tr->n = 1;
+		return err;
+	}
+
+	tr->y_a = track_at(tr, x) + err / PHASE_DIV;
+	tr->x_a = x;
+	tr->rate += (err << RATE_SHIFT) / dx / FREQ_DIV;
+	tr->rate = CLAMP(tr->rate, tr->rate_nom - range, tr->rate_nom + range);
+	if (tr->n < UINT16_MAX) {
+		tr->n++;
+	}
+	return err;
+}
+
+// hub time if the hub clock is known, local time otherwise
+static int64_t to_ref(const struct lin_track *ref, int64_t local)
+{
+	return ref->n ? track_at(ref, local) : local;
+}
+
+void timesync_config(uint32_t odr_hz, uint16_t frames)
+{
+	K_SPINLOCK(&lock) {
+		track_init(&sample_clk, ((int64_t)USEC_PER_SEC << RATE_SHIFT) / odr_hz);
+		track_init(&ref_clk, (int64_t)1 << RATE_SHIFT);
+		edge_frames = frames;
+		grid_us = USEC_PER_SEC / odr_hz;
+	}
+	resample_init(&grid.rs, grid_us);
+}
+
+void timesync_set_odr(uint32_t odr_hz, uint16_t frames)
+{
+	K_SPINLOCK(&lock) {
+		int64_t rate_nom = ((int64_t)USEC_PER_SEC << RATE_SHIFT) / odr_hz;
+
+		// Same oscillator, so the error relative to nominal carries over.
+		// The last drained frame stays where it was, the frames after it
+		// come at the new rate; the loop takes up the rest.
+		if (sample_clk.n && frames_total) {
+			int64_t k = frames_total - 1;
+
+			sample_clk.y_a = track_at(&sample_clk, k);
+			sample_clk.x_a = k;
+			int64_t err_q20 = ((sample_clk.rate - sample_clk.rate_nom) << RATE_SHIFT) /
+					  sample_clk.rate_nom;
+
+			sample_clk.rate = rate_nom + ((rate_nom * err_q20) >> RATE_SHIFT);
+		} else {
+			sample_clk.rate = rate_nom;
+		}
+		sample_clk.rate_nom = rate_nom;
+		edge_frames = frames;
+		edge_pending = false;
+	}
+}
+
+void timesync_edge(void)
+{
+	K_SPINLOCK(&lock) {
+		if (!edge_pending) {
+			edge_us = local_us();
+			edge_pending = true;
+		}
+	}
+}
+
+void timesync_drained(uint16_t frames)
+{
+	int64_t k = -1;
+	int64_t ref = 0;
+
+	K_SPINLOCK(&lock) {
+		batch_first = frames_total;
+		// The FIFO was empty after the last drain, so the frame that
+		// crossed the watermark is the edge_frames'th one after it.
+		if (edge_pending && frames >= edge_frames) {
+			k = frames_total + edge_frames - 1;
+			track_update(&sample_clk, k, edge_us, TIMESYNC_SAMPLE_STEP_US);
+			if (track_locked(&sample_clk) && track_locked(&ref_clk)) {
+				ref = track_at(&ref_clk, track_at(&sample_clk, k));
+			}
+		}
+		edge_pending = false;
+		frames_total += frames;
+	}
+
+#if defined(CONFIG_APP_SENSOR_EMUL) && defined(CONFIG_ARCH_POSIX)
+	// ground truth for bsim/run.sh: every device runs on the same simulated time
+	if (ref) {
+		printk("SYNC frame=%lld true_us=%llu ref_us=%lld\n", (long long)k,
+		       (unsigned long long)sensor_emul_frame_time_us(k), (long long)ref);
+	}
+#else
+	ARG_UNUSED(k);
+	ARG_UNUSED(ref);
+#endif
+}
+
+static void grid_flush(void)
+{
+	struct accel_grid_hdr *hdr = (struct accel_grid_hdr *)grid.buf;
+
+	if (!grid.count) {
+		return;
+	}
+	hdr->count = grid.count;
+	accel_svc_send(ACCEL_STREAM_GRID, grid.buf,
+		       sizeof(*hdr) + grid.count * 3 * sizeof(int16_t));
+	grid.count = 0;
+}
+
+static void grid_out(int64_t index, const int16_t xyz[3], void *user)
+{
+	struct accel_grid_hdr *hdr = (struct accel_grid_hdr *)grid.buf;
+	uint8_t *p;
+
+	// a restarted resampler skips grid points, a packet only holds a run
+	if (grid.count && index != grid.last + 1) {
+		grid_flush();
+	}
+	grid.last = index;
+	if (sizeof(*hdr) + (grid.count + 1) * 3 * sizeof(int16_t) > accel_svc_payload_len()) {
+		grid_flush();
+	}
+	if (!grid.count) {
+		hdr->index = sys_cpu_to_le32((uint32_t)index);
+	}
+	p = &grid.buf[sizeof(*hdr) + grid.count * 3 * sizeof(int16_t)];
+	for (int a = 0; a < 3; a++) {
+		sys_put_le16(xyz[a], p + 2 * a);
+	}
+	grid.count++;
+}
+
+void timesync_process(uint16_t seq, const struct bma400_fifo_sensor_data *samples,
+		      uint16_t count)
+{
+	struct lin_track s, r;
+	int64_t first;
+	uint8_t state = 0;
+
+	if (!accel_svc_subscribed(ACCEL_STREAM_SYNC) && !accel_svc_subscribed(ACCEL_STREAM_GRID)) {
+		resample_reset(&grid.rs);
+		return;
+	}
+
+	K_SPINLOCK(&lock) {
+		s = sample_clk;
+		r = ref_clk;
+		first = batch_first;
+		// a drain above FIFO_SAMPLES comes in several blocks
+		batch_first += count;
+	}
+	if (track_locked(&s)) {
+		state |= ACCEL_SYNC_SAMPLE_LOCKED;
+	}
+	if (track_locked(&r)) {
+		state |= ACCEL_SYNC_REF_LOCKED;
+	}
+
+	if (accel_svc_subscribed(ACCEL_STREAM_SYNC)) {
+		struct accel_sync_pkt pkt = {
+			.seq = sys_cpu_to_le16(seq),
+			.count = count,
+			.state = state,
+			.t_ref_us = sys_cpu_to_le32((uint32_t)to_ref(&r, track_at(&s, first))),
+			.period_ns = sys_cpu_to_le32((uint32_t)(
+				(((s.rate * r.rate) >> RATE_SHIFT) * NSEC_PER_USEC) >> RATE_SHIFT)),
+			.ref_err_us = sys_cpu_to_le16(ref_err_us),
+			.beacons = sys_cpu_to_le16(beacons),
+		};
+
+		accel_svc_send(ACCEL_STREAM_SYNC, &pkt, sizeof(pkt));
+	}
+
+	// the grid is only common to all devices once both clocks are known
+	if (!accel_svc_subscribed(ACCEL_STREAM_GRID) ||
+	    state != (ACCEL_SYNC_SAMPLE_LOCKED | ACCEL_SYNC_REF_LOCKED)) {
+		resample_reset(&grid.rs);
+		return;
+	}
+	// every sample at its own time on the hub timeline
+	for (int i = 0; i < count; i++) {
+		int16_t xyz[3] = { samples[i].x, samples[i].y, samples[i].z };
+
+		resample_push(&grid.rs, to_ref(&r, track_at(&s, first + i)), xyz, grid_out, NULL);
+	}
+	grid_flush();
+}
+
+#if defined(CONFIG_APP_TIMESYNC_HUB)
+
+static struct bt_le_per_adv_sync *sync;
+static atomic_t synced;
+static atomic_t paused;
+// scan bursts, only the work item changes these
+static bool scanning;
+static uint32_t backoff_s = TIMESYNC_SCAN_BACKOFF_S;
+static uint32_t beacon_interval_us;
+
+static bool beacon_parse(struct bt_data *data, void *user_data)
+{
+	uint32_t *label = user_data;
+
+	if (data->type == BT_DATA_MANUFACTURER_DATA &&
+	    data->data_len >= sizeof(struct timesync_beacon) &&
+	    sys_get_le16(data->data) == TIMESYNC_COMPANY_ID &&
+	    sys_get_le16(data->data + 2) == TIMESYNC_MAGIC) {
+		*label = sys_get_le32(data->data + offsetof(struct timesync_beacon, label));
+		return false;
+	}
+	return true;
+}
+
+// returns true and the label if buf carries a hub beacon, buf is left as is
+static bool find_beacon(struct net_buf_simple *buf, uint32_t *label)
+{
+	struct net_buf_simple_state state;
+	uint32_t l = UINT32_MAX;
+
+	net_buf_simple_save(buf, &state);
+	bt_data_parse(buf, beacon_parse, &l);
+	net_buf_simple_restore(buf, &state);
+	if (label) {
+		*label = l;
+	}
+	return l != UINT32_MAX;
+}
+
+static void scan_recv(const struct bt_le_scan_recv_info *info, struct net_buf_simple *buf)
+{
+	struct bt_le_per_adv_sync_param param = {
+		.sid = info->sid,
+		.timeout = TIMESYNC_SYNC_TIMEOUT,
+	};
+
+	if (sync || !info->interval || !find_beacon(buf, NULL)) {
+		return;
+	}
+	bt_addr_le_copy(&param.addr, info->addr);
+	if (bt_le_per_adv_sync_create(&param, &sync)) {
+		sync = NULL;
+	}
+}
+
+static struct bt_le_scan_cb scan_cb = {
+	.recv = scan_recv,
+};
+
+static void scan_work_fn(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(scan_work, scan_work_fn);
+
+// Starts a burst, ends it, or waits out the backoff; every change of the
+// sync state comes through here.
+static void scan_work_fn(struct k_work *work)
+{
+	const struct bt_le_scan_param param = BT_LE_SCAN_PARAM_INIT(BT_LE_SCAN_TYPE_PASSIVE,
+		BT_LE_SCAN_OPT_NONE, TIMESYNC_SCAN_INTERVAL, TIMESYNC_SCAN_WINDOW);
+	int err;
+
+	if (atomic_get(&synced)) {
+		if (scanning) {
+			bt_le_scan_stop();
+			scanning = false;
+		}
+		backoff_s = TIMESYNC_SCAN_BACKOFF_S;
+		return;
+	}
+
+	if (scanning) {
+		if (sync && !atomic_get(&paused)) {
+			// found, the sync is being established (or times out)
+			k_work_reschedule(&scan_work, K_MSEC(TIMESYNC_SCAN_BURST_MS));
+			return;
+		}
+		bt_le_scan_stop();
+		scanning = false;
+		power_gov_set_timesync(0, 0);
+		if (atomic_get(&paused)) {
+			backoff_s = TIMESYNC_SCAN_BACKOFF_S;
+			return;
+		}
+		LOG_INF("no hub beacon, next look in %u s", backoff_s);
+		k_work_reschedule(&scan_work, K_SECONDS(backoff_s));
+		backoff_s = MIN(backoff_s * 2, CONFIG_APP_TIMESYNC_SCAN_MAX_S);
+		return;
+	}
+
+	if (atomic_get(&paused)) {
+		// back to streaming starts over with a short backoff
+		backoff_s = TIMESYNC_SCAN_BACKOFF_S;
+		return;
+	}
+	err = bt_le_scan_start(&param, NULL);
+	if (err) {
+		LOG_WRN("hub scan failed to start (err %d)", err);
+		k_work_reschedule(&scan_work, K_SECONDS(backoff_s));
+		return;
+	}
+	scanning = true;
+	power_gov_set_timesync(TIMESYNC_SCAN_WINDOW * 100 / TIMESYNC_SCAN_INTERVAL, 0);
+	k_work_reschedule(&scan_work, K_MSEC(TIMESYNC_SCAN_BURST_MS));
+}
+
+static void sync_synced(struct bt_le_per_adv_sync *s, struct bt_le_per_adv_sync_synced_info *info)
+{
+	beacon_interval_us = info->interval * 1250;
+	atomic_set(&synced, 1);
+	bt_le_scan_stop();
+	power_gov_set_timesync(0, beacon_interval_us / 1000);
+	k_work_reschedule(&scan_work, K_NO_WAIT);
+	LOG_INF("synced to hub beacon, interval %u ms", beacon_interval_us / 1000);
+}
+
+static void sync_term(struct bt_le_per_adv_sync *s, const struct bt_le_per_adv_sync_term_info *info)
+{
+	bool was_synced = atomic_set(&synced, 0);
+
+	sync = NULL;
+	// keep the last rate, but it has to earn the lock again
+	K_SPINLOCK(&lock) {
+		ref_clk.n = MIN(ref_clk.n, 1);
+	}
+	power_gov_set_timesync(0, 0);
+	// lost: look again right away; a sync that never came up ends the burst
+	LOG_WRN("hub beacon %s (reason %u)", was_synced ? "lost" : "not synced", info->reason);
+	k_work_reschedule(&scan_work, K_NO_WAIT);
+}
+
+static void sync_recv(struct bt_le_per_adv_sync *s, const struct bt_le_per_adv_sync_recv_info *info,
+		 struct net_buf_simple *buf)
+{
+	int64_t now = local_us();
+	uint32_t label;
+	int64_t err;
+	bool was_locked, locked;
+
+	if (!beacon_interval_us || !find_beacon(buf, &label)) {
+		return;
+	}
+
+	K_SPINLOCK(&lock) {
+		was_locked = track_locked(&ref_clk);
+		err = track_update(&ref_clk, now, (int64_t)label * beacon_interval_us,
+				   TIMESYNC_REF_STEP_US);
+		locked = track_locked(&ref_clk);
+		ref_err_us = CLAMP(err, INT16_MIN, INT16_MAX);
+		beacons++;
+	}
+	if (locked != was_locked) {
+		LOG_INF("hub clock %s", locked ? "locked" : "lost");
+	}
+}
+
+static struct bt_le_per_adv_sync_cb sync_cb = {
+	.synced = sync_synced,
+	.term = sync_term,
+	.recv = sync_recv,
+};
+
+int timesync_start(void)
+{
+	static bool registered;
+
+	if (!registered) {
+		bt_le_scan_cb_register(&scan_cb);
+		bt_le_per_adv_sync_cb_register(&sync_cb);
+		registered = true;
+	}
+	k_work_reschedule(&scan_work, K_NO_WAIT);
+	return 0;
+}
+
+void timesync_pause(bool pause)
+{
+	if (atomic_set(&paused, pause) == pause) {
+		return;
+	}
+	// paused: the burst in progress ends; back: a look right away
+	k_work_reschedule(&scan_work, K_NO_WAIT);
+}
+
+#else
+
+// no scanner or periodic sync in the build (overlay-timesync.conf adds them)
+int timesync_start(void)
+{
+	LOG_INF("no hub, samples on the local timeline");
+	return 0;
+}
+
+void timesync_pause(bool pause)
+{
+	ARG_UNUSED(pause);
+}
+
+#endif /* CONFIG_APP_TIMESYNC_HUB */
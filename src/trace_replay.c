@@ -0,0 +1,424 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/byteorder.h>
+#include <nsi_host_trampolines.h>
+#include <posix_native_task.h>
+#include <posix_board_if.h>
+#include "cmdline.h"
+#include "trace_replay.h"
+#include "fifo_trace.h"
+#include "accel_svc.h"
+#include "stage_prof.h"
+#include "fifo_deadline.h"
+#include "host_clock.h"
+#include "reduce.h"
+
+LOG_MODULE_REGISTER(trace_replay, LOG_LEVEL_INF);
+
+#define REG_COUNT         0x80
+#define FIFO_BYTES        1024
+// biggest drain we accept from a trace: a full FIFO plus the driver's overread
+#define MAX_DRAIN_BYTES   (FIFO_BYTES + BMA400_FIFO_BYTES_OVERREAD)
+// how long to wait for the firmware to empty the FIFO at the end
+#define END_POLL_MS       100
+
+static char *trace_path;
+static int trace_fd = -1;
+static trace_replay_irq_t replay_irq;
+static struct k_spinlock lock;
+
+static uint8_t regs[REG_COUNT];
+static struct fifo_trace_regs snap;
+static bool have_snap;
+static bool regs_checked;
+
+static uint8_t fifo[FIFO_BYTES];
+static uint16_t fifo_len;
+static uint16_t int_status;
+
+// next drain record, read ahead so it can be scheduled
+static struct fifo_trace_rec next_rec;
+static uint8_t next_data[sizeof(uint16_t) + MAX_DRAIN_BYTES];
+static bool have_next;
+static uint32_t t0_trace;
+static int64_t t0_local;
+static bool t0_set;
+
+static struct {
+	uint32_t headers;
+	uint32_t drains;
+	uint32_t bytes;
+	uint32_t samples;
+	uint32_t overflows;      // FIFO full status recorded on the device
+	uint32_t lost_bytes;     // replay FIFO full: the firmware drained too slowly
+	uint32_t first_ms;
+	uint32_t last_ms;
+	uint64_t wall_start_ns;
+} rs;
+
+static void replay_work_fn(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(replay_work, replay_work_fn);
+static void end_work_fn(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(end_work, end_work_fn);
+
+static void add_cmdline_opts(void)
+{
+	static struct args_struct_t opts[] = {
+		{
+			.option = "trace",
+			.name = "path",
+			.type = 's',
+			.dest = (void *)&trace_path,
+			.descript = "FIFO trace (fifo_trace.h format) to replay",
+		},
+		ARG_TABLE_ENDMARKER
+	};
+
+	native_add_command_line_opts(opts);
+}
+NATIVE_TASK(add_cmdline_opts, PRE_BOOT_1, 1);
+
+static bool read_exact(void *buf, uint32_t len)
+{
+	uint8_t *p = buf;
+
+	while (len) {
+		long n = nsi_host_read(trace_fd, p, len);
+
+		if (n <= 0) {
+			return false;
+		}
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+static bool skip(uint32_t len)
+{
+	uint8_t tmp[32];
+
+	while (len) {
+		uint32_t n = MIN(len, sizeof(tmp));
+
+		if (!read_exact(tmp, n)) {
+			return false;
+		}
+		len -= n;
+	}
+	return true;
+}
+
+// accel frames in a block of FIFO bytes, walking the headers like bma400.c
+static uint32_t count_frames(const uint8_t *p, uint16_t len)
+{
+	uint32_t n = 0;
+
+	for (uint16_t i = 0; i < len;) {
+		uint8_t h = p[i++];
+
+		if ((h & 0xE0) == 0x80 && (h & BMA400_FIFO_DATA_EN_MASK)) {
+			i += __builtin_popcount(h & BMA400_FIFO_DATA_EN_MASK) * ((h & 0x10) ? 2 : 1);
+			n++;
+		} else if (h == BMA400_FIFO_SENSOR_TIME) {
+			i += 3;
+		} else if (h == BMA400_FIFO_CONTROL_FRAME) {
+			i += 1;
+		} else {
+			// empty frame, the rest is padding
+			break;
+		}
+	}
+	return n;
+}
+
+// reads up to and including the next drain record, false at the end
+static bool read_next(void)
+{
+	struct fifo_trace_rec rec;
+
+	while (read_exact(&rec, sizeof(rec))) {
+		uint16_t len = sys_le16_to_cpu(rec.len);
+
+		switch (rec.type) {
+		case FIFO_TRACE_REC_HEADER: {
+			struct fifo_trace_header hdr;
+
+			if (len < sizeof(hdr) || !read_exact(&hdr, sizeof(hdr)) ||
+			    !skip(len - sizeof(hdr))) {
+				return false;
+			}
+			if (sys_le32_to_cpu(hdr.magic) != FIFO_TRACE_MAGIC ||
+			    sys_le16_to_cpu(hdr.version) != FIFO_TRACE_VERSION) {
+				LOG_ERR("not a v%d FIFO trace", FIFO_TRACE_VERSION);
+				return false;
+			}
+			// more than one header = capture restarted after a gap
+			rs.headers++;
+			break;
+		}
+		case FIFO_TRACE_REC_REGS:
+			if (len < sizeof(snap) || !read_exact(&snap, sizeof(snap)) ||
+			    !skip(len - sizeof(snap))) {
+				return false;
+			}
+			have_snap = true;
+			break;
+		case FIFO_TRACE_REC_DRAIN:
+			if (len < sizeof(uint16_t) || len > sizeof(next_data)) {
+				LOG_ERR("bad drain record (%u bytes)", len);
+				return false;
+			}
+			if (!read_exact(next_data, len)) {
+				return false;
+			}
+			next_rec = rec;
+			next_rec.len = len;
+			next_rec.t_ms = sys_le32_to_cpu(rec.t_ms);
+			return true;
+		default:
+			// unknown records are skipped, newer captures may add some
+			if (!skip(len)) {
+				return false;
+			}
+			break;
+		}
+	}
+	return false;
+}
+
+// The trace only replays faithfully if the firmware set the sensor up the
+// way the device was set up when recording, say so if it didn't.
+static void check_regs(void)
+{
+	for (int i = 0; i < sizeof(snap.v); i++) {
+		uint8_t r = snap.first + i;
+
+		if (r < REG_COUNT && regs[r] != snap.v[i]) {
+			LOG_WRN("reg 0x%02x: trace 0x%02x, firmware 0x%02x", r, snap.v[i], regs[r]);
+		}
+	}
+}
+
+static void deliver(void)
+{
+	uint16_t status = sys_get_le16(next_data);
+	const uint8_t *data = next_data + sizeof(uint16_t);
+	uint16_t len = next_rec.len - sizeof(uint16_t);
+	uint16_t n;
+
+	if (have_snap && !regs_checked) {
+		check_regs();
+		regs_checked = true;
+	}
+
+	rs.drains++;
+	rs.bytes += len;
+	rs.samples += count_frames(data, len);
+	if (status & BMA400_ASSERTED_FIFO_FULL_INT) {
+		rs.overflows++;
+	}
+	rs.last_ms = next_rec.t_ms;
+
+	K_SPINLOCK(&lock) {
+		n = MIN(len, FIFO_BYTES - fifo_len);
+		memcpy(&fifo[fifo_len], data, n);
+		fifo_len += n;
+		int_status |= status;
+	}
+	rs.lost_bytes += len - n;
+
+	if (replay_irq) {
+		replay_irq();
+	}
+}
+
+static void report(void)
+{
+	uint64_t wall_us = (host_clock_ns() - rs.wall_start_ns) / 1000;
+	uint32_t trace_ms = rs.last_ms - rs.first_ms;
+
+	printk("REPLAY trace=%s trace_ms=%u wall_ms=%u drains=%u samples=%u bytes=%u "
+	       "samples_per_s=%u restarts=%u fifo_overflows=%u replay_lost_bytes=%u\n",
+	       trace_path, trace_ms, (uint32_t)(wall_us / 1000), rs.drains, rs.samples, rs.bytes,
+	       wall_us ? (uint32_t)((uint64_t)rs.samples * 1000000 / wall_us) : 0,
+	       rs.headers ? rs.headers - 1 : 0, rs.overflows, rs.lost_bytes);
+
+	uint16_t sent[ACCEL_STREAM_COUNT], dropped[ACCEL_STREAM_COUNT];
+
+	accel_svc_get_counts(sent, dropped);
+	for (int s = 0; s < ACCEL_STREAM_COUNT; s++) {
+		uint32_t bytes = accel_svc_get_bytes(s);
+
+		printk("REPLAY stream=%s sent=%u dropped=%u bytes=%u bps=%u\n",
+		       accel_svc_stream_name(s), sent[s], dropped[s], bytes,
+		       trace_ms ? (uint32_t)((uint64_t)bytes * 8000 / trace_ms) : 0);
+	}
+
+	for (int st = 0; st < STAGE_COUNT; st++) {
+		struct stage_stats ss;
+
+		stage_prof_get(st, &ss);
+		if (ss.n) {
+			printk("REPLAY stage=%s n=%u avg_ns=%u max_ns=%u\n", stage_prof_name(st), ss.n,
+			       (uint32_t)(ss.sum_cycles / ss.n), ss.max_cycles);
+		}
+	}
+
+	struct fifo_deadline_stats dl;
+
+	fifo_deadline_get_stats(&dl);
+	printk("REPLAY deadline budget_us=%u drains=%u max_latency_us=%u min_slack_us=%d "
+	       "warnings=%u missed=%u max_fill=%u\n", dl.budget_us, dl.drains, dl.max_latency_us,
+	       dl.drains ? dl.min_slack_us : 0, dl.warnings, dl.missed, dl.max_fill_bytes);
+
+	reduce_report();
+}
+
+static void end_work_fn(struct k_work *work)
+{
+	bool empty;
+
+	K_SPINLOCK(&lock) {
+		empty = fifo_len == 0;
+	}
+	if (!empty) {
+		k_work_reschedule(&end_work, K_MSEC(END_POLL_MS));
+		return;
+	}
+
+	report();
+	nsi_host_close(trace_fd);
+	posix_exit(0);
+}
+
+static void replay_work_fn(struct k_work *work)
+{
+	int64_t due;
+
+	if (have_next) {
+		deliver();
+	}
+
+	have_next = read_next();
+	if (!have_next) {
+		// give the firmware a moment to drain what is left
+		k_work_reschedule(&end_work, K_MSEC(END_POLL_MS));
+		return;
+	}
+
+	if (!t0_set) {
+		t0_trace = next_rec.t_ms;
+		t0_local = k_uptime_get();
+		rs.first_ms = next_rec.t_ms;
+		t0_set = true;
+	}
+
+	due = t0_local + (next_rec.t_ms - t0_trace);
+	k_work_reschedule(&replay_work, K_MSEC(MAX(due - k_uptime_get(), 0)));
+}
+
+static uint8_t read_one(uint8_t reg)
+{
+	uint8_t v;
+
+	switch (reg) {
+	case BMA400_REG_FIFO_LENGTH:
+		return fifo_len & 0xFF;
+	case BMA400_REG_FIFO_LENGTH + 1:
+		return (fifo_len >> 8) & 0x07;
+	case BMA400_REG_INT_STAT0:
+		return int_status & 0xFF;
+	case BMA400_REG_INT_STAT0 + 1:
+		return int_status >> 8;
+	case BMA400_REG_INT_STAT0 + 2:
+		// last status byte is read, status clears
+		v = BMA400_GET_BITS(int_status >> 8, BMA400_INT_STATUS);
+		int_status = 0;
+		return v;
+	default:
+		return reg < REG_COUNT ? regs[reg] : 0;
+	}
+}
+
+BMA400_INTF_RET_TYPE trace_replay_read(uint8_t reg_address, uint8_t *data, uint32_t len, void *intf_ptr)
+{
+	uint8_t reg = reg_address & ~BMA400_SPI_RD_MASK;
+
+	ARG_UNUSED(intf_ptr);
+
+	if (!len) {
+		return BMA400_INTF_RET_SUCCESS;
+	}
+
+	K_SPINLOCK(&lock) {
+		// SPI: the driver asks for one extra byte and drops the first
+		data[0] = 0xFF;
+
+		if (reg == BMA400_REG_FIFO_DATA) {
+			uint32_t n = MIN(len - 1, fifo_len);
+
+			memcpy(&data[1], fifo, n);
+			memmove(fifo, &fifo[n], fifo_len - n);
+			fifo_len -= n;
+			memset(&data[1 + n], BMA400_FIFO_EMPTY_FRAME, len - 1 - n);
+		} else {
+			for (uint32_t i = 1; i < len; i++) {
+				data[i] = read_one(reg + i - 1);
+			}
+		}
+	}
+
+	return BMA400_INTF_RET_SUCCESS;
+}
+
+BMA400_INTF_RET_TYPE trace_replay_write(uint8_t reg_address, const uint8_t *data, uint32_t len, void *intf_ptr)
+{
+	ARG_UNUSED(intf_ptr);
+
+	// config writes are kept so read-modify-write in the driver works, the
+	// data itself comes from the trace regardless
+	K_SPINLOCK(&lock) {
+		for (uint32_t i = 0; i < len && reg_address + i < REG_COUNT; i++) {
+			if (reg_address + i != BMA400_REG_COMMAND) {
+				regs[reg_address + i] = data[i];
+			}
+		}
+	}
+
+	return BMA400_INTF_RET_SUCCESS;
+}
+
+void trace_replay_start(trace_replay_irq_t irq)
+{
+	regs[BMA400_REG_CHIP_ID] = BMA400_CHIP_ID;
+	replay_irq = irq;
+
+	if (!trace_path) {
+		LOG_ERR("no trace, run with --trace=<file>");
+		posix_exit(1);
+	}
+	// 0 = O_RDONLY on every host we build on
+	trace_fd = nsi_host_open(trace_path, 0);
+	if (trace_fd < 0) {
+		LOG_ERR("can't open %s", trace_path);
+		posix_exit(1);
+	}
+
+	// every stage runs, as if a central listened to everything
+	accel_svc_set_sink(true);
+	stage_prof_reset();
+	rs.wall_start_ns = host_clock_ns();
+
+	// let the firmware finish configuring the sensor first
+	k_work_schedule(&replay_work, K_MSEC(500));
+	LOG_INF("replaying %s", trace_path);
+}
@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/util.h>
+#include "wake_tune.h"
+#include "sensor_cfg.h"
+
+LOG_MODULE_REGISTER(wake_tune, LOG_LEVEL_INF);
+
+#define STEP_MG   8
+#define N_DUR     4
+
+// reference low-pass of the sensor (~1 Hz), alpha = w / (w + fs) in Q15
+#define REF_ALPHA_Q15  ((int32_t)(32768LL * 6283 / (6283 + 1000LL * SENSOR_ODR_HZ)))
+
+static const uint8_t durations[N_DUR] = { 1, 2, 4, 8 };
+static const uint8_t hyst_mg[] = {
+	[BMA400_HYST_0_MG] = 0, [BMA400_HYST_24_MG] = 24, [BMA400_HYST_48_MG] = 48, [BMA400_HYST_96_MG] = 96,
+};
+
+static int32_t ref_q15[3];
+static bool primed;
+// samples in a row above each candidate threshold, never increasing with b
+static uint8_t run[WAKE_TUNE_BINS];
+
+// current 1 s window, added to the totals only if it had no real motion
+static uint8_t win_ep[N_DUR][WAKE_TUNE_BINS];
+static uint8_t win_hist[WAKE_TUNE_BINS + 1];   // last bin: everything above
+static uint16_t win_n;
+static uint16_t win_peak_mg;
+
+// since the last tune
+static uint16_t episodes[N_DUR][WAKE_TUNE_BINS];
+static uint32_t hist[WAKE_TUNE_BINS + 1];
+static uint32_t bg_samples;
+static uint32_t all_samples;
+static uint32_t status_batches;
+static uint32_t gen1_hits;
+static uint32_t gen1_still;     // GEN1 in batches without real motion
+static uint32_t gen2_hits;
+static bool tuned;
+
+static bool pending;
+static struct wake_tune_cfg next_cfg;
+
+void wake_tune_defaults(struct wake_tune_cfg *cfg)
+{
+	*cfg = (struct wake_tune_cfg){
+		.act_thres = 0x10,
+		.act_dur = 15,
+		.act_hyst = BMA400_HYST_48_MG,
+		.inact_thres = 0x04,
+		.inact_dur = WAKE_TUNE_INACT_S * SENSOR_ODR_HZ,
+	};
+}
+
+static void close_window(void)
+{
+	if (win_peak_mg < WAKE_TUNE_MOTION_MG) {
+		for (int k = 0; k < N_DUR; k++) {
+			for (int b = 0; b < WAKE_TUNE_BINS; b++) {
+				episodes[k][b] = MIN(episodes[k][b] + win_ep[k][b], UINT16_MAX);
+			}
+		}
+		for (int b = 0; b <= WAKE_TUNE_BINS; b++) {
+			hist[b] += win_hist[b];
+		}
+		bg_samples += win_n;
+	}
+	memset(win_ep, 0, sizeof(win_ep));
+	memset(win_hist, 0, sizeof(win_hist));
+	win_n = 0;
+	win_peak_mg = 0;
+}
+
+static uint8_t percentile_bin(uint32_t pct)
+{
+	uint32_t want = (uint64_t)bg_samples * pct / 100;
+	uint32_t acc = 0;
+
+	for (int b = 0; b <= WAKE_TUNE_BINS; b++) {
+		acc += hist[b];
+		if (acc > want) {
+			return b;
+		}
+	}
+	return WAKE_TUNE_BINS;
+}
+
+static void tune(void)
+{
+	uint32_t bg_s = bg_samples / SENSOR_ODR_HZ;
+	// false wakes the target allows over the background seen
+	uint32_t allowed = WAKE_TUNE_FALSE_PER_HOUR * bg_s / 3600;
+	int pick_b = WAKE_TUNE_BINS - 1;
+	int pick_k = N_DUR - 1;
+	bool found = false;
+
+	// lowest threshold first, sensitivity matters more than latency
+	for (int b = WAKE_TUNE_MIN_MG / STEP_MG; b < WAKE_TUNE_BINS && !found; b++) {
+		for (int k = 0; k < N_DUR && !found; k++) {
+			if (episodes[k][b] <= allowed) {
+				pick_b = b;
+				pick_k = k;
+				found = true;
+			}
+		}
+	}
+
+	uint8_t p50 = percentile_bin(50);
+	uint8_t p99 = percentile_bin(99);
+	uint16_t spread_mg = (p99 - p50) * STEP_MG;
+	int margin_b = MIN(pick_b + 1, WAKE_TUNE_BINS - 1);
+	struct wake_tune_cfg cfg = {
+		.act_thres = pick_b + 1,
+		.act_dur = durations[pick_k],
+		.act_hyst = spread_mg == 0 ? BMA400_HYST_0_MG :
+			    spread_mg <= 24 ? BMA400_HYST_24_MG :
+			    spread_mg <= 48 ? BMA400_HYST_48_MG : BMA400_HYST_96_MG,
+		.inact_thres = p99 + 1,
+		.inact_dur = WAKE_TUNE_INACT_S * SENSOR_ODR_HZ,
+	};
+
+	LOG_INF("background %u s: p50 %u mg p99 %u mg, expect %u false wakes/h", bg_s,
+		p50 * STEP_MG, p99 * STEP_MG,
+		bg_s ? episodes[pick_k][margin_b] * 3600 / bg_s : 0);
+	LOG_INF("GEN1 %u mg x %u samples, hyst %u mg; GEN2 %u mg x %u samples",
+		cfg.act_thres * STEP_MG, cfg.act_dur, hyst_mg[cfg.act_hyst], cfg.inact_thres * STEP_MG,
+		cfg.inact_dur);
+
+	next_cfg = cfg;
+	pending = true;
+	tuned = true;
+}
+
+static void period_end(void)
+{
+	// wakes seen with the config of the period that just ended
+	LOG_INF("%u s: GEN1 %u (%u without motion) GEN2 %u in %u batches with status",
+		all_samples / SENSOR_ODR_HZ, gen1_hits, gen1_still, gen2_hits, status_batches);
+
+	if (bg_samples >= WAKE_TUNE_FIRST_S * SENSOR_ODR_HZ) {
+		tune();
+	} else {
+		LOG_INF("%u s of background, keeping the thresholds", bg_samples / SENSOR_ODR_HZ);
+	}
+
+	memset(episodes, 0, sizeof(episodes));
+	memset(hist, 0, sizeof(hist));
+	bg_samples = 0;
+	all_samples = 0;
+	status_batches = 0;
+	gen1_hits = gen1_still = gen2_hits = 0;
+}
+
+void wake_tune_process(const struct bma400_fifo_sensor_data *samples, uint16_t count,
+		       uint16_t int_status, bool status_read)
+{
+	uint16_t batch_peak_mg = 0;
+
+	for (int i = 0; i < count; i++) {
+		const int32_t v[3] = { samples[i].x, samples[i].y, samples[i].z };
+		int32_t dev = 0;
+
+		if (!primed) {
+			for (int a = 0; a < 3; a++) {
+				ref_q15[a] = v[a] * (1 << 15);
+			}
+			primed = true;
+		}
+		// against the reference before this sample moves it, like the sensor
+		for (int a = 0; a < 3; a++) {
+			int32_t d = v[a] - (ref_q15[a] >> 15);
+
+			dev = MAX(dev, d < 0 ? -d : d);
+			ref_q15[a] += (int32_t)(((int64_t)((v[a] * (1 << 15)) - ref_q15[a]) * REF_ALPHA_Q15) >> 15);
+		}
+
+		uint32_t mg = (uint32_t)dev * 1000 / SENSOR_LSB_PER_G;
+		int above = MIN(DIV_ROUND_UP(mg, STEP_MG), WAKE_TUNE_BINS); // thresholds mg is over
+
+		batch_peak_mg = MAX(batch_peak_mg, MIN(mg, UINT16_MAX));
+		win_peak_mg = MAX(win_peak_mg, MIN(mg, UINT16_MAX));
+		win_hist[MIN(mg / STEP_MG, WAKE_TUNE_BINS)]++;
+		for (int b = 0; b < above; b++) {
+			if (run[b] < UINT8_MAX) {
+				run[b]++;
+			}
+			for (int k = 0; k < N_DUR; k++) {
+				if (run[b] == durations[k]) {
+					win_ep[k][b]++;
+				}
+			}
+		}
+		for (int b = above; b < WAKE_TUNE_BINS && run[b]; b++) {
+			run[b] = 0;
+		}
+
+		all_samples++;
+		if (++win_n >= SENSOR_ODR_HZ) {
+			close_window();
+		}
+	}
+
+	if (status_read) {
+		status_batches++;
+		if (int_status & BMA400_ASSERTED_GEN1_INT) {
+			gen1_hits++;
+			if (batch_peak_mg < WAKE_TUNE_MOTION_MG) {
+				gen1_still++;
+			}
+		}
+		if (int_status & BMA400_ASSERTED_GEN2_INT) {
+			gen2_hits++;
+		}
+	}
+
+	if (!tuned ? bg_samples >= WAKE_TUNE_FIRST_S * SENSOR_ODR_HZ :
+		     all_samples >= WAKE_TUNE_PERIOD_S * SENSOR_ODR_HZ) {
+		period_end();
+	}
+}
+
+bool wake_tune_take(struct wake_tune_cfg *cfg)
+{
+	if (!pending) {
+		return false;
+	}
+	*cfg = next_cfg;
+	pending = false;
+	return true;
+}
@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/util.h>
+#include "wear_state.h"
+#include "sensor_cfg.h"
+
+LOG_MODULE_REGISTER(wear_state, LOG_LEVEL_INF);
+
+#define STILL_LSB   (WEAR_STILL_MG * SENSOR_LSB_PER_G / 1000)
+#define ORIENT_LSB  (WEAR_ORIENT_MG * SENSOR_LSB_PER_G / 1000)
+
+// open window
+static struct {
+	uint32_t n;
+	int32_t sum[3];
+	uint64_t sumsq[3];
+	uint16_t bits;      // every sample OR'd, its lowest set bit is the quantum
+} win;
+
+static int16_t prev_mean[3];
+static bool have_prev;
+static uint32_t still_s;
+
+static int16_t temp_dc;
+static int16_t still_temp_max;   // warmest reading since the stillness began
+static bool temp_valid;
+static bool temp_due = true;
+
+static bool worn = true;
+static bool off_pending;
+
+static uint32_t since_ms;
+static uint64_t worn_ms;
+static uint64_t off_ms;
+static uint32_t off_count;
+
+static void account(void)
+{
+	uint32_t now = k_uptime_get_32();
+
+	if (worn) {
+		worn_ms += now - since_ms;
+	} else {
+		off_ms += now - since_ms;
+	}
+	since_ms = now;
+}
+
+static bool looks_off(void)
+{
+	if (still_s >= WEAR_OFF_LONG_S) {
+		return true;
+	}
+	if (still_s < WEAR_OFF_S || !temp_valid) {
+		return false;
+	}
+	return temp_dc < WEAR_SKIN_DC || still_temp_max - temp_dc >= WEAR_COOL_DC;
+}
+
+static void close_window(void)
+{
+	// 8-bit FIFO frames (cascade and low-power profiles) step in 16 LSB,
+	// one quantum of dither is more than WEAR_STILL_MG, so the threshold
+	// is never below the resolution the data actually has
+	int32_t quantum = win.bits ? (win.bits & -win.bits) : 1;
+	int32_t still_lsb = MAX(STILL_LSB, quantum);
+	bool still = true;
+
+	for (int a = 0; a < 3; a++) {
+		int32_t mean = win.sum[a] / (int32_t)win.n;
+		// from the exact sums, a truncated mean is up to 2 * 512 LSB^2 off at 1 g
+		int64_t var = ((int64_t)win.sumsq[a] * win.n - (int64_t)win.sum[a] * win.sum[a]) /
+			      ((int64_t)win.n * win.n);
+
+		if (var > still_lsb * still_lsb) {
+			still = false;
+		}
+		if (have_prev && abs(mean - prev_mean[a]) > ORIENT_LSB) {
+			still = false;
+		}
+		prev_mean[a] = mean;
+	}
+	have_prev = true;
+	memset(&win, 0, sizeof(win));
+
+	still_s = still ? still_s + WEAR_WINDOW_S : 0;
+	temp_due = true;
+
+	if (!off_pending && looks_off()) {
+		LOG_INF("off body: still for %u s at %d.%d C (%d.%d C at the start)", still_s,
+			temp_dc / 10, abs(temp_dc % 10), still_temp_max / 10, abs(still_temp_max % 10));
+		off_pending = true;
+	}
+}
+
+void wear_state_process(const struct bma400_fifo_sensor_data *samples, uint16_t count)
+{
+	for (int i = 0; i < count; i++) {
+		const int16_t v[3] = { samples[i].x, samples[i].y, samples[i].z };
+
+		for (int a = 0; a < 3; a++) {
+			win.sum[a] += v[a];
+			win.sumsq[a] += (int32_t)v[a] * v[a];
+			win.bits |= (uint16_t)v[a];
+		}
+		if (++win.n >= WEAR_WINDOW_S * SENSOR_ODR_HZ) {
+			close_window();
+		}
+	}
+}
+
+bool wear_state_temp_due(void)
+{
+	return worn && temp_due;
+}
+
+void wear_state_temp(int16_t t)
+{
+	temp_dc = t;
+	temp_valid = true;
+	temp_due = false;
+	// a still spell starts out at the temperature it began with
+	still_temp_max = still_s ? MAX(still_temp_max, t) : t;
+}
+
+bool wear_state_take_off(void)
+{
+	if (!off_pending) {
+		return false;
+	}
+	off_pending = false;
+	account();
+	worn = false;
+	off_count++;
+	return true;
+}
+
+void wear_state_resume(void)
+{
+	struct wear_stats st;
+
+	account();
+	worn = true;
+	// a verdict from the batch still processed after the last take-off is stale
+	off_pending = false;
+	memset(&win, 0, sizeof(win));
+	have_prev = false;
+	still_s = 0;
+	temp_due = true;
+
+	wear_state_get_stats(&st);
+	LOG_INF("worn again; %u s worn, %u s off body in %u spells", st.worn_s, st.off_s,
+		st.off_count);
+}
+
+bool wear_state_worn(void)
+{
+	return worn;
+}
+
+void wear_state_get_stats(struct wear_stats *stats)
+{
+	uint32_t open_ms = k_uptime_get_32() - since_ms;
+
+	stats->worn_s = (worn_ms + (worn ? open_ms : 0)) / 1000;
+	stats->off_s = (off_ms + (worn ? 0 : open_ms)) / 1000;
+	stats->off_count = off_count;
+	stats->temp_dc = temp_dc;
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/ztest.h>
+#include "wear_state.h"
+#include "sensor_cfg.h"
+
+// Feeds the detector the way the drain does, a FIFO_SAMPLES block at a time.
+// Gravity sits on z, every axis dithers by up to +/-steps quanta around it
+// (16 LSB for 8-bit FIFO frames, 1 for 12-bit).
+static bool feed(uint32_t seconds, int16_t steps, int16_t quantum)
+{
+	static uint32_t lcg = 12345;
+	struct bma400_fifo_sensor_data blk[FIFO_SAMPLES];
+	uint32_t n = seconds * SENSOR_ODR_HZ;
+	bool off = false;
+
+	while (n) {
+		uint16_t count = MIN(n, FIFO_SAMPLES);
+
+		for (int i = 0; i < count; i++) {
+			int16_t d[3];
+
+			for (int a = 0; a < 3; a++) {
+				lcg = lcg * 1103515245U + 12345U;
+				d[a] = ((int32_t)((lcg >> 16) % (2 * steps + 1)) - steps) * quantum;
+			}
+			blk[i].x = d[0];
+			blk[i].y = d[1];
+			blk[i].z = SENSOR_LSB_PER_G + d[2];
+		}
+		wear_state_process(blk, count);
+		off = off || wear_state_take_off();
+		n -= count;
+	}
+	return off;
+}
+
+static void before(void *fixture)
+{
+	ARG_UNUSED(fixture);
+	wear_state_resume();
+}
+
+// no temperature readings, so only the WEAR_OFF_LONG_S rule can fire
+#define OFF_S (WEAR_OFF_LONG_S + WEAR_WINDOW_S)
+
+ZTEST(wear_state, test_still_12bit)
+{
+	zassert_true(feed(OFF_S, 3, 1), "12-bit still data not taken off");
+}
+
+ZTEST(wear_state, test_still_8bit)
+{
+	// one quantum of dither is over WEAR_STILL_MG on its own
+	zassert_true(feed(OFF_S, 1, 16), "8-bit still data not taken off");
+}
+
+ZTEST(wear_state, test_moving_12bit)
+{
+	// fine enough data keeps the WEAR_STILL_MG threshold
+	zassert_false(feed(OFF_S, 3, 4), "12-bit motion taken off");
+}
+
+ZTEST(wear_state, test_moving_8bit)
+{
+	zassert_false(feed(OFF_S, 8, 16), "8-bit motion taken off");
+}
+
+ZTEST_SUITE(wear_state, NULL, NULL, before, NULL, NULL);
@@ -0,0 +1,42 @@
+#!/usr/bin/env bash
+#
+# Copyright (c) 2024 Nordic Semiconductor
+#
+# SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+#
+# Replays recorded FIFO traces (fifo_trace.h format, captured on the trace
+# characteristic) through the firmware built for native_sim, one process per
+# trace, and collects the REPLAY report lines.
+#
+#   tools/replay.sh [-r] trace.ftrc...
+#
+# -r replays in real time, by default traces run as fast as the host allows.
+# Reports end up in build_replay/report.txt.
+
+set -eu
+
+: "${ZEPHYR_BASE:?}"
+
+RT=--no-rt
+if [ "${1:-}" = "-r" ]; then
+	RT=
+	shift
+fi
+[ $# -gt 0 ] || { echo "usage: $0 [-r] trace..." >&2; exit 1; }
+
+APP_DIR=$(cd "$(dirname "$0")/.." && pwd)
+OUT=$APP_DIR/build_replay
+
+west build -b native_sim --no-sysbuild -d "$OUT/app" "$APP_DIR"
+
+: > "$OUT/report.txt"
+for trace in "$@"; do
+	log=$OUT/$(basename "$trace").log
+	"$OUT/app/zephyr/zephyr.exe" $RT --trace="$(realpath "$trace")" > "$log" 2>&1 || {
+		echo "replay of $trace failed, see $log" >&2
+		exit 1
+	}
+	grep -h "REPLAY" "$log" | sed 's/^.*REPLAY/REPLAY/' >> "$OUT/report.txt"
+done
+
+grep "trace=" "$OUT/report.txt"